@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+struct AdaptivePollParams {
+  int64_t fast_interval_us;  // While the cursor moves
+  int64_t slow_interval_us;  // Longest interval once the cursor is still
+  int64_t idle_after_us;     // Stillness before the interval starts growing
+};
+
+// Polling schedule that idles when the cursor is still. Polls stay at the
+// fast interval while the cursor moves and for idle_after_us after; then
+// each still poll doubles the interval up to the slow one. The first moved
+// poll drops straight back to the fast interval, so motion is picked up at
+// most one slow interval late
+class AdaptivePollRate {
+ public:
+  explicit AdaptivePollRate(const AdaptivePollParams& params)
+      : params_(params), interval_us_(params.fast_interval_us) {}
+
+  // Reports one poll and returns the delay until the next one. Restores and
+  // animation frames run on their own timers, so they never pull polls in
+  int64_t OnPoll(bool moved, int64_t now_us) {
+    if (moved || !has_polled_) {
+      last_motion_us_ = now_us;
+      interval_us_ = params_.fast_interval_us;
+      has_polled_ = true;
+    } else if (now_us - last_motion_us_ >= params_.idle_after_us) {
+      interval_us_ = interval_us_ * 2 < params_.slow_interval_us
+                         ? interval_us_ * 2
+                         : params_.slow_interval_us;
+    }
+    return interval_us_;
+  }
+
+  int64_t interval_us() const { return interval_us_; }
+
+ private:
+  AdaptivePollParams params_;
+  int64_t interval_us_;
+  int64_t last_motion_us_ = 0;
+  bool has_polled_ = false;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "mpsc_queue.h"
+
+struct AsyncLoggerOptions {
+  std::filesystem::path path;
+  uint64_t max_file_bytes = 1 << 20;  // Rotate past this size, 0 never rotates
+  int max_files = 2;                  // Rotated files kept as path.1, path.2...
+};
+
+// Log file written from a background thread. Log() copies the message into a
+// fixed-size record in a lock-free queue and returns without allocating or
+// touching the file; the writer thread drains the queue in batches, formats
+// them into one buffer and writes it with a single call. Timestamps are
+// formatted once per second and reused. The file is opened lazily and
+// rotated when it would grow past max_file_bytes
+class AsyncLogger {
+ public:
+  static constexpr size_t kRecordSize = 256;
+  static constexpr size_t kMaxMessageSize =
+      kRecordSize - sizeof(int64_t) - sizeof(uint16_t);  // Longer is truncated
+  static constexpr size_t kQueueCapacity = 1024;
+  static constexpr size_t kBatchSize = 256;
+
+  explicit AsyncLogger(const AsyncLoggerOptions& options)
+      : options_(options), thread_(&AsyncLogger::ThreadMain, this) {}
+
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  // Writes everything logged so far before returning
+  ~AsyncLogger() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_.store(true);
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+  }
+
+  // Any thread. Drops the message and returns false if the queue is full
+  bool Log(std::string_view message) {
+    int64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    bool pushed = queue_.TryPush([&](Record& record) {
+      size_t size = message.size() < kMaxMessageSize ? message.size()
+                                                     : kMaxMessageSize;
+      record.time_us = time_us;
+      record.size = static_cast<uint16_t>(size);
+      std::memcpy(record.text, message.data(), size);
+    });
+    if (!pushed) {
+      dropped_count_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    // Pairs with the fence in WaitForWork(), as in SampleWorker::Post()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      sleeping_.store(false, std::memory_order_relaxed);
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      wake_cv_.notify_one();
+    }
+    return true;
+  }
+
+  // Blocks until every message logged before the call has been written
+  void Flush() {
+    uint64_t target = queue_.claimed_count();
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_cv_.wait(lock, [&] { return written_count_ >= target; });
+  }
+
+  uint64_t dropped_count() const {
+    return dropped_count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Record {
+    int64_t time_us;
+    uint16_t size;
+    char text[kMaxMessageSize];
+  };
+  static_assert(sizeof(Record) == kRecordSize, "Record is not packed");
+
+  void ThreadMain() {
+    std::string buffer;
+    buffer.reserve(kBatchSize * (kRecordSize + 32));
+    for (;;) {
+      bool stopping = stop_.load();
+      size_t count = queue_.PopBatch(
+          [&](const Record& record) { Format(record, &buffer); }, kBatchSize);
+      if (count > 0) {
+        Write(buffer);
+        buffer.clear();
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          written_count_ += count;
+        }
+        written_cv_.notify_all();
+        continue;
+      }
+      if (stopping) return;
+      WaitForWork();
+    }
+  }
+
+  void WaitForWork() {
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!queue_.Empty()) {
+      sleeping_.store(false, std::memory_order_relaxed);
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_cv_.wait(lock, [this] {
+      return !sleeping_.load(std::memory_order_relaxed) || stop_.load();
+    });
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+
+  // "YYYY-MM-DD HH:MM:SS.mmm - message\n"
+  void Format(const Record& record, std::string* out) {
+    int64_t second = record.time_us / 1000000;
+    if (second != cached_second_) {
+      std::time_t time = static_cast<std::time_t>(second);
+      std::tm local_time;
+#ifdef _WIN32
+      localtime_s(&local_time, &time);
+#else
+      localtime_r(&time, &local_time);
+#endif
+      cached_size_ = std::strftime(cached_prefix_, sizeof(cached_prefix_),
+                                   "%Y-%m-%d %H:%M:%S", &local_time);
+      cached_second_ = second;
+    }
+    int millis = static_cast<int>(record.time_us / 1000 % 1000);
+    char suffix[] = {'.',
+                     static_cast<char>('0' + millis / 100),
+                     static_cast<char>('0' + millis / 10 % 10),
+                     static_cast<char>('0' + millis % 10),
+                     ' ', '-', ' '};
+    out->append(cached_prefix_, cached_size_);
+    out->append(suffix, sizeof(suffix));
+    out->append(record.text, record.size);
+    out->push_back('\n');
+  }
+
+  void Write(const std::string& data) {
+    if (!file_.is_open()) Open();
+    if (options_.max_file_bytes > 0 && file_size_ > 0 &&
+        file_size_ + data.size() > options_.max_file_bytes) {
+      Rotate();
+      Open();
+    }
+    if (!file_.is_open()) return;
+    file_.write(data.data(), static_cast<std::streamsize>(data.size()));
+    file_.flush();
+    file_size_ += data.size();
+  }
+
+  void Open() {
+    file_.clear();
+    file_.open(options_.path, std::ios_base::binary | std::ios_base::app);
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(options_.path, error);
+    file_size_ = error ? 0 : static_cast<uint64_t>(size);
+  }
+
+  // path.(n-1) -> path.n, ..., path -> path.1. Errors leave the files as
+  // they are and the log keeps growing
+  void Rotate() {
+    file_.close();
+    file_size_ = 0;
+    std::error_code error;
+    if (options_.max_files <= 0) {
+      std::filesystem::remove(options_.path, error);
+      return;
+    }
+    for (int i = options_.max_files - 1; i >= 1; --i) {
+      std::filesystem::rename(RotatedPath(i), RotatedPath(i + 1), error);
+    }
+    std::filesystem::rename(options_.path, RotatedPath(1), error);
+  }
+
+  std::filesystem::path RotatedPath(int index) const {
+    std::filesystem::path path = options_.path;
+    path += "." + std::to_string(index);
+    return path;
+  }
+
+  const AsyncLoggerOptions options_;
+  MpscQueue<Record, kQueueCapacity> queue_;
+  std::atomic<bool> sleeping_{false};
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> dropped_count_{0};
+  std::mutex mutex_;
+  std::condition_variable wake_cv_;
+  std::condition_variable written_cv_;
+  uint64_t written_count_ = 0;  // Guarded by mutex_
+
+  // Writer thread only
+  std::ofstream file_;
+  uint64_t file_size_ = 0;
+  int64_t cached_second_ = -1;
+  char cached_prefix_[32] = {};
+  size_t cached_size_ = 0;
+
+  std::thread thread_;  // Last, so it starts after everything above
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "cursor_scaler.h"
+
+// Smoothstep ease-in/ease-out over t in [0, 1]
+inline double EaseInOut(double t) {
+  if (t <= 0.0) return 0.0;
+  if (t >= 1.0) return 1.0;
+  return t * t * (3.0 - 2.0 * t);
+}
+
+// All frames of a grow animation rendered once into one contiguous pixel
+// buffer. Frame 0 is the smallest step above the original size and the last
+// frame is the fully enlarged cursor; shrinking plays the frames backwards
+class FrameAtlas {
+ public:
+  struct Frame {
+    size_t offset;  // Index of the first pixel in the atlas
+    int width;
+    int height;
+    int hotspot_x;
+    int hotspot_y;
+    bool monochrome;
+    double scale;
+  };
+
+  // Eased scale for each frame, ending exactly at target_scale
+  static std::vector<double> FrameScales(double target_scale, int frame_count) {
+    std::vector<double> scales;
+    for (int i = 1; i <= frame_count; ++i) {
+      double t = static_cast<double>(i) / frame_count;
+      scales.push_back(1.0 + (target_scale - 1.0) * EaseInOut(t));
+    }
+    return scales;
+  }
+
+  static FrameAtlas Build(const CursorImage& source, double target_scale,
+                          int frame_count, ScaleFilter filter) {
+    FrameAtlas atlas;
+    for (double scale : FrameScales(target_scale, frame_count)) {
+      atlas.AddFrame(CursorScaler::ScaleCursorImage(source, scale, filter),
+                     scale);
+    }
+    return atlas;
+  }
+
+  void AddFrame(const CursorImage& image, double scale) {
+    Frame frame;
+    frame.offset = pixels_.size();
+    frame.width = image.pixels.width;
+    frame.height = image.pixels.height;
+    frame.hotspot_x = image.hotspot_x;
+    frame.hotspot_y = image.hotspot_y;
+    frame.monochrome = image.monochrome;
+    frame.scale = scale;
+    frames_.push_back(frame);
+    pixels_.insert(pixels_.end(), image.pixels.pixels.begin(),
+                   image.pixels.pixels.end());
+  }
+
+  CursorImage FrameImage(int index) const {
+    const Frame& frame = frames_[index];
+    CursorImage image;
+    image.pixels.width = frame.width;
+    image.pixels.height = frame.height;
+    image.hotspot_x = frame.hotspot_x;
+    image.hotspot_y = frame.hotspot_y;
+    image.monochrome = frame.monochrome;
+    const uint32_t* first = FramePixels(index);
+    image.pixels.pixels.assign(
+        first, first + static_cast<size_t>(frame.width) * frame.height);
+    return image;
+  }
+
+  const uint32_t* FramePixels(int index) const {
+    return pixels_.data() + frames_[index].offset;
+  }
+
+  const Frame& frame(int index) const { return frames_[index]; }
+  int frame_count() const { return static_cast<int>(frames_.size()); }
+
+  // Memory held by the pixels and the frame table
+  size_t byte_size() const {
+    return pixels_.size() * sizeof(uint32_t) + frames_.size() * sizeof(Frame);
+  }
+
+ private:
+  std::vector<Frame> frames_;
+  std::vector<uint32_t> pixels_;
+};
+
+// Deadline-based pacing of animation steps. Step k is due at a fixed offset
+// from the start, so a late wakeup jumps to the latest due step instead of
+// replaying the missed ones and the animation never drifts
+class FramePacer {
+ public:
+  static constexpr int64_t kNoDeadline = std::numeric_limits<int64_t>::max();
+
+  // Runs steps first_step..step_count - 1. first_step is due immediately and
+  // the last step at start_us + duration_us * (remaining fraction)
+  void Start(int64_t start_us, int64_t duration_us, int step_count,
+             int first_step = 0) {
+    start_us_ = start_us;
+    duration_us_ = duration_us > 0 ? duration_us : 0;
+    step_count_ = step_count;
+    first_step_ = first_step < step_count ? first_step : step_count - 1;
+    shown_step_ = first_step_ - 1;
+    running_ = step_count_ > 0;
+  }
+
+  void Stop() { running_ = false; }
+
+  // Returns the step to show now, or -1 if the shown step is still current
+  int Advance(int64_t now_us) {
+    if (!running_) return -1;
+    int due = DueStep(now_us);
+    if (due == shown_step_) return -1;
+    shown_step_ = due;
+    if (shown_step_ >= step_count_ - 1) {
+      running_ = false;
+    }
+    return shown_step_;
+  }
+
+  // Time the next step becomes due, or kNoDeadline when finished
+  int64_t NextDeadline() const {
+    if (!running_) return kNoDeadline;
+    return StepTime(shown_step_ + 1);
+  }
+
+  bool running() const { return running_; }
+  int shown_step() const { return shown_step_; }
+
+ private:
+  int Intervals() const { return step_count_ - 1 > 0 ? step_count_ - 1 : 1; }
+
+  int64_t StepTime(int step) const {
+    int64_t k = step - first_step_;
+    // Round up so a step is never reported due before its time
+    return start_us_ + (duration_us_ * k + Intervals() - 1) / Intervals();
+  }
+
+  int DueStep(int64_t now_us) const {
+    if (now_us < start_us_) return first_step_;
+    if (duration_us_ == 0) return step_count_ - 1;
+    int64_t elapsed = now_us - start_us_;
+    int64_t step = first_step_ + elapsed * Intervals() / duration_us_;
+    return step >= step_count_ - 1 ? step_count_ - 1 : static_cast<int>(step);
+  }
+
+  int64_t start_us_ = 0;
+  int64_t duration_us_ = 0;
+  int step_count_ = 0;
+  int first_step_ = 0;
+  int shown_step_ = -1;
+  bool running_ = false;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+
+#include "cursor_animation.h"
+#include "cursor_swap_scheduler.h"
+#include "enlarge_state_machine.h"
+#include "latency_recorder.h"
+#include "monotonic_clock.h"
+
+struct CursorAnimationParams {
+  EnlargeTiming timing;
+  int frame_count;      // Frames up to the fully enlarged one, 1 disables
+                        // the animation
+  int64_t duration_us;  // Grow and shrink duration
+  CursorSwapScheduler::Mode swap_mode;
+};
+
+// Turns shake decisions into cursor swaps: the enlarge state machine decides
+// when to enlarge and restore, and the frame pacer plays the grow and shrink
+// animations on the platform's pre-rendered frames. Nothing here allocates,
+// so it can run on every mouse event
+class CursorAnimator {
+ public:
+  CursorAnimator(CursorSwapPlatform* platform, const MonotonicClock* clock,
+                 LatencyRecorder* latency, const CursorAnimationParams& params)
+      : clock_(clock),
+        latency_(latency),
+        params_(params),
+        swap_scheduler_(platform, params.swap_mode),
+        state_machine_(params.timing) {}
+
+  // Feeds one shake detector decision. A shake while enlarged keeps the
+  // cursor enlarged instead of restoring and enlarging it again. Returns the
+  // action taken, after the cursor has been swapped
+  EnlargeStateMachine::Action OnDetection(bool shaking) {
+    int64_t now_us = clock_->NowMicros();
+    int64_t deadline_us = state_machine_.NextDeadline();
+    EnlargeStateMachine::Action action =
+        state_machine_.OnDetection(shaking, now_us);
+    Apply(action, now_us, deadline_us);
+    Animate(now_us);
+    return action;
+  }
+
+  // Applies expired deadlines and advances the animation
+  void Tick() {
+    int64_t now_us = clock_->NowMicros();
+    int64_t deadline_us = state_machine_.NextDeadline();
+    Apply(state_machine_.Tick(now_us), now_us, deadline_us);
+    Animate(now_us);
+  }
+
+  // Time of the next frame or state change, or FramePacer::kNoDeadline
+  int64_t NextDeadline() const {
+    int64_t deadline = state_machine_.NextDeadline();
+    if (phase_ == Phase::kGrowing || phase_ == Phase::kShrinking) {
+      int64_t frame_deadline = pacer_.NextDeadline();
+      if (frame_deadline < deadline) {
+        deadline = frame_deadline;
+      }
+    }
+    return deadline;
+  }
+
+  void set_timing(const EnlargeTiming& timing) {
+    params_.timing = timing;
+    state_machine_.set_timing(timing);
+  }
+
+  uint64_t enlarge_count() const { return state_machine_.enlarge_count(); }
+  uint64_t swap_count() const { return swap_scheduler_.swap_count(); }
+
+ private:
+  enum class Phase { kIdle, kGrowing, kHolding, kShrinking };
+
+  // Shrinking plays the frames below the largest one backwards and ends on
+  // the original cursor, which is frame -1
+  int ShrinkStepToFrame(int step) const {
+    if (step < 0) return params_.frame_count - 1;
+    return params_.frame_count - 2 - step;
+  }
+
+  int FrameToShrinkStep(int frame) const {
+    return params_.frame_count - 2 - frame;
+  }
+
+  // deadline_us is the state machine deadline before the action was taken
+  void Apply(EnlargeStateMachine::Action action, int64_t now_us,
+             int64_t deadline_us) {
+    if (action == EnlargeStateMachine::Action::kEnlarge) {
+      StartGrowing(now_us);
+    } else if (action == EnlargeStateMachine::Action::kRestore) {
+      if (latency_->enabled()) {
+        latency_->Record(LatencyRecorder::kRestoreDelay,
+                         (now_us - deadline_us) * 1000);
+      }
+      StartShrinking(now_us);
+    }
+  }
+
+  // Grows the cursor, or grows it back if it is shrinking
+  void StartGrowing(int64_t now_us) {
+    if (phase_ == Phase::kIdle) {
+      TimedSwap([this] { swap_scheduler_.Enlarge(0); });
+      phase_ = Phase::kGrowing;
+      pacer_.Start(now_us, params_.duration_us, params_.frame_count);
+    } else if (phase_ == Phase::kShrinking) {
+      // Continue from the frame on screen instead of jumping back to frame 0
+      int shown_frame = ShrinkStepToFrame(pacer_.shown_step());
+      phase_ = Phase::kGrowing;
+      pacer_.Start(now_us, params_.duration_us,
+                   params_.frame_count, shown_frame + 1);
+    }
+  }
+
+  // Shrinks the cursor from the frame on screen
+  void StartShrinking(int64_t now_us) {
+    if (phase_ != Phase::kGrowing && phase_ != Phase::kHolding) return;
+    int shown_frame = phase_ == Phase::kGrowing
+                          ? pacer_.shown_step()
+                          : params_.frame_count - 1;
+    phase_ = Phase::kShrinking;
+    pacer_.Start(now_us, params_.duration_us, params_.frame_count,
+                 FrameToShrinkStep(shown_frame - 1));
+  }
+
+  void Animate(int64_t now_us) {
+    if (phase_ == Phase::kIdle) return;
+    swap_scheduler_.TrackShape();
+
+    if (phase_ == Phase::kGrowing) {
+      int step = pacer_.Advance(now_us);
+      if (step >= 0) {
+        TimedSwap([this, step] { swap_scheduler_.ShowFrame(step); });
+      }
+      if (!pacer_.running()) {
+        phase_ = Phase::kHolding;
+      }
+    }
+
+    if (phase_ == Phase::kShrinking) {
+      int step = pacer_.Advance(now_us);
+      if (step >= 0) {
+        int frame = ShrinkStepToFrame(step);
+        if (frame >= 0) {
+          TimedSwap([this, frame] { swap_scheduler_.ShowFrame(frame); });
+        } else {
+          RestoreOriginalCursor();
+        }
+      }
+    }
+  }
+
+  void RestoreOriginalCursor() {
+    if (phase_ != Phase::kIdle) {
+      // Restore the system cursors that were swapped
+      pacer_.Stop();
+      TimedSwap([this] { swap_scheduler_.Restore(); });
+      phase_ = Phase::kIdle;
+    }
+  }
+
+  // Runs one round of cursor swaps, timing it while latency is recorded
+  template <typename Swap>
+  void TimedSwap(Swap swap) {
+    if (!latency_->enabled()) {
+      swap();
+      return;
+    }
+    int64_t start_ns = MonotonicNanos();
+    swap();
+    latency_->Record(LatencyRecorder::kCursorSwap, MonotonicNanos() - start_ns);
+  }
+
+  const MonotonicClock* clock_;
+  LatencyRecorder* latency_;
+  CursorAnimationParams params_;
+  CursorSwapScheduler swap_scheduler_;
+  EnlargeStateMachine state_machine_;
+  FramePacer pacer_;
+  Phase phase_ = Phase::kIdle;
+};
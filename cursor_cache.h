@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+#include "cursor_scaler.h"
+#include "mapped_file.h"
+
+// On-disk cache of scaled cursors, so startup can skip scaling entirely.
+// The file is little-endian and laid out as
+//
+//   Header | Entry[entry_count] | pixel data
+//
+// Each entry is keyed by a hash of the source cursor bits, the scale factor,
+// the DPI and the filter. Bump kVersion whenever the layout or the scaler
+// output changes so stale caches are ignored
+class CursorCache {
+ public:
+  static constexpr uint32_t kMagic = 0x43465453;  // "STFC"
+  static constexpr uint32_t kVersion = 2;
+
+ private:
+  static constexpr uint32_t kFlagMonochrome = 1;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+  };
+
+  struct Entry {
+    uint64_t key;
+    int32_t width;
+    int32_t height;
+    int32_t hotspot_x;
+    int32_t hotspot_y;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t pixel_offset;
+  };
+
+  static_assert(sizeof(Header) == 16, "Unexpected cache header layout");
+  static_assert(sizeof(Entry) == 40, "Unexpected cache entry layout");
+
+ public:
+  // FNV-1a over everything that affects the scaled result
+  static uint64_t MakeKey(const CursorImage& source, double scale_factor,
+                          int dpi, ScaleFilter filter) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+      const uint8_t* bytes = static_cast<const uint8_t*>(data);
+      for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+      }
+    };
+    int32_t fields[6] = {source.pixels.width, source.pixels.height,
+                         source.hotspot_x,    source.hotspot_y,
+                         source.monochrome,   static_cast<int32_t>(filter)};
+    mix(fields, sizeof(fields));
+    mix(&scale_factor, sizeof(scale_factor));
+    mix(&dpi, sizeof(dpi));
+    mix(&kVersion, sizeof(kVersion));
+    mix(source.pixels.pixels.data(),
+        source.pixels.pixels.size() * sizeof(uint32_t));
+    return hash;
+  }
+
+  // Memory-maps a cache file. Lookups copy only the pixels of the hit
+  class Reader {
+   public:
+    bool Open(const std::filesystem::path& path) {
+      if (!file_.Open(path)) return false;
+      if (!Validate()) {
+        file_.Close();
+        return false;
+      }
+      return true;
+    }
+
+    void Close() { file_.Close(); }
+
+    bool Find(uint64_t key, CursorImage* image) const {
+      if (!file_.is_open()) return false;
+      const Entry* entries = FileEntries();
+      for (uint32_t i = 0; i < FileHeader()->entry_count; ++i) {
+        const Entry& entry = entries[i];
+        if (entry.key != key) continue;
+
+        image->pixels.width = entry.width;
+        image->pixels.height = entry.height;
+        image->hotspot_x = entry.hotspot_x;
+        image->hotspot_y = entry.hotspot_y;
+        image->monochrome = (entry.flags & kFlagMonochrome) != 0;
+        size_t count = static_cast<size_t>(entry.width) * entry.height;
+        image->pixels.pixels.resize(count);
+        std::memcpy(image->pixels.pixels.data(),
+                    file_.data() + entry.pixel_offset,
+                    count * sizeof(uint32_t));
+        return true;
+      }
+      return false;
+    }
+
+   private:
+    const Header* FileHeader() const {
+      return reinterpret_cast<const Header*>(file_.data());
+    }
+
+    const Entry* FileEntries() const {
+      return reinterpret_cast<const Entry*>(file_.data() + sizeof(Header));
+    }
+
+    // Rejects truncated, foreign or outdated files
+    bool Validate() const {
+      if (file_.size() < sizeof(Header)) return false;
+      const Header* header = FileHeader();
+      if (header->magic != kMagic || header->version != kVersion) {
+        return false;
+      }
+      uint64_t table_end = sizeof(Header) +
+                           static_cast<uint64_t>(header->entry_count) *
+                               sizeof(Entry);
+      if (table_end > file_.size()) return false;
+
+      const Entry* entries = FileEntries();
+      for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const Entry& entry = entries[i];
+        if (entry.width <= 0 || entry.height <= 0) return false;
+        uint64_t bytes = static_cast<uint64_t>(entry.width) * entry.height *
+                         sizeof(uint32_t);
+        if (entry.pixel_offset < table_end || entry.pixel_offset % 4 != 0 ||
+            entry.pixel_offset + bytes > file_.size()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    MappedFile file_;
+  };
+
+  // Collects entries and writes them out in one go
+  class Writer {
+   public:
+    void Add(uint64_t key, const CursorImage& image) {
+      items_.push_back({key, image});
+    }
+
+    // Writes to a temporary file first so readers never see a partial cache
+    bool Write(const std::filesystem::path& path) const {
+      std::filesystem::path temp_path = path;
+      temp_path += ".tmp";
+      {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        Header header = {};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.entry_count = static_cast<uint32_t>(items_.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        uint64_t offset = sizeof(header) + items_.size() * sizeof(Entry);
+        for (const Item& item : items_) {
+          const BgraImage& pixels = item.image.pixels;
+          Entry entry = {};
+          entry.key = item.key;
+          entry.width = pixels.width;
+          entry.height = pixels.height;
+          entry.hotspot_x = item.image.hotspot_x;
+          entry.hotspot_y = item.image.hotspot_y;
+          entry.flags = item.image.monochrome ? kFlagMonochrome : 0;
+          entry.pixel_offset = offset;
+          out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+          offset += pixels.pixels.size() * sizeof(uint32_t);
+        }
+        for (const Item& item : items_) {
+          const std::vector<uint32_t>& pixels = item.image.pixels.pixels;
+          out.write(reinterpret_cast<const char*>(pixels.data()),
+                    static_cast<std::streamsize>(pixels.size() *
+                                                 sizeof(uint32_t)));
+        }
+        if (!out) return false;
+      }
+
+      std::error_code error;
+      std::filesystem::rename(temp_path, path, error);
+      return !error;
+    }
+
+    bool empty() const { return items_.empty(); }
+
+   private:
+    struct Item {
+      uint64_t key;
+      CursorImage image;
+    };
+
+    std::vector<Item> items_;
+  };
+};
@@ -0,0 +1,442 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// SSE2 follows the compiler's target. The AVX2 kernel is compiled for AVX2
+// on its own and only runs when the CPU has it, so one build runs anywhere
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CURSOR_SCALER_SSE2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CURSOR_SCALER_AVX2 1
+#define CURSOR_SCALER_TARGET_AVX2
+#elif defined(__GNUC__)
+#define CURSOR_SCALER_AVX2 1
+#define CURSOR_SCALER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// 32-bit pixels, B, G, R, A in memory order (0xAARRGGBB), rows top-down
+struct BgraImage {
+  int width = 0;
+  int height = 0;
+  std::vector<uint32_t> pixels;
+};
+
+// Cursor bitmap in a platform independent form. Color cursors carry straight
+// (not premultiplied) alpha. Monochrome cursors keep their AND plane in the
+// blue channel and their XOR plane in the green channel, each 0 or 255, so
+// that screen inversion survives scaling
+struct CursorImage {
+  BgraImage pixels;
+  int hotspot_x = 0;
+  int hotspot_y = 0;
+  bool monochrome = false;
+};
+
+enum class ScalerKernel {
+  kScalar,
+  kSse2,
+  kAvx2  // SSE2 plus AVX2 for the vertical pass
+};
+
+enum class ScaleFilter {
+  kBilinear,  // Triangle filter
+  kArea,      // Exact pixel coverage, crisp when enlarging
+  kLanczos3   // Windowed sinc with three lobes
+};
+
+// Separable cursor bitmap scaler working on premultiplied BGRA. The inner
+// loops use the best kernel the CPU runs, picked once at first use. Every
+// kernel produces the same pixels
+class CursorScaler {
+ public:
+  static ScalerKernel BestKernel() {
+    static const ScalerKernel best = DetectKernel();
+    return best;
+  }
+
+  static bool KernelSupported(ScalerKernel kernel) {
+    return kernel <= BestKernel();
+  }
+
+  static const char* KernelName(ScalerKernel kernel = BestKernel()) {
+    switch (kernel) {
+      case ScalerKernel::kAvx2:
+        return "avx2";
+      case ScalerKernel::kSse2:
+        return "sse2";
+      default:
+        return "scalar";
+    }
+  }
+
+  // Scales a premultiplied image. Colors in the result never exceed alpha.
+  // kernel must be supported
+  static BgraImage Scale(const BgraImage& src, int dst_width, int dst_height,
+                         ScaleFilter filter,
+                         ScalerKernel kernel = BestKernel()) {
+    BgraImage dst;
+    if (src.width <= 0 || src.height <= 0 || dst_width <= 0 ||
+        dst_height <= 0) {
+      return dst;
+    }
+    dst.width = dst_width;
+    dst.height = dst_height;
+    dst.pixels.resize(static_cast<size_t>(dst_width) * dst_height);
+
+    FilterTable columns = BuildFilterTable(src.width, dst_width, filter);
+    FilterTable rows = BuildFilterTable(src.height, dst_height, filter);
+
+    // Horizontal pass into a float buffer of dst_width x src.height pixels
+    std::vector<float> horizontal(static_cast<size_t>(dst_width) * src.height *
+                                  4);
+    for (int y = 0; y < src.height; ++y) {
+      HorizontalRow(kernel, &src.pixels[static_cast<size_t>(y) * src.width],
+                    columns,
+                    &horizontal[static_cast<size_t>(y) * dst_width * 4]);
+    }
+
+    // Vertical pass, one accumulated row at a time
+    std::vector<float> accum(static_cast<size_t>(dst_width) * 4);
+    for (int y = 0; y < dst_height; ++y) {
+      const Contribution& c = rows.contributions[y];
+      const float* weights = &rows.weights[c.weight_offset];
+      std::fill(accum.begin(), accum.end(), 0.0f);
+      for (int k = 0; k < c.count; ++k) {
+        AccumulateRow(
+            kernel,
+            &horizontal[static_cast<size_t>(c.first + k) * dst_width * 4],
+            weights[k], accum.data(), accum.size());
+      }
+      StoreRow(kernel, accum.data(), dst_width,
+               &dst.pixels[static_cast<size_t>(y) * dst_width]);
+    }
+    return dst;
+  }
+
+  // Scales a cursor, hotspot included
+  static CursorImage ScaleCursorImage(const CursorImage& src,
+                                      double scale_factor, ScaleFilter filter) {
+    CursorImage dst;
+    int width = static_cast<int>(src.pixels.width * scale_factor);
+    int height = static_cast<int>(src.pixels.height * scale_factor);
+    dst.hotspot_x = static_cast<int>(src.hotspot_x * scale_factor);
+    dst.hotspot_y = static_cast<int>(src.hotspot_y * scale_factor);
+    dst.monochrome = src.monochrome;
+
+    if (src.monochrome) {
+      // Planes are opaque, so scale them as they are and snap back to 0/255
+      dst.pixels = Scale(src.pixels, width, height, ScaleFilter::kArea);
+      for (uint32_t& pixel : dst.pixels.pixels) {
+        uint32_t and_bit = (pixel & 0xFF) >= 128 ? 0xFF : 0;
+        uint32_t xor_bit = ((pixel >> 8) & 0xFF) >= 128 ? 0xFF00 : 0;
+        pixel = 0xFF000000 | xor_bit | and_bit;
+      }
+    } else {
+      BgraImage premultiplied = src.pixels;
+      Premultiply(&premultiplied);
+      dst.pixels = Scale(premultiplied, width, height, filter);
+      Unpremultiply(&dst.pixels);
+    }
+    return dst;
+  }
+
+  static void Premultiply(BgraImage* image) {
+    for (uint32_t& pixel : image->pixels) {
+      uint32_t a = pixel >> 24;
+      uint32_t b = ((pixel & 0xFF) * a + 127) / 255;
+      uint32_t g = (((pixel >> 8) & 0xFF) * a + 127) / 255;
+      uint32_t r = (((pixel >> 16) & 0xFF) * a + 127) / 255;
+      pixel = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+  }
+
+  static void Unpremultiply(BgraImage* image) {
+    for (uint32_t& pixel : image->pixels) {
+      uint32_t a = pixel >> 24;
+      if (a == 0) {
+        pixel = 0;
+        continue;
+      }
+      uint32_t b = std::min<uint32_t>(255, ((pixel & 0xFF) * 255 + a / 2) / a);
+      uint32_t g = std::min<uint32_t>(
+          255, (((pixel >> 8) & 0xFF) * 255 + a / 2) / a);
+      uint32_t r = std::min<uint32_t>(
+          255, (((pixel >> 16) & 0xFF) * 255 + a / 2) / a);
+      pixel = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+  }
+
+  // 1-bpp mask rows padded to 16 bits, as CreateBitmap expects. For color
+  // cursors the AND mask is derived from the scaled alpha; monochrome cursors
+  // get the AND plane followed by the XOR plane
+  static std::vector<uint8_t> BuildMaskBits(const CursorImage& image) {
+    const BgraImage& pixels = image.pixels;
+    size_t stride = static_cast<size_t>((pixels.width + 15) / 16) * 2;
+    int planes = image.monochrome ? 2 : 1;
+    std::vector<uint8_t> bits(stride * pixels.height * planes, 0);
+
+    for (int plane = 0; plane < planes; ++plane) {
+      for (int y = 0; y < pixels.height; ++y) {
+        uint8_t* row = &bits[(static_cast<size_t>(plane) * pixels.height + y) *
+                             stride];
+        const uint32_t* src = &pixels.pixels[static_cast<size_t>(y) *
+                                             pixels.width];
+        for (int x = 0; x < pixels.width; ++x) {
+          bool set;
+          if (!image.monochrome) {
+            set = (src[x] >> 24) < kMaskAlphaThreshold;
+          } else if (plane == 0) {
+            set = (src[x] & 0xFF) != 0;
+          } else {
+            set = ((src[x] >> 8) & 0xFF) != 0;
+          }
+          if (set) {
+            row[x >> 3] |= static_cast<uint8_t>(0x80 >> (x & 7));
+          }
+        }
+      }
+    }
+    return bits;
+  }
+
+ private:
+  static constexpr uint32_t kMaskAlphaThreshold = 128;
+
+  static ScalerKernel DetectKernel() {
+#if defined(CURSOR_SCALER_AVX2) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+      __cpuid(info, 1);
+      // AVX2 also needs the OS to save the YMM registers
+      bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                 (_xgetbv(0) & 6) == 6;
+      __cpuidex(info, 7, 0);
+      if (avx && (info[1] & (1 << 5)) != 0) return ScalerKernel::kAvx2;
+    }
+#elif defined(CURSOR_SCALER_AVX2)
+    if (__builtin_cpu_supports("avx2")) return ScalerKernel::kAvx2;
+#endif
+#if defined(CURSOR_SCALER_SSE2)
+    return ScalerKernel::kSse2;
+#else
+    return ScalerKernel::kScalar;
+#endif
+  }
+
+  struct Contribution {
+    int first;          // First source pixel
+    int count;          // Number of source pixels
+    int weight_offset;  // Index of the first weight in FilterTable::weights
+  };
+
+  struct FilterTable {
+    std::vector<Contribution> contributions;
+    std::vector<float> weights;
+  };
+
+  static double Sinc(double x) {
+    const double kPi = 3.14159265358979323846;
+    if (x == 0.0) return 1.0;
+    return std::sin(kPi * x) / (kPi * x);
+  }
+
+  static double FilterWeight(ScaleFilter filter, double t) {
+    t = std::abs(t);
+    switch (filter) {
+      case ScaleFilter::kLanczos3:
+        return (t < 3.0) ? Sinc(t) * Sinc(t / 3.0) : 0.0;
+      case ScaleFilter::kBilinear:
+      default:
+        return (t < 1.0) ? 1.0 - t : 0.0;
+    }
+  }
+
+  static double FilterSupport(ScaleFilter filter) {
+    return (filter == ScaleFilter::kLanczos3) ? 3.0 : 1.0;
+  }
+
+  // Precomputes normalized weights for every destination pixel of one axis
+  static FilterTable BuildFilterTable(int src_size, int dst_size,
+                                      ScaleFilter filter) {
+    FilterTable table;
+    table.contributions.resize(dst_size);
+
+    double inv_scale = static_cast<double>(src_size) / dst_size;
+    // Widen the kernel when shrinking so every source pixel contributes
+    double filter_scale = std::max(1.0, inv_scale);
+
+    std::vector<double> raw;
+    for (int x = 0; x < dst_size; ++x) {
+      int first;
+      int last;
+      raw.clear();
+
+      if (filter == ScaleFilter::kArea) {
+        double left = x * inv_scale;
+        double right = (x + 1) * inv_scale;
+        first = std::max(0, static_cast<int>(std::floor(left)));
+        last = std::min(src_size - 1, static_cast<int>(std::ceil(right)) - 1);
+        for (int j = first; j <= last; ++j) {
+          double pixel_left = static_cast<double>(j);
+          raw.push_back(std::min(right, pixel_left + 1.0) -
+                        std::max(left, pixel_left));
+        }
+      } else {
+        double center = (x + 0.5) * inv_scale;
+        double support = FilterSupport(filter) * filter_scale;
+        first = std::max(0, static_cast<int>(std::floor(center - support)));
+        last = std::min(src_size - 1,
+                        static_cast<int>(std::ceil(center + support)));
+        for (int j = first; j <= last; ++j) {
+          double t = (j + 0.5 - center) / filter_scale;
+          raw.push_back(FilterWeight(filter, t));
+        }
+      }
+
+      // Trim zero weights at the ends to keep the inner loops short
+      size_t begin = 0;
+      size_t end = raw.size();
+      while (begin < end && raw[begin] == 0.0) ++begin;
+      while (end > begin && raw[end - 1] == 0.0) --end;
+
+      double sum = 0.0;
+      for (size_t k = begin; k < end; ++k) sum += raw[k];
+
+      Contribution& c = table.contributions[x];
+      c.weight_offset = static_cast<int>(table.weights.size());
+      if (end == begin || sum == 0.0) {
+        // Degenerate footprint, fall back to the nearest pixel
+        c.first = std::min(src_size - 1,
+                           static_cast<int>((x + 0.5) * inv_scale));
+        c.count = 1;
+        table.weights.push_back(1.0f);
+        continue;
+      }
+      c.first = first + static_cast<int>(begin);
+      c.count = static_cast<int>(end - begin);
+      for (size_t k = begin; k < end; ++k) {
+        table.weights.push_back(static_cast<float>(raw[k] / sum));
+      }
+    }
+    return table;
+  }
+
+  static void HorizontalRow(ScalerKernel kernel, const uint32_t* src,
+                            const FilterTable& columns, float* out) {
+    size_t dst_width = columns.contributions.size();
+    for (size_t x = 0; x < dst_width; ++x) {
+      const Contribution& c = columns.contributions[x];
+      const float* weights = &columns.weights[c.weight_offset];
+      const uint32_t* pixels = src + c.first;
+#if defined(CURSOR_SCALER_SSE2)
+      if (kernel != ScalerKernel::kScalar) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < c.count; ++k) {
+          __m128i px = _mm_cvtsi32_si128(static_cast<int>(pixels[k]));
+          px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+          acc = _mm_add_ps(
+              acc, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(weights[k])));
+        }
+        _mm_storeu_ps(out + x * 4, acc);
+        continue;
+      }
+#else
+      (void)kernel;
+#endif
+      float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+      for (int k = 0; k < c.count; ++k) {
+        uint32_t px = pixels[k];
+        for (int ch = 0; ch < 4; ++ch) {
+          acc[ch] += weights[k] * static_cast<float>((px >> (ch * 8)) & 0xFF);
+        }
+      }
+      for (int ch = 0; ch < 4; ++ch) out[x * 4 + ch] = acc[ch];
+    }
+  }
+
+#if defined(CURSOR_SCALER_AVX2)
+  // accum[i] += weight * row[i] over whole groups of 8, returns the count done
+  CURSOR_SCALER_TARGET_AVX2 static size_t AccumulateRowAvx2(
+      const float* row, float weight, float* accum, size_t count) {
+    const __m256 w8 = _mm256_set1_ps(weight);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m256 acc = _mm256_loadu_ps(accum + i);
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(row + i), w8));
+      _mm256_storeu_ps(accum + i, acc);
+    }
+    return i;
+  }
+#endif
+
+  // accum[i] += weight * row[i]
+  static void AccumulateRow(ScalerKernel kernel, const float* row,
+                            float weight, float* accum, size_t count) {
+    size_t i = 0;
+#if defined(CURSOR_SCALER_AVX2)
+    if (kernel == ScalerKernel::kAvx2) {
+      i = AccumulateRowAvx2(row, weight, accum, count);
+    }
+#endif
+#if defined(CURSOR_SCALER_SSE2)
+    if (kernel != ScalerKernel::kScalar) {
+      const __m128 w4 = _mm_set1_ps(weight);
+      for (; i + 4 <= count; i += 4) {
+        __m128 acc = _mm_loadu_ps(accum + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(row + i), w4));
+        _mm_storeu_ps(accum + i, acc);
+      }
+    }
+#else
+    (void)kernel;
+#endif
+    for (; i < count; ++i) {
+      accum[i] += weight * row[i];
+    }
+  }
+
+  // Rounds and clamps to 0..255, then clamps colors to alpha so ringing from
+  // the Lanczos filter cannot produce invalid premultiplied pixels. Halves
+  // round to even, as _mm_cvtps_epi32 does, in every kernel
+  static void StoreRow(ScalerKernel kernel, const float* accum, int width,
+                       uint32_t* out) {
+#if defined(CURSOR_SCALER_SSE2)
+    if (kernel != ScalerKernel::kScalar) {
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 max = _mm_set1_ps(255.0f);
+      for (int x = 0; x < width; ++x) {
+        __m128 v =
+            _mm_min_ps(_mm_max_ps(_mm_loadu_ps(accum + x * 4), zero), max);
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+        __m128i i32 = _mm_cvtps_epi32(v);
+        __m128i i16 = _mm_packs_epi32(i32, i32);
+        out[x] = static_cast<uint32_t>(
+            _mm_cvtsi128_si32(_mm_packus_epi16(i16, i16)));
+      }
+      return;
+    }
+#else
+    (void)kernel;
+#endif
+    for (int x = 0; x < width; ++x) {
+      const float* px = accum + x * 4;
+      float a = std::min(255.0f, std::max(0.0f, px[3]));
+      uint32_t pixel = static_cast<uint32_t>(std::nearbyint(a)) << 24;
+      for (int ch = 0; ch < 3; ++ch) {
+        float v = std::min(a, std::max(0.0f, px[ch]));
+        pixel |= static_cast<uint32_t>(std::nearbyint(v)) << (ch * 8);
+      }
+      out[x] = pixel;
+    }
+  }
+};
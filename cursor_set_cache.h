@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cursor_animation.h"
+#include "cursor_cache.h"
+#include "cursor_scaler.h"
+#include "work_stealing_pool.h"
+
+struct CursorSetParams {
+  double scale_factor;  // Enlargement on a monitor at source_dpi
+  int frame_count;      // Animation frames per shape, the last fully enlarged
+  ScaleFilter filter;
+  int source_dpi;       // DPI the source cursors were read at
+};
+
+// Enlarged animation frames of every managed cursor shape for one DPI
+struct CursorSet {
+  int dpi;
+  std::vector<FrameAtlas> shapes;  // In source order
+};
+
+// Cursor sets keyed by monitor DPI. A cursor is enlarged to the same
+// physical size on every monitor, so a monitor at twice the source DPI
+// gets frames scaled twice as far. Sync() is given the DPIs of the
+// monitors present and builds only the sets that are missing, with every
+// frame scaled in parallel, so docking or undocking leaves the sets of
+// unchanged monitors alone. StartSync() does the same without waiting for
+// the frames
+class CursorSetCache {
+ public:
+  struct SyncResult {
+    std::vector<int> built;
+    std::vector<int> dropped;
+    size_t scaled_frames = 0;  // Frames not found in the disk cache
+  };
+
+  CursorSetCache(std::vector<CursorImage> sources,
+                 const CursorSetParams& params, WorkStealingPool* pool)
+      : sources_(std::move(sources)), params_(params), pool_(pool) {}
+
+  CursorSetCache(const CursorSetCache&) = delete;
+  CursorSetCache& operator=(const CursorSetCache&) = delete;
+
+  // Frames being scaled for the DPIs a StartSync() found missing
+  class PendingSync {
+   public:
+    // Every frame is scaled and FinishSync() may take it
+    bool done() const { return remaining_.load() == 0; }
+
+   private:
+    friend class CursorSetCache;
+
+    std::vector<int> dpis_;     // Every DPI held once finished
+    std::vector<int> built_;
+    std::vector<double> frame_scales_;  // frame_count per built DPI
+    std::vector<CursorImage> frames_;   // One per task
+    std::vector<uint64_t> keys_;
+    std::vector<char> scaled_;
+    const CursorCache::Reader* disk_cache_ = nullptr;
+    std::shared_ptr<const CursorCache::Reader> disk_cache_owner_;
+    std::atomic<size_t> remaining_{0};
+    std::function<void()> on_done_;
+  };
+
+  // Holds sets for exactly dpis afterwards. Frames are looked up in
+  // disk_cache first when it is given
+  SyncResult Sync(std::vector<int> dpis,
+                  const CursorCache::Reader* disk_cache = nullptr) {
+    PendingSync pending;
+    Plan(std::move(dpis), disk_cache, &pending);
+    size_t task_count = pending.frames_.size();
+    auto build = [&](size_t begin, size_t end) {
+      for (size_t task = begin; task < end; ++task) {
+        ScaleFrame(&pending, task);
+      }
+    };
+    if (pool_) {
+      pool_->ParallelFor(task_count, 1, build);
+    } else {
+      build(0, task_count);
+    }
+    return FinishSync(&pending);
+  }
+
+  // Sync() that returns at once, with the frames scaling on the pool and
+  // the current sets left alone. on_done runs on the pool thread that
+  // scales the last frame, or before this returns when nothing needs
+  // scaling; FinishSync() then swaps the new sets in. disk_cache stays open
+  // until then. One sync at a time
+  std::shared_ptr<PendingSync> StartSync(
+      std::vector<int> dpis,
+      std::shared_ptr<const CursorCache::Reader> disk_cache,
+      std::function<void()> on_done) {
+    auto pending = std::make_shared<PendingSync>();
+    Plan(std::move(dpis), disk_cache.get(), pending.get());
+    pending->disk_cache_owner_ = std::move(disk_cache);
+    pending->on_done_ = std::move(on_done);
+    size_t task_count = pending->frames_.size();
+    pending->remaining_.store(task_count);
+    if (task_count == 0 || !pool_) {
+      for (size_t task = 0; task < task_count; ++task) {
+        ScaleFrame(pending.get(), task);
+      }
+      pending->remaining_.store(0);
+      pending->on_done_();
+      return pending;
+    }
+    for (size_t task = 0; task < task_count; ++task) {
+      pool_->Submit([this, pending, task] {
+        ScaleFrame(pending.get(), task);
+        if (pending->remaining_.fetch_sub(1) == 1) pending->on_done_();
+      });
+    }
+    return pending;
+  }
+
+  // Swaps in the sets of a done pending sync, dropping those of DPIs no
+  // longer in use, and closes its disk cache
+  SyncResult FinishSync(PendingSync* pending) {
+    SyncResult result;
+    result.built = pending->built_;
+    for (auto it = sets_.begin(); it != sets_.end();) {
+      if (std::binary_search(pending->dpis_.begin(), pending->dpis_.end(),
+                             it->first)) {
+        ++it;
+      } else {
+        result.dropped.push_back(it->first);
+        it = sets_.erase(it);
+      }
+    }
+
+    size_t shape_count = sources_.size();
+    size_t frame_count = static_cast<size_t>(params_.frame_count);
+    for (size_t d = 0; d < pending->built_.size(); ++d) {
+      auto set = std::make_unique<Entry>();
+      set->set.dpi = pending->built_[d];
+      for (size_t shape = 0; shape < shape_count; ++shape) {
+        FrameAtlas atlas;
+        for (size_t frame = 0; frame < frame_count; ++frame) {
+          size_t task = (d * shape_count + shape) * frame_count + frame;
+          atlas.AddFrame(pending->frames_[task],
+                         pending->frame_scales_[d * frame_count + frame]);
+          set->keys.push_back(pending->keys_[task]);
+          result.scaled_frames +=
+              static_cast<size_t>(pending->scaled_[task]);
+        }
+        set->set.shapes.push_back(std::move(atlas));
+      }
+      sets_[pending->built_[d]] = std::move(set);
+    }
+    pending->frames_.clear();
+    pending->disk_cache_ = nullptr;
+    pending->disk_cache_owner_.reset();
+    return result;
+  }
+
+  // Set for dpi, or nullptr if there is none
+  const CursorSet* Find(int dpi) const {
+    auto it = sets_.find(dpi);
+    return it == sets_.end() ? nullptr : &it->second->set;
+  }
+
+  std::vector<int> dpis() const {
+    std::vector<int> result;
+    for (const auto& entry : sets_) result.push_back(entry.first);
+    return result;
+  }
+
+  // Adds every frame held to a disk cache, which then drops the frames of
+  // DPIs no longer in use
+  void AddTo(CursorCache::Writer* writer) const {
+    for (const auto& entry : sets_) {
+      size_t key = 0;
+      for (const FrameAtlas& atlas : entry.second->set.shapes) {
+        for (int frame = 0; frame < atlas.frame_count(); ++frame) {
+          writer->Add(entry.second->keys[key++], atlas.FrameImage(frame));
+        }
+      }
+    }
+  }
+
+  double ScaleFor(int dpi) const {
+    return params_.scale_factor * dpi / params_.source_dpi;
+  }
+
+  size_t shape_count() const { return sources_.size(); }
+
+ private:
+  struct Entry {
+    CursorSet set;
+    std::vector<uint64_t> keys;  // Disk cache key of each frame, in order
+  };
+
+  // Lists the DPIs in dpis without a set and sizes the frames to scale
+  void Plan(std::vector<int> dpis, const CursorCache::Reader* disk_cache,
+            PendingSync* pending) const {
+    std::sort(dpis.begin(), dpis.end());
+    dpis.erase(std::unique(dpis.begin(), dpis.end()), dpis.end());
+    for (int dpi : dpis) {
+      if (dpi > 0 && sets_.find(dpi) == sets_.end()) {
+        pending->built_.push_back(dpi);
+      }
+    }
+    pending->dpis_ = std::move(dpis);
+    pending->disk_cache_ = disk_cache;
+
+    size_t frame_count = static_cast<size_t>(params_.frame_count);
+    for (int dpi : pending->built_) {
+      std::vector<double> scales =
+          FrameAtlas::FrameScales(ScaleFor(dpi), params_.frame_count);
+      pending->frame_scales_.insert(pending->frame_scales_.end(),
+                                    scales.begin(), scales.end());
+    }
+    size_t task_count =
+        pending->built_.size() * sources_.size() * frame_count;
+    pending->frames_.resize(task_count);
+    pending->keys_.resize(task_count);
+    pending->scaled_.assign(task_count, 0);
+  }
+
+  // Looks up or scales one frame. One task per frame: frames of large
+  // cursors take far longer to scale than small ones, and the pool balances
+  // them by stealing. Tasks touch only their own slots
+  void ScaleFrame(PendingSync* pending, size_t task) const {
+    size_t shape_count = sources_.size();
+    size_t frame_count = static_cast<size_t>(params_.frame_count);
+    size_t d = task / (shape_count * frame_count);
+    size_t shape = task / frame_count % shape_count;
+    size_t frame = task % frame_count;
+    double scale = pending->frame_scales_[d * frame_count + frame];
+    const CursorImage& source = sources_[shape];
+    pending->keys_[task] = CursorCache::MakeKey(
+        source, scale, pending->built_[d], params_.filter);
+    if (!pending->disk_cache_ ||
+        !pending->disk_cache_->Find(pending->keys_[task],
+                                    &pending->frames_[task])) {
+      pending->frames_[task] =
+          CursorScaler::ScaleCursorImage(source, scale, params_.filter);
+      pending->scaled_[task] = 1;
+    }
+  }
+
+  std::vector<CursorImage> sources_;
+  CursorSetParams params_;
+  WorkStealingPool* pool_;
+  std::map<int, std::unique_ptr<Entry>> sets_;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The system cursor table, by system cursor id (OCR_* on Windows). Cursors
+// are opaque handles; 0 is no cursor
+class SystemCursorTable {
+ public:
+  virtual ~SystemCursorTable() = default;
+
+  // Returns a private copy of the cursor currently set for id, or 0
+  virtual uintptr_t CopyCurrent(uint32_t id) = 0;
+
+  // Sets a copy of cursor as the system cursor for id. The caller keeps
+  // cursor
+  virtual bool Set(uint32_t id, uintptr_t cursor) = 0;
+
+  virtual void Destroy(uintptr_t cursor) = 0;
+
+  // Reloads every system cursor from the saved scheme, dropping cursors set
+  // without saving them to the scheme. With notify every top-level window is
+  // told about the change
+  virtual bool ReloadScheme(bool notify) = 0;
+};
+
+// The system cursors of the saved scheme, and which of them have been
+// replaced since. Restoring puts back exactly the replaced cursors, so
+// cursors other programs set later survive and no window is notified; the
+// scheme is only reloaded with notification if a cursor cannot be put back
+class CursorSnapshot {
+ public:
+  explicit CursorSnapshot(SystemCursorTable* table) : table_(table) {}
+
+  ~CursorSnapshot() {
+    for (const Entry& entry : entries_) {
+      if (entry.original) table_->Destroy(entry.original);
+    }
+  }
+
+  CursorSnapshot(const CursorSnapshot&) = delete;
+  CursorSnapshot& operator=(const CursorSnapshot&) = delete;
+
+  // Copies the saved scheme cursor for each id; indices into ids are used
+  // below. The scheme is reloaded first without notifying windows, so
+  // cursors left enlarged by an instance that did not exit are not taken as
+  // the originals. Returns false if a cursor could not be copied
+  bool Capture(const uint32_t* ids, size_t count) {
+    table_->ReloadScheme(false);
+    bool captured = true;
+    for (size_t i = 0; i < count; ++i) {
+      uintptr_t original = table_->CopyCurrent(ids[i]);
+      captured = captured && original != 0;
+      entries_.push_back({ids[i], original, false});
+    }
+    return captured;
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  // Shows cursor in place of the cursor at index
+  bool Replace(size_t index, uintptr_t cursor) {
+    Entry& entry = entries_[index];
+    if (!table_->Set(entry.id, cursor)) return false;
+    if (!entry.replaced) {
+      entry.replaced = true;
+      ++replaced_count_;
+    }
+    return true;
+  }
+
+  // Puts back the captured cursor at index if it was replaced. A cursor
+  // that cannot be put back stays marked for RestoreAll()
+  bool Restore(size_t index) {
+    Entry& entry = entries_[index];
+    if (!entry.replaced) return true;
+    if (!table_->Set(entry.id, entry.original)) return false;
+    entry.replaced = false;
+    --replaced_count_;
+    return true;
+  }
+
+  // Puts back every replaced cursor. Falls back to reloading the scheme if
+  // one cannot be put back, and returns false if even that failed
+  bool RestoreAll() {
+    bool restored = true;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      restored = Restore(i) && restored;
+    }
+    if (restored) return true;
+
+    if (!table_->ReloadScheme(true)) return false;
+    for (Entry& entry : entries_) entry.replaced = false;
+    replaced_count_ = 0;
+    return true;
+  }
+
+  size_t replaced_count() const { return replaced_count_; }
+
+ private:
+  struct Entry {
+    uint32_t id;
+    uintptr_t original;  // 0 if it could not be copied
+    bool replaced;
+  };
+
+  SystemCursorTable* table_;
+  std::vector<Entry> entries_;
+  size_t replaced_count_ = 0;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+
+// System cursor operations driven by CursorSwapScheduler. Shapes are indices
+// into the platform's table of managed system cursors
+class CursorSwapPlatform {
+ public:
+  virtual ~CursorSwapPlatform() = default;
+
+  virtual int ShapeCount() const = 0;
+
+  // Shape currently shown on screen, or -1 if it is not a managed cursor
+  virtual int CurrentShape() = 0;
+
+  // Shows one of the pre-rendered enlarged frames of a shape
+  virtual void ShowEnlarged(int shape, int frame) = 0;
+  virtual void ShowOriginal(int shape) = 0;
+};
+
+// Decides which system cursors to swap. In kAll mode every shape is swapped
+// on enlarge and restore. In kCurrentOnly mode only the shape on screen is
+// swapped, further shapes are swapped as the pointer changes to them while
+// enlarged, and restore touches only what was swapped. A shake then costs
+// two swaps instead of two per managed shape, plus one per animation frame
+class CursorSwapScheduler {
+ public:
+  enum class Mode { kAll, kCurrentOnly };
+
+  static constexpr int kMaxShapes = 32;
+  static constexpr int kDefaultShape = 0;  // Used when the shape is unknown
+
+  CursorSwapScheduler(CursorSwapPlatform* platform, Mode mode)
+      : platform_(platform), mode_(mode) {}
+
+  void Enlarge(int frame) {
+    if (enlarged_) return;
+    enlarged_ = true;
+    frame_ = frame;
+
+    if (mode_ == Mode::kAll) {
+      int count = ShapeCount();
+      for (int shape = 0; shape < count; ++shape) {
+        Swap(shape);
+      }
+      return;
+    }
+
+    int shape = platform_->CurrentShape();
+    Swap(shape >= 0 ? shape : kDefaultShape);
+  }
+
+  // Moves every swapped shape to another animation frame
+  void ShowFrame(int frame) {
+    if (!enlarged_ || frame == frame_) return;
+    frame_ = frame;
+
+    int count = ShapeCount();
+    for (int shape = 0; shape < count; ++shape) {
+      if (swapped_mask_ & Bit(shape)) {
+        platform_->ShowEnlarged(shape, frame_);
+        ++swap_count_;
+      }
+    }
+  }
+
+  // Call while enlarged whenever the shape on screen may have changed
+  void TrackShape() {
+    if (!enlarged_ || mode_ == Mode::kAll) return;
+    int shape = platform_->CurrentShape();
+    if (shape >= 0) {
+      Swap(shape);
+    }
+  }
+
+  void Restore() {
+    if (!enlarged_) return;
+    enlarged_ = false;
+
+    int count = ShapeCount();
+    for (int shape = 0; shape < count; ++shape) {
+      if (swapped_mask_ & Bit(shape)) {
+        platform_->ShowOriginal(shape);
+        ++swap_count_;
+      }
+    }
+    swapped_mask_ = 0;
+  }
+
+  bool enlarged() const { return enlarged_; }
+
+  // Total ShowEnlarged and ShowOriginal calls issued
+  uint64_t swap_count() const { return swap_count_; }
+
+ private:
+  static uint32_t Bit(int shape) { return uint32_t{1} << shape; }
+
+  int ShapeCount() const {
+    int count = platform_->ShapeCount();
+    return count < kMaxShapes ? count : kMaxShapes;
+  }
+
+  void Swap(int shape) {
+    if (shape >= ShapeCount() || (swapped_mask_ & Bit(shape))) return;
+    platform_->ShowEnlarged(shape, frame_);
+    swapped_mask_ |= Bit(shape);
+    ++swap_count_;
+  }
+
+  CursorSwapPlatform* platform_;
+  Mode mode_;
+  bool enlarged_ = false;
+  int frame_ = 0;
+  uint32_t swapped_mask_ = 0;
+  uint64_t swap_count_ = 0;
+};
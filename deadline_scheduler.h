@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// One-shot timers on a binary min-heap of deadlines. Timers are registered
+// once, then armed, moved and cancelled in O(log n) without allocating, and
+// the earliest deadline is O(1), so the owner can sleep until exactly then
+// and not at all while nothing is armed. Not thread-safe: one thread owns
+// the scheduler and runs the callbacks
+class DeadlineScheduler {
+ public:
+  using TimerId = size_t;
+  using Callback = std::function<void(int64_t now_us)>;
+
+  static constexpr int64_t kNoDeadline = std::numeric_limits<int64_t>::max();
+
+  DeadlineScheduler() = default;
+  DeadlineScheduler(const DeadlineScheduler&) = delete;
+  DeadlineScheduler& operator=(const DeadlineScheduler&) = delete;
+
+  // Registers a disarmed timer
+  TimerId Add(Callback callback) {
+    timers_.push_back({kNoDeadline, kNotArmed, std::move(callback)});
+    heap_.reserve(timers_.size());
+    return timers_.size() - 1;
+  }
+
+  // Arms or moves the timer. kNoDeadline disarms it
+  void Arm(TimerId id, int64_t deadline_us) {
+    if (deadline_us == kNoDeadline) {
+      Cancel(id);
+      return;
+    }
+    Timer& timer = timers_[id];
+    if (timer.heap_index == kNotArmed) {
+      timer.deadline_us = deadline_us;
+      timer.heap_index = heap_.size();
+      heap_.push_back(id);
+      SiftUp(timer.heap_index);
+    } else if (deadline_us != timer.deadline_us) {
+      bool earlier = deadline_us < timer.deadline_us;
+      timer.deadline_us = deadline_us;
+      if (earlier) {
+        SiftUp(timer.heap_index);
+      } else {
+        SiftDown(timer.heap_index);
+      }
+    }
+  }
+
+  void Cancel(TimerId id) {
+    Timer& timer = timers_[id];
+    if (timer.heap_index == kNotArmed) return;
+    size_t index = timer.heap_index;
+    size_t last = heap_.size() - 1;
+    if (index != last) {
+      Place(index, heap_[last]);
+      heap_.pop_back();
+      SiftDown(index);
+      SiftUp(index);
+    } else {
+      heap_.pop_back();
+    }
+    timer.heap_index = kNotArmed;
+    timer.deadline_us = kNoDeadline;
+  }
+
+  bool armed(TimerId id) const { return timers_[id].heap_index != kNotArmed; }
+
+  int64_t deadline(TimerId id) const { return timers_[id].deadline_us; }
+
+  // Earliest armed deadline, or kNoDeadline
+  int64_t NextDeadline() const {
+    return heap_.empty() ? kNoDeadline : timers_[heap_[0]].deadline_us;
+  }
+
+  // Disarms and runs every timer due at now_us, earliest first, and returns
+  // the number run. Callbacks may arm and cancel timers. At most as many
+  // callbacks run as timers were armed on entry, so a callback re-arming its
+  // own timer at or before now_us cannot spin
+  size_t RunExpired(int64_t now_us) {
+    size_t budget = heap_.size();
+    size_t run = 0;
+    while (run < budget && !heap_.empty() &&
+           timers_[heap_[0]].deadline_us <= now_us) {
+      TimerId id = heap_[0];
+      Cancel(id);
+      timers_[id].callback(now_us);
+      ++run;
+    }
+    return run;
+  }
+
+ private:
+  static constexpr size_t kNotArmed = std::numeric_limits<size_t>::max();
+
+  struct Timer {
+    int64_t deadline_us;
+    size_t heap_index;
+    Callback callback;
+  };
+
+  // Ties go to the earlier registered timer, so the order is deterministic
+  bool Before(TimerId a, TimerId b) const {
+    int64_t deadline_a = timers_[a].deadline_us;
+    int64_t deadline_b = timers_[b].deadline_us;
+    return deadline_a < deadline_b || (deadline_a == deadline_b && a < b);
+  }
+
+  void Place(size_t index, TimerId id) {
+    heap_[index] = id;
+    timers_[id].heap_index = index;
+  }
+
+  void SiftUp(size_t index) {
+    TimerId id = heap_[index];
+    while (index > 0) {
+      size_t parent = (index - 1) / 2;
+      if (!Before(id, heap_[parent])) break;
+      Place(index, heap_[parent]);
+      index = parent;
+    }
+    Place(index, id);
+  }
+
+  void SiftDown(size_t index) {
+    TimerId id = heap_[index];
+    size_t size = heap_.size();
+    for (;;) {
+      size_t child = 2 * index + 1;
+      if (child >= size) break;
+      if (child + 1 < size && Before(heap_[child + 1], heap_[child])) {
+        ++child;
+      }
+      if (!Before(heap_[child], id)) break;
+      Place(index, heap_[child]);
+      index = child;
+    }
+    Place(index, id);
+  }
+
+  std::vector<Timer> timers_;
+  std::vector<TimerId> heap_;
+};
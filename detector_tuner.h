@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "enlarge_state_machine.h"
+#include "mouse_trace.h"
+#include "shake_app.h"
+
+// Span of a trace, in trace time, during which the user was shaking
+struct ShakeLabel {
+  int64_t start_us;
+  int64_t end_us;
+};
+
+// A recorded trace with its hand-labelled shakes. Traces without labels are
+// negatives: every enlargement in them is a false positive. The samples are
+// decoded once and shared by every configuration evaluated
+struct LabelledTrace {
+  std::string name;
+  std::vector<MouseSample> samples;
+  std::vector<ShakeLabel> shakes;  // Sorted by start
+};
+
+// Scores for one detector configuration over a corpus
+struct TuneResult {
+  ShakeParams params;
+  uint64_t detected = 0;         // Labelled shakes with an enlargement
+  uint64_t missed = 0;           // Labelled shakes without one
+  uint64_t false_positives = 0;  // Enlargements outside any labelled shake
+  uint64_t duplicates = 0;       // Further enlargements in a detected shake
+  int64_t total_latency_us = 0;  // Shake start to enlargement, summed
+  int64_t max_latency_us = 0;
+
+  double precision() const {
+    uint64_t reported = detected + false_positives;
+    return reported > 0 ? static_cast<double>(detected) /
+                              static_cast<double>(reported)
+                        : 0.0;
+  }
+
+  double recall() const {
+    uint64_t labelled = detected + missed;
+    return labelled > 0 ? static_cast<double>(detected) /
+                              static_cast<double>(labelled)
+                        : 0.0;
+  }
+
+  double f1() const {
+    double p = precision();
+    double r = recall();
+    return p + r > 0 ? 2 * p * r / (p + r) : 0.0;
+  }
+
+  double mean_latency_ms() const {
+    return detected > 0
+               ? static_cast<double>(total_latency_us) /
+                     static_cast<double>(detected) / 1000.0
+               : 0.0;
+  }
+};
+
+// Inclusive range of values for one detector parameter
+struct ParamRange {
+  double min;
+  double max;
+  double step;
+
+  size_t Count() const {
+    if (step <= 0 || max <= min) return 1;
+    return static_cast<size_t>(std::floor((max - min) / step + 1e-9)) + 1;
+  }
+
+  double At(size_t index) const {
+    return min + step * static_cast<double>(index);
+  }
+};
+
+// The searched parameters. Everything else comes from the base ShakeParams
+class ParamSpace {
+ public:
+  ParamSpace(const ShakeParams& base, const ParamRange& history_size,
+             const ParamRange& min_direction_changes,
+             const ParamRange& min_movement_speed,
+             const ParamRange& max_time_window_ms)
+      : base_(base),
+        ranges_{history_size, min_direction_changes, min_movement_speed,
+                max_time_window_ms} {}
+
+  size_t GridSize() const {
+    size_t size = 1;
+    for (const ParamRange& range : ranges_) {
+      size *= range.Count();
+    }
+    return size;
+  }
+
+  // Grid point index, with the history size varying slowest
+  ShakeParams GridPoint(size_t index) const {
+    double values[kDimensions];
+    for (int i = kDimensions - 1; i >= 0; --i) {
+      size_t count = ranges_[i].Count();
+      values[i] = ranges_[i].At(index % count);
+      index /= count;
+    }
+    return Make(values);
+  }
+
+  // Uniformly random point. The same seed and index always give the same
+  // point, so random searches can be split across threads and rerun
+  ShakeParams RandomPoint(uint64_t seed, size_t index) const {
+    uint64_t state = seed ^ (index * 0x9E3779B97F4A7C15ULL);
+    double values[kDimensions];
+    for (int i = 0; i < kDimensions; ++i) {
+      double unit = static_cast<double>(SplitMix64(&state) >> 11) * 0x1p-53;
+      values[i] = ranges_[i].min + (ranges_[i].max - ranges_[i].min) * unit;
+    }
+    return Make(values);
+  }
+
+ private:
+  static constexpr int kDimensions = 4;
+
+  static uint64_t SplitMix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  ShakeParams Make(const double* values) const {
+    ShakeParams params = base_;
+    params.history_size = static_cast<size_t>(std::lround(values[0]));
+    params.min_direction_changes = static_cast<int>(std::lround(values[1]));
+    params.min_movement_speed = values[2];
+    params.max_time_window_us = std::llround(values[3] * 1000.0);
+    return params;
+  }
+
+  ShakeParams base_;
+  ParamRange ranges_[kDimensions];
+};
+
+// Replays a labelled corpus against detector configurations, through the
+// app's gesture detector with the given gestures. Evaluate() is
+// const and keeps all state on the stack, so one tuner can be shared by any
+// number of threads
+class DetectorTuner {
+ public:
+  // An enlargement up to match_tolerance_us after a labelled shake ends
+  // still counts for that shake
+  DetectorTuner(const std::vector<LabelledTrace>* corpus,
+                const GestureOptions& gestures, const EnlargeTiming& timing,
+                int64_t match_tolerance_us)
+      : corpus_(corpus),
+        gestures_(gestures),
+        timing_(timing),
+        match_tolerance_us_(match_tolerance_us) {}
+
+  // Reads "start_ms end_ms" lines, relative to the first sample of the
+  // trace. Blank lines and lines starting with '#' are skipped
+  static bool LoadLabels(const std::filesystem::path& path,
+                         int64_t start_time_us,
+                         std::vector<ShakeLabel>* labels) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream fields(line);
+      double start_ms, end_ms;
+      if (!(fields >> start_ms >> end_ms) || end_ms < start_ms) return false;
+      labels->push_back({start_time_us + std::llround(start_ms * 1000.0),
+                         start_time_us + std::llround(end_ms * 1000.0)});
+    }
+    std::sort(labels->begin(), labels->end(),
+              [](const ShakeLabel& a, const ShakeLabel& b) {
+                return a.start_us < b.start_us;
+              });
+    return true;
+  }
+
+  // Decodes the whole trace into samples
+  static void Decode(const MouseTraceReader& reader,
+                     std::vector<MouseSample>* samples) {
+    samples->reserve(reader.recorded_sample_count());
+    MouseTraceDecoder decoder = reader.Decoder();
+    MouseSample batch[kBatchSize];
+    size_t count;
+    while ((count = decoder.Read(batch, kBatchSize)) > 0) {
+      samples->insert(samples->end(), batch, batch + count);
+    }
+  }
+
+  TuneResult Evaluate(const ShakeParams& params) const {
+    TuneResult result;
+    result.params = params;
+    MouseMoveDetector detector(params, gestures_);
+    for (const LabelledTrace& trace : *corpus_) {
+      detector.Reset();
+      EvaluateTrace(trace, &detector, &result);
+    }
+    return result;
+  }
+
+ private:
+  static constexpr size_t kBatchSize = 256;
+
+  void EvaluateTrace(const LabelledTrace& trace, MouseMoveDetector* detector,
+                     TuneResult* result) const {
+    EnlargeStateMachine state_machine(timing_);
+    const std::vector<ShakeLabel>& shakes = trace.shakes;
+    size_t label = 0;
+    bool label_detected = false;
+
+    for (const MouseSample& sample : trace.samples) {
+      bool shaking =
+          detector->AddSample(sample.x, sample.y, sample.timestamp_us)
+              .enlarge();
+      if (state_machine.OnDetection(shaking, sample.timestamp_us) !=
+          EnlargeStateMachine::Action::kEnlarge) {
+        continue;
+      }
+
+      // Enlargements arrive in time order, so labels are walked once
+      int64_t time_us = sample.timestamp_us;
+      while (label < shakes.size() &&
+             time_us > shakes[label].end_us + match_tolerance_us_) {
+        result->missed += label_detected ? 0 : 1;
+        ++label;
+        label_detected = false;
+      }
+      if (label < shakes.size() && time_us >= shakes[label].start_us) {
+        if (label_detected) {
+          ++result->duplicates;
+          continue;
+        }
+        label_detected = true;
+        ++result->detected;
+        int64_t latency_us = time_us - shakes[label].start_us;
+        result->total_latency_us += latency_us;
+        result->max_latency_us = std::max(result->max_latency_us, latency_us);
+      } else {
+        ++result->false_positives;
+      }
+    }
+
+    for (; label < shakes.size(); ++label) {
+      result->missed += label_detected ? 0 : 1;
+      label_detected = false;
+    }
+  }
+
+  const std::vector<LabelledTrace>* corpus_;
+  GestureOptions gestures_;
+  EnlargeTiming timing_;
+  int64_t match_tolerance_us_;
+};
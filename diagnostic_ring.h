@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "shake_detector.h"
+#include "shared_memory.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4324)  // Structure padded due to alignas
+#endif
+
+// One detector input and what the detector made of it
+struct DiagnosticRecord {
+  enum Flags : uint8_t {
+    kShaking = 1,   // The detector matched a shake
+    kEnlarged = 2,  // The sample started an enlargement
+    kRestored = 4,  // The sample's time was past the restore deadline
+  };
+
+  int64_t timestamp_us;
+  int32_t x;
+  int32_t y;
+
+  // ShakeFeatures of the window after the sample
+  double average_speed;
+  int64_t total_time_us;
+  int32_t direction_changes;
+  uint16_t movement_count;
+
+  uint8_t flags;
+  uint8_t reserved;
+};
+
+// Fixed-size ring of the latest DiagnosticRecords in named shared memory,
+// written by the app and read live by other processes. The single writer
+// never waits: each slot is a seqlock whose sequence is odd while the slot
+// is written and 2 * position + 2 once it holds the record at position, so
+// readers copy a slot and keep it only if the sequence matched before and
+// after. Record fields are stored as relaxed atomic words, which compile to
+// plain loads and stores
+class DiagnosticRing {
+ public:
+#ifdef _WIN32
+  static constexpr const char* kDefaultName =
+      "Local\\ShakeToFindCursor.Diagnostics";
+#else
+  static constexpr const char* kDefaultName = "/ShakeToFindCursor.Diagnostics";
+#endif
+  static constexpr uint32_t kMagic = 0x47524453;  // "SDRG"
+  static constexpr uint32_t kVersion = 1;
+
+  static constexpr size_t kRecordWords =
+      (sizeof(DiagnosticRecord) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> words[kRecordWords];
+  };
+
+  // Start of the shared region, followed by the slots
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;   // Slots, a power of two
+    uint32_t slot_size;
+    ShakeParams params;  // Thresholds the records were judged against
+    alignas(64) std::atomic<uint64_t> write_position;  // Records written
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "Shared memory atomics must be lock-free");
+
+  static size_t RegionSize(uint32_t capacity) {
+    return sizeof(Header) + static_cast<size_t>(capacity) * sizeof(Slot);
+  }
+
+  static void Pack(const DiagnosticRecord& record, uint64_t* words) {
+    words[kRecordWords - 1] = 0;
+    std::memcpy(words, &record, sizeof(record));
+  }
+
+  static void Unpack(const uint64_t* words, DiagnosticRecord* record) {
+    std::memcpy(record, words, sizeof(*record));
+  }
+};
+
+class DiagnosticRingWriter {
+ public:
+  // capacity is rounded up to a power of two
+  bool Create(const std::string& name, uint32_t capacity,
+              const ShakeParams& params) {
+    uint32_t slots = 1;
+    while (slots < capacity) slots <<= 1;
+    if (!memory_.Create(name, DiagnosticRing::RegionSize(slots))) return false;
+
+    header_ = reinterpret_cast<DiagnosticRing::Header*>(memory_.data());
+    slots_ = reinterpret_cast<DiagnosticRing::Slot*>(
+        memory_.data() + sizeof(DiagnosticRing::Header));
+    mask_ = slots - 1;
+
+    // Invalidate whatever a previous instance left before publishing the
+    // header, so readers never match a stale slot
+    header_->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    for (uint32_t i = 0; i < slots; ++i) {
+      slots_[i].sequence.store(1, std::memory_order_relaxed);
+    }
+    header_->write_position.store(0, std::memory_order_relaxed);
+    header_->version = DiagnosticRing::kVersion;
+    header_->capacity = slots;
+    header_->slot_size = sizeof(DiagnosticRing::Slot);
+    header_->params = params;
+    position_ = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = DiagnosticRing::kMagic;
+    return true;
+  }
+
+  void Close() {
+    memory_.Close();
+    header_ = nullptr;
+    slots_ = nullptr;
+  }
+
+  bool is_open() const { return header_ != nullptr; }
+
+  // Wait-free; overwrites the oldest record once the ring is full
+  void Append(const DiagnosticRecord& record) {
+    uint64_t words[DiagnosticRing::kRecordWords];
+    DiagnosticRing::Pack(record, words);
+
+    DiagnosticRing::Slot& slot = slots_[position_ & mask_];
+    slot.sequence.store(2 * position_ + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < DiagnosticRing::kRecordWords; ++i) {
+      slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(2 * position_ + 2, std::memory_order_release);
+    ++position_;
+    header_->write_position.store(position_, std::memory_order_release);
+  }
+
+ private:
+  SharedMemory memory_;
+  DiagnosticRing::Header* header_ = nullptr;
+  DiagnosticRing::Slot* slots_ = nullptr;
+  uint64_t mask_ = 0;
+  uint64_t position_ = 0;
+};
+
+// Reads a ring from another process without ever blocking the writer
+class DiagnosticRingReader {
+ public:
+  bool Open(const std::string& name) {
+    Close();
+    if (!memory_.Open(name)) return false;
+    if (memory_.size() < sizeof(DiagnosticRing::Header)) {
+      Close();
+      return false;
+    }
+    header_ = reinterpret_cast<const DiagnosticRing::Header*>(memory_.data());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t capacity = header_->capacity;
+    if (header_->magic != DiagnosticRing::kMagic ||
+        header_->version != DiagnosticRing::kVersion || capacity == 0 ||
+        (capacity & (capacity - 1)) != 0 ||
+        header_->slot_size != sizeof(DiagnosticRing::Slot) ||
+        memory_.size() < DiagnosticRing::RegionSize(capacity)) {
+      Close();
+      return false;
+    }
+    slots_ = reinterpret_cast<const DiagnosticRing::Slot*>(
+        memory_.data() + sizeof(DiagnosticRing::Header));
+    mask_ = capacity - 1;
+    return true;
+  }
+
+  void Close() {
+    memory_.Close();
+    header_ = nullptr;
+    slots_ = nullptr;
+  }
+
+  bool is_open() const { return header_ != nullptr; }
+  uint32_t capacity() const { return header_->capacity; }
+  const ShakeParams& params() const { return header_->params; }
+
+  uint64_t write_position() const {
+    return header_->write_position.load(std::memory_order_acquire);
+  }
+
+  // Copies up to max_count records from *position on and advances
+  // *position past them. Records the writer overwrote before they could be
+  // read are skipped and added to *lost
+  size_t Read(uint64_t* position, DiagnosticRecord* records, size_t max_count,
+              uint64_t* lost) const {
+    uint64_t end = write_position();
+    uint64_t capacity = mask_ + 1;
+    if (*position > end) *position = 0;  // The writer restarted
+    if (end - *position > capacity) {
+      *lost += end - capacity - *position;
+      *position = end - capacity;
+    }
+
+    size_t count = 0;
+    while (count < max_count && *position < end) {
+      if (ReadSlot(*position, &records[count])) {
+        ++count;
+      } else {
+        ++*lost;
+      }
+      ++*position;
+    }
+    return count;
+  }
+
+ private:
+  bool ReadSlot(uint64_t position, DiagnosticRecord* record) const {
+    const DiagnosticRing::Slot& slot = slots_[position & mask_];
+    uint64_t expected = 2 * position + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != expected) {
+      return false;
+    }
+    uint64_t words[DiagnosticRing::kRecordWords];
+    for (size_t i = 0; i < DiagnosticRing::kRecordWords; ++i) {
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != expected) {
+      return false;
+    }
+    DiagnosticRing::Unpack(words, record);
+    return true;
+  }
+
+  SharedMemory memory_;
+  const DiagnosticRing::Header* header_ = nullptr;
+  const DiagnosticRing::Slot* slots_ = nullptr;
+  uint64_t mask_ = 0;
+};
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Enlarge and restore timing, all in microseconds
+struct EnlargeTiming {
+  int64_t enlarge_duration_us;      // Stay enlarged this long after a shake
+  int64_t max_enlarge_duration_us;  // Cap on extensions while shaking
+  int64_t cooldown_us;              // Ignore shakes this long after restore
+};
+
+// Decides when to enlarge and restore. A shake that continues while enlarged
+// extends the enlarged period instead of letting it expire and re-trigger.
+// After a restore, shakes are ignored for a cooldown, and a new enlarge also
+// needs the detector to have reported "no shake" at least once since the
+// restore (hysteresis), so a detector window still full of the previous
+// shake cannot re-trigger straight away.
+//
+// All times are passed in by the caller, so recorded traces can be replayed
+// against a simulated clock
+class EnlargeStateMachine {
+ public:
+  enum class State { kIdle, kEnlarged, kCooldown };
+  enum class Action { kNone, kEnlarge, kRestore };
+
+  static constexpr int64_t kNoDeadline = std::numeric_limits<int64_t>::max();
+
+  explicit EnlargeStateMachine(const EnlargeTiming& timing) : timing_(timing) {}
+
+  // Feeds one detector decision
+  Action OnDetection(bool shaking, int64_t now_us) {
+    Action action = Tick(now_us);
+    if (!shaking) {
+      armed_ = true;
+      return action;
+    }
+
+    switch (state_) {
+      case State::kIdle:
+        if (!armed_) break;
+        state_ = State::kEnlarged;
+        enlarge_start_us_ = now_us;
+        restore_at_us_ = now_us + timing_.enlarge_duration_us;
+        ++enlarge_count_;
+        return Action::kEnlarge;
+
+      case State::kEnlarged: {
+        int64_t limit = enlarge_start_us_ + timing_.max_enlarge_duration_us;
+        int64_t extended = now_us + timing_.enlarge_duration_us;
+        restore_at_us_ = extended < limit ? extended : limit;
+        ++extension_count_;
+        break;
+      }
+
+      case State::kCooldown:
+        break;
+    }
+    return action;
+  }
+
+  // Applies expired deadlines
+  Action Tick(int64_t now_us) {
+    if (state_ == State::kEnlarged && now_us >= restore_at_us_) {
+      state_ = State::kCooldown;
+      cooldown_until_us_ = now_us + timing_.cooldown_us;
+      armed_ = false;
+      ++restore_count_;
+      return Action::kRestore;
+    }
+    if (state_ == State::kCooldown && now_us >= cooldown_until_us_) {
+      state_ = State::kIdle;
+    }
+    return Action::kNone;
+  }
+
+  // Next time Tick() has something to do, or kNoDeadline
+  int64_t NextDeadline() const {
+    switch (state_) {
+      case State::kEnlarged:
+        return restore_at_us_;
+      case State::kCooldown:
+        return cooldown_until_us_;
+      default:
+        return kNoDeadline;
+    }
+  }
+
+  // Forces an immediate restore without a cooldown, e.g. on shutdown
+  void Reset() {
+    state_ = State::kIdle;
+    armed_ = true;
+  }
+
+  // Takes effect from the next enlargement, extension or restore
+  void set_timing(const EnlargeTiming& timing) { timing_ = timing; }
+
+  State state() const { return state_; }
+  uint64_t enlarge_count() const { return enlarge_count_; }
+  uint64_t restore_count() const { return restore_count_; }
+  uint64_t extension_count() const { return extension_count_; }
+
+ private:
+  EnlargeTiming timing_;
+  State state_ = State::kIdle;
+  bool armed_ = true;
+  int64_t enlarge_start_us_ = 0;
+  int64_t restore_at_us_ = 0;
+  int64_t cooldown_until_us_ = 0;
+  uint64_t enlarge_count_ = 0;
+  uint64_t restore_count_ = 0;
+  uint64_t extension_count_ = 0;
+};
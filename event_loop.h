@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+// Blocking event loop interface. Wait() sleeps until there is input, the
+// deadline passes or Shutdown() is called, so an idle process never wakes up
+class EventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class WakeReason {
+    kInput,     // Input is pending and should be drained by the caller
+    kDeadline,  // The deadline passed without input
+    kShutdown   // Shutdown() was called
+  };
+
+  static constexpr Clock::time_point kNoDeadline = Clock::time_point::max();
+
+  virtual ~EventLoop() = default;
+
+  virtual WakeReason Wait(Clock::time_point deadline) = 0;
+
+  // Thread-safe. Once called, every Wait() returns kShutdown immediately
+  virtual void Shutdown() = 0;
+
+  // Number of times Wait() returned, used to measure idle wakeups
+  uint64_t wakeup_count() const {
+    return wakeup_count_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  void CountWakeup() { wakeup_count_.fetch_add(1, std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> wakeup_count_{0};
+};
+
+#ifdef _WIN32
+
+// Win32 backend: waits on the thread message queue and a shutdown event
+class Win32EventLoop : public EventLoop {
+ public:
+  Win32EventLoop() {
+    shutdown_event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!shutdown_event_) {
+      throw std::runtime_error("Failed to create shutdown event");
+    }
+  }
+
+  ~Win32EventLoop() override { CloseHandle(shutdown_event_); }
+
+  WakeReason Wait(Clock::time_point deadline) override {
+    DWORD timeout = INFINITE;
+    if (deadline != kNoDeadline) {
+      auto now = Clock::now();
+      auto remaining =
+          std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+      timeout = (remaining <= 0) ? 0
+                : (remaining >= INFINITE) ? INFINITE - 1
+                                          : static_cast<DWORD>(remaining);
+    }
+
+    // QS_ALLINPUT includes sent messages, which is how WH_MOUSE_LL callbacks
+    // reach this thread
+    DWORD result = MsgWaitForMultipleObjectsEx(
+        1, &shutdown_event_, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    CountWakeup();
+
+    switch (result) {
+      case WAIT_OBJECT_0:
+        return WakeReason::kShutdown;
+      case WAIT_OBJECT_0 + 1:
+        return WakeReason::kInput;
+      case WAIT_TIMEOUT:
+        return WakeReason::kDeadline;
+      default:
+        throw std::runtime_error("Failed to wait for messages");
+    }
+  }
+
+  void Shutdown() override { SetEvent(shutdown_event_); }
+
+ private:
+  Win32EventLoop(const Win32EventLoop&) = delete;
+  Win32EventLoop& operator=(const Win32EventLoop&) = delete;
+
+  HANDLE shutdown_event_ = nullptr;
+};
+
+#elif defined(__linux__)
+
+// Linux backend: epoll over the registered input descriptors, an eventfd for
+// shutdown and a timerfd armed with the absolute deadline
+class EpollEventLoop : public EventLoop {
+ public:
+  EpollEventLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    shutdown_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (epoll_fd_ < 0 || shutdown_fd_ < 0 || timer_fd_ < 0) {
+      CloseAll();
+      throw std::runtime_error("Failed to create event loop descriptors");
+    }
+    if (!Watch(shutdown_fd_) || !Watch(timer_fd_)) {
+      CloseAll();
+      throw std::runtime_error("Failed to register event loop descriptors");
+    }
+  }
+
+  ~EpollEventLoop() override { CloseAll(); }
+
+  // Registers a readable descriptor whose readiness counts as input. The
+  // caller owns the descriptor and drains it after Wait() returns kInput
+  bool AddInputFd(int fd) { return Watch(fd); }
+
+  WakeReason Wait(Clock::time_point deadline) override {
+    ArmTimer(deadline);
+
+    epoll_event event = {};
+    int count;
+    do {
+      count = epoll_wait(epoll_fd_, &event, 1, -1);
+    } while (count < 0 && errno == EINTR);
+    CountWakeup();
+
+    if (count < 0) {
+      throw std::runtime_error("Failed to wait for events");
+    }
+    if (event.data.fd == shutdown_fd_) {
+      return WakeReason::kShutdown;
+    }
+    if (event.data.fd == timer_fd_) {
+      uint64_t expirations;
+      ssize_t read_size = read(timer_fd_, &expirations, sizeof(expirations));
+      (void)read_size;
+      // The timer is one-shot, so it has to be re-armed for the next Wait()
+      armed_deadline_ = kNoDeadline;
+      return WakeReason::kDeadline;
+    }
+    return WakeReason::kInput;
+  }
+
+  void Shutdown() override {
+    // The counter is never read back, so the descriptor stays readable
+    uint64_t one = 1;
+    ssize_t write_size = write(shutdown_fd_, &one, sizeof(one));
+    (void)write_size;
+  }
+
+ private:
+  EpollEventLoop(const EpollEventLoop&) = delete;
+  EpollEventLoop& operator=(const EpollEventLoop&) = delete;
+
+  bool Watch(int fd) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+  }
+
+  void ArmTimer(Clock::time_point deadline) {
+    if (deadline == armed_deadline_) return;
+    armed_deadline_ = deadline;
+
+    // A zero it_value disarms the timer
+    itimerspec spec = {};
+    if (deadline != kNoDeadline) {
+      auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             deadline.time_since_epoch())
+                             .count();
+      if (since_epoch <= 0) since_epoch = 1;
+      spec.it_value.tv_sec = static_cast<time_t>(since_epoch / 1000000000);
+      spec.it_value.tv_nsec = static_cast<long>(since_epoch % 1000000000);
+    }
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+  }
+
+  void CloseAll() {
+    if (timer_fd_ >= 0) close(timer_fd_);
+    if (shutdown_fd_ >= 0) close(shutdown_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    timer_fd_ = shutdown_fd_ = epoll_fd_ = -1;
+  }
+
+  int epoll_fd_ = -1;
+  int shutdown_fd_ = -1;
+  int timer_fd_ = -1;
+  Clock::time_point armed_deadline_ = kNoDeadline;
+};
+
+#endif
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "shake_detector.h"
+
+// Motion over the newest movements of the window, the input every gesture
+// is judged on
+struct MotionFeatures {
+  size_t movement_count;
+  int64_t duration_us;
+  double path_length;       // Pixels travelled
+  int64_t displacement_x;   // Net movement in pixels
+  int64_t displacement_y;
+  double average_speed;     // Mean movement speed in pixels/second
+  int direction_changes;    // Axis reversals between consecutive movements
+  double turning;           // Signed sum of the turns between movements, rad
+  double absolute_turning;  // Sum of the absolute turns, rad
+  int sharp_turns;          // Turns sharper than GestureEngine::kSharpTurn
+  double velocity_x;        // Newest movement in pixels/second
+  double velocity_y;
+
+  double displacement() const {
+    return std::sqrt(static_cast<double>(displacement_x * displacement_x +
+                                         displacement_y * displacement_y));
+  }
+
+  // Mean turning per pixel travelled
+  double curvature() const {
+    return path_length > 0.0 ? absolute_turning / path_length : 0.0;
+  }
+};
+
+// The newest movements a gesture looks at: at most max_movements of them,
+// and of those only the ones within max_duration_us
+struct GestureWindow {
+  size_t max_movements;
+  int64_t max_duration_us;
+};
+
+struct Gesture {
+  GestureWindow window;
+  std::function<bool(const MotionFeatures&)> matches;
+  // Average speed matches compares against, if any. Close to it the average
+  // is re-summed exactly, so the decision is the same as a rescan's
+  double speed_threshold = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Recognizes several gestures from one pass of feature extraction. Each
+// movement's features (distance, speed, axis reversals and the turn against
+// the previous movement) are computed once and appended to a ring of
+// running totals, so the features of a window of the newest movements are
+// the difference of two totals. Gestures with the same GestureWindow share
+// it, and each window's oldest movement only ever moves forward, so a
+// movement costs O(1) per distinct window plus each gesture's own threshold
+// test; the square root and arctangent are paid once however many gestures
+// are registered.
+//
+// Timestamps are in microseconds; samples closer than min_sample_interval_us
+// are merged into the next movement, as in ShakeDetector
+class GestureEngine {
+ public:
+  static constexpr size_t kMaxGestures = 32;
+  static constexpr int64_t kUnlimitedDuration =
+      std::numeric_limits<int64_t>::max();
+  static constexpr double kSharpTurn = 2.0 * 3.14159265358979323846 / 3.0;
+
+  explicit GestureEngine(int64_t min_sample_interval_us)
+      : min_sample_interval_us_(min_sample_interval_us), totals_(2) {}
+
+  // Registers up to kMaxGestures gestures and returns the gesture's bit
+  // index in AddSample() results. Registering clears the window
+  size_t Register(Gesture gesture) {
+    size_t window = 0;
+    while (window < windows_.size() &&
+           (windows_[window].window.max_movements !=
+                gesture.window.max_movements ||
+            windows_[window].window.max_duration_us !=
+                gesture.window.max_duration_us)) {
+      ++window;
+    }
+    if (window == windows_.size()) {
+      windows_.push_back({gesture.window, 0, MotionFeatures()});
+    }
+    if (gesture.window.max_movements > capacity_) {
+      capacity_ = gesture.window.max_movements;
+      size_t slots = 2;
+      while (slots < capacity_ + 1) slots <<= 1;
+      totals_.assign(slots, Totals());
+    }
+    gestures_.push_back(
+        {window, std::move(gesture.matches), gesture.speed_threshold});
+    Reset();
+    return gestures_.size() - 1;
+  }
+
+  size_t gesture_count() const { return gestures_.size(); }
+
+  // Features of the window the gesture was last judged on
+  const MotionFeatures& features(size_t gesture) const {
+    return windows_[gestures_[gesture].window].features;
+  }
+
+  // Adds a pointer position sampled at timestamp_us and returns the bit set
+  // of the gestures the window now matches. A coalesced sample leaves the
+  // window as it was, so it repeats the previous result
+  uint32_t AddSample(int x, int y, int64_t timestamp_us) {
+    if (!has_last_sample_) {
+      last_x_ = x;
+      last_y_ = y;
+      last_time_us_ = timestamp_us;
+      has_last_sample_ = true;
+      return 0;
+    }
+
+    int64_t dt = timestamp_us - last_time_us_;
+    if (dt < min_sample_interval_us_ || dt <= 0) return last_matches_;
+
+    int dx = x - last_x_;
+    int dy = y - last_y_;
+    last_x_ = x;
+    last_y_ = y;
+    last_time_us_ = timestamp_us;
+
+    last_matches_ = AddMovement(dx, dy, dt);
+    return last_matches_;
+  }
+
+  // Adds a movement of (dx, dy) pixels over dt microseconds and returns the
+  // bit set of the gestures the window now matches
+  uint32_t AddMovement(int dx, int dy, int64_t dt) {
+    double distance = std::sqrt(dx * dx + dy * dy);
+    double speed = (dt > 0) ? (distance / static_cast<double>(dt)) * 1000000.0
+                            : 0;
+
+    int x_dir = Sign(dx);
+    int y_dir = Sign(dy);
+    int changes = 0;
+    double turn = 0.0;
+    if (movement_count_ > 0) {
+      if (last_x_dir_ != 0 && x_dir != 0 && last_x_dir_ != x_dir) ++changes;
+      if (last_y_dir_ != 0 && y_dir != 0 && last_y_dir_ != y_dir) ++changes;
+    }
+    if (dx != 0 || dy != 0) {
+      if (has_heading_) {
+        double cross = static_cast<double>(last_heading_x_) * dy -
+                       static_cast<double>(last_heading_y_) * dx;
+        double dot = static_cast<double>(last_heading_x_) * dx +
+                     static_cast<double>(last_heading_y_) * dy;
+        turn = std::atan2(cross, dot);
+      }
+      last_heading_x_ = dx;
+      last_heading_y_ = dy;
+      has_heading_ = true;
+    }
+    last_x_dir_ = x_dir;
+    last_y_dir_ = y_dir;
+
+    Totals next = TotalsAt(movement_count_);
+    next.time_us += dt;
+    next.dx += dx;
+    next.dy += dy;
+    next.direction_changes += changes;
+    next.sharp_turns += std::abs(turn) > kSharpTurn ? 1 : 0;
+    next.distance += distance;
+    next.speed += speed;
+    next.movement_speed = speed;
+    next.turning += turn;
+    next.absolute_turning += std::abs(turn);
+    ++movement_count_;
+    totals_[Slot(movement_count_)] = next;
+
+    // The floating point totals only ever grow; rebasing them on the oldest
+    // one still needed once per window length keeps their magnitude, and so
+    // the error of a difference, bounded at an amortized O(1) cost
+    if (++updates_since_rebase_ > capacity_) {
+      Rebase();
+      updates_since_rebase_ = 0;
+    }
+
+    double velocity_x = dx * 1e6 / static_cast<double>(dt);
+    double velocity_y = dy * 1e6 / static_cast<double>(dt);
+    for (WindowState& window : windows_) {
+      Slide(&window);
+      window.features.velocity_x = velocity_x;
+      window.features.velocity_y = velocity_y;
+    }
+
+    uint32_t matches = 0;
+    for (size_t i = 0; i < gestures_.size(); ++i) {
+      const RegisteredGesture& gesture = gestures_[i];
+      WindowState& window = windows_[gesture.window];
+      // The running totals may differ from a rescan in the last bits, so
+      // fall back to an exact sum when the average is close to the threshold
+      double margin = 1e-9 * std::abs(gesture.speed_threshold) + 1e-12;
+      if (std::abs(window.features.average_speed - gesture.speed_threshold) <=
+          margin) {
+        window.features.average_speed = ExactAverageSpeed(window);
+      }
+      if (gesture.matches(window.features)) matches |= uint32_t{1} << i;
+    }
+    return matches;
+  }
+
+  void Reset() {
+    totals_[0] = Totals();
+    for (WindowState& window : windows_) {
+      window.start = 0;
+      window.features = MotionFeatures();
+    }
+    movement_count_ = 0;
+    updates_since_rebase_ = 0;
+    has_last_sample_ = false;
+    has_heading_ = false;
+    last_x_dir_ = 0;
+    last_y_dir_ = 0;
+    last_matches_ = 0;
+  }
+
+ private:
+  // Sums over the movements so far
+  struct Totals {
+    int64_t time_us = 0;
+    int64_t dx = 0;
+    int64_t dy = 0;
+    int64_t direction_changes = 0;
+    int64_t sharp_turns = 0;
+    double distance = 0.0;
+    double speed = 0.0;
+    double turning = 0.0;
+    double absolute_turning = 0.0;
+    double movement_speed = 0.0;  // Of the last movement alone
+  };
+
+  struct WindowState {
+    GestureWindow window;
+    uint64_t start;  // Movements before the window
+    MotionFeatures features;
+  };
+
+  struct RegisteredGesture {
+    size_t window;
+    std::function<bool(const MotionFeatures&)> matches;
+    double speed_threshold;
+  };
+
+  static int Sign(int value) { return (value > 0) ? 1 : (value < 0) ? -1 : 0; }
+
+  size_t Slot(uint64_t movement) const {
+    return static_cast<size_t>(movement & (totals_.size() - 1));
+  }
+
+  // Totals after the first movement movements; the ring keeps at least the
+  // last capacity_ + 1 of them
+  const Totals& TotalsAt(uint64_t movement) const {
+    return totals_[Slot(movement)];
+  }
+
+  // Drops the movements that left the window and recomputes its features
+  void Slide(WindowState* state) {
+    const GestureWindow& window = state->window;
+    uint64_t count = movement_count_ - state->start;
+    if (count > window.max_movements) {
+      state->start = movement_count_ - window.max_movements;
+    }
+    const Totals& newest = TotalsAt(movement_count_);
+    while (state->start < movement_count_ &&
+           newest.time_us - TotalsAt(state->start).time_us >
+               window.max_duration_us) {
+      ++state->start;
+    }
+
+    MotionFeatures& features = state->features;
+    count = movement_count_ - state->start;
+    if (count == 0) {
+      features = MotionFeatures();
+      return;
+    }
+
+    // Turns and reversals are counted against the previous movement, so the
+    // oldest movement's ones lie outside the window
+    const Totals& before = TotalsAt(state->start);
+    const Totals& first = TotalsAt(state->start + 1);
+    features.movement_count = static_cast<size_t>(count);
+    features.duration_us = newest.time_us - before.time_us;
+    features.path_length = newest.distance - before.distance;
+    features.displacement_x = newest.dx - before.dx;
+    features.displacement_y = newest.dy - before.dy;
+    features.average_speed =
+        (newest.speed - before.speed) / static_cast<double>(count);
+    features.direction_changes =
+        static_cast<int>(newest.direction_changes - first.direction_changes);
+    features.turning = newest.turning - first.turning;
+    features.absolute_turning =
+        newest.absolute_turning - first.absolute_turning;
+    features.sharp_turns =
+        static_cast<int>(newest.sharp_turns - first.sharp_turns);
+  }
+
+  // Sums the window's speeds oldest to newest, in the same order as a full
+  // rescan
+  double ExactAverageSpeed(const WindowState& state) const {
+    if (state.features.movement_count == 0) return 0.0;
+    double total = 0.0;
+    for (uint64_t m = state.start + 1; m <= movement_count_; ++m) {
+      total += TotalsAt(m).movement_speed;
+    }
+    return total / static_cast<double>(state.features.movement_count);
+  }
+
+  void Rebase() {
+    Totals base = TotalsAt(movement_count_ - capacity_);
+    for (Totals& totals : totals_) {
+      totals.distance -= base.distance;
+      totals.speed -= base.speed;
+      totals.turning -= base.turning;
+      totals.absolute_turning -= base.absolute_turning;
+    }
+  }
+
+  int64_t min_sample_interval_us_;
+  std::vector<WindowState> windows_;
+  std::vector<RegisteredGesture> gestures_;
+  size_t capacity_ = 1;
+  std::vector<Totals> totals_;  // Power-of-two ring
+  uint64_t movement_count_ = 0;
+  size_t updates_since_rebase_ = 0;
+  bool has_last_sample_ = false;
+  int last_x_ = 0;
+  int last_y_ = 0;
+  int64_t last_time_us_ = 0;
+  int last_x_dir_ = 0;
+  int last_y_dir_ = 0;
+  bool has_heading_ = false;
+  int last_heading_x_ = 0;
+  int last_heading_y_ = 0;
+  uint32_t last_matches_ = 0;
+};
+
+// The shake ShakeDetector recognizes, on the same thresholds
+inline Gesture ShakeGesture(const ShakeParams& params) {
+  size_t movements = params.history_size > 0 ? params.history_size : 1;
+  return {{movements, GestureEngine::kUnlimitedDuration},
+          [params, movements](const MotionFeatures& features) {
+            return features.movement_count >= movements &&
+                   features.duration_us <= params.max_time_window_us &&
+                   features.direction_changes >=
+                       params.min_direction_changes &&
+                   features.average_speed >= params.min_movement_speed;
+          },
+          params.min_movement_speed};
+}
+
+struct CircleParams {
+  size_t max_movements;
+  int64_t max_duration_us;  // Longest time to draw the circle
+  double min_turns;         // Net turning, in full turns
+  double min_path_length;   // Pixels
+  int max_sharp_turns;      // Reversals allowed; a shake is mostly reversals
+};
+
+// A loop in either direction, matched from the moment it closes
+inline Gesture CircleGesture(const CircleParams& params) {
+  constexpr double kFullTurn = 2.0 * 3.14159265358979323846;
+  return {{params.max_movements, params.max_duration_us},
+          [params](const MotionFeatures& features) {
+            return std::abs(features.turning) >= params.min_turns * kFullTurn &&
+                   features.path_length >= params.min_path_length &&
+                   features.sharp_turns <= params.max_sharp_turns;
+          }};
+}
+
+struct FlickParams {
+  size_t max_movements;
+  int64_t max_duration_us;  // Longest time to cover min_distance
+  double min_distance;      // Net pixels
+  double min_straightness;  // Net distance over the path length
+};
+
+// A fast, nearly straight throw of the pointer, matched while it lasts
+inline Gesture FlickGesture(const FlickParams& params) {
+  return {{params.max_movements, params.max_duration_us},
+          [params](const MotionFeatures& features) {
+            double distance = features.displacement();
+            return features.movement_count >= 2 &&
+                   distance >= params.min_distance &&
+                   distance >= params.min_straightness * features.path_length;
+          }};
+}
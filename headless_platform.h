@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "cursor_swap_scheduler.h"
+#include "monotonic_clock.h"
+#include "shake_app.h"
+
+// One system cursor change, at simulated time
+struct CursorSwapEvent {
+  int64_t time_us;
+  int shape;
+  int frame;  // -1 for the original cursor
+};
+
+// System cursor table in memory that records every swap with the time it
+// happened
+class HeadlessCursors : public CursorSwapPlatform {
+ public:
+  HeadlessCursors(const MonotonicClock* clock, int shape_count)
+      : clock_(clock), shown_(static_cast<size_t>(shape_count), -1) {}
+
+  int ShapeCount() const override { return static_cast<int>(shown_.size()); }
+  int CurrentShape() override { return current_shape_; }
+
+  void ShowEnlarged(int shape, int frame) override { Record(shape, frame); }
+  void ShowOriginal(int shape) override { Record(shape, -1); }
+
+  // Shape the pointer shows, -1 for one the app does not manage
+  void set_current_shape(int shape) { current_shape_ = shape; }
+
+  // Off, only the swaps are counted, so a timing run does not allocate
+  void set_recording(bool recording) { recording_ = recording; }
+
+  // Frame shown for shape, -1 while it is the original cursor
+  int shown(int shape) const { return shown_[static_cast<size_t>(shape)]; }
+
+  const std::vector<CursorSwapEvent>& timeline() const { return timeline_; }
+  uint64_t swap_count() const { return swap_count_; }
+
+ private:
+  void Record(int shape, int frame) {
+    shown_[static_cast<size_t>(shape)] = frame;
+    ++swap_count_;
+    if (recording_) timeline_.push_back({clock_->NowMicros(), shape, frame});
+  }
+
+  const MonotonicClock* clock_;
+  std::vector<int> shown_;
+  int current_shape_ = 0;
+  bool recording_ = true;
+  std::vector<CursorSwapEvent> timeline_;
+  uint64_t swap_count_ = 0;
+};
+
+// AppPlatform without a desktop. Time only moves when the driver sets it,
+// and the pointer stays where the driver or a corner flick last put it, so
+// every run over the same input is the same
+class HeadlessPlatform : public AppPlatform {
+ public:
+  static constexpr int kShapeCount = 13;  // As many as the app manages
+
+  explicit HeadlessPlatform(
+      std::vector<ScreenRect> monitors = {{0, 0, 1920, 1080}})
+      : monitors_(std::move(monitors)), cursors_(&clock_, kShapeCount) {}
+
+  const MonotonicClock* clock() const override { return &clock_; }
+  CursorSwapPlatform* cursors() override { return &cursors_; }
+
+  bool PointerPosition(int32_t* x, int32_t* y) override {
+    *x = x_;
+    *y = y_;
+    return true;
+  }
+
+  void MovePointer(int32_t x, int32_t y) override {
+    x_ = x;
+    y_ = y;
+    ++pointer_warps_;
+  }
+
+  void PointerMoved(int32_t, int32_t) override {}
+
+  // The monitor holding (x, y), or the one with the nearest edge
+  bool MonitorBounds(int32_t x, int32_t y, ScreenRect* bounds) override {
+    if (monitors_.empty()) return false;
+    int64_t best_distance = -1;
+    for (const ScreenRect& monitor : monitors_) {
+      int64_t dx = x < monitor.left    ? monitor.left - x
+                   : x >= monitor.right ? x - monitor.right + 1
+                                        : 0;
+      int64_t dy = y < monitor.top      ? monitor.top - y
+                   : y >= monitor.bottom ? y - monitor.bottom + 1
+                                         : 0;
+      int64_t distance = dx * dx + dy * dy;
+      if (best_distance < 0 || distance < best_distance) {
+        best_distance = distance;
+        *bounds = monitor;
+      }
+    }
+    return true;
+  }
+
+  bool AddTrayIcon() override {
+    tray_icon_ = true;
+    return true;
+  }
+
+  void RemoveTrayIcon() override { tray_icon_ = false; }
+
+  // Driver side
+  void SetTime(int64_t now_us) { clock_.Set(now_us); }
+  void SetPointer(int32_t x, int32_t y) {
+    x_ = x;
+    y_ = y;
+  }
+
+  HeadlessCursors& headless_cursors() { return cursors_; }
+  const HeadlessCursors& headless_cursors() const { return cursors_; }
+  bool tray_icon() const { return tray_icon_; }
+  uint64_t pointer_warps() const { return pointer_warps_; }
+
+ private:
+  ManualClock clock_;
+  std::vector<ScreenRect> monitors_;
+  HeadlessCursors cursors_;
+  int32_t x_ = 0;
+  int32_t y_ = 0;
+  bool tray_icon_ = false;
+  uint64_t pointer_warps_ = 0;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// HDR-style histogram of non-negative integer values, e.g. nanoseconds.
+// Values below 2^kSubBucketBits get a bucket each; above that every power of
+// two is split into 2^kSubBucketBits linear buckets, so any recorded value is
+// reported within 1/32 (about 3%) of itself. Values of 2^kMaxValueBits and
+// above are counted in the last bucket.
+//
+// Record() is a couple of relaxed atomic adds and is safe from any number of
+// threads. Readers see a consistent-enough view for reporting: counts may
+// trail the sum by the records in flight
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kMaxValueBits = 40;  // About 18 minutes in nanoseconds
+  static constexpr int64_t kSubBucketCount = int64_t{1} << kSubBucketBits;
+  static constexpr size_t kBucketCount = static_cast<size_t>(
+      kSubBucketCount + (kMaxValueBits - kSubBucketBits) * kSubBucketCount);
+
+  LatencyHistogram() { Reset(); }
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  void Record(int64_t value) {
+    if (value < 0) value = 0;
+    counts_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    total_count_.fetch_add(1, std::memory_order_relaxed);
+    total_value_.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Records racing with Reset() may survive it
+  void Reset() {
+    for (std::atomic<uint64_t>& count : counts_) {
+      count.store(0, std::memory_order_relaxed);
+    }
+    total_count_.store(0, std::memory_order_relaxed);
+    total_value_.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const {
+    return total_count_.load(std::memory_order_relaxed);
+  }
+
+  double mean() const {
+    uint64_t n = count();
+    return n > 0 ? static_cast<double>(
+                       total_value_.load(std::memory_order_relaxed)) /
+                       static_cast<double>(n)
+                 : 0.0;
+  }
+
+  // Highest value equivalent to the value at the given percentile (0-100),
+  // or 0 if nothing was recorded
+  int64_t ValueAtPercentile(double percentile) const {
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t>& count : counts_) {
+      total += count.load(std::memory_order_relaxed);
+    }
+    if (total == 0) return 0;
+    if (percentile > 100.0) percentile = 100.0;
+    uint64_t target = static_cast<uint64_t>(
+        percentile / 100.0 * static_cast<double>(total) + 0.5);
+    if (target < 1) target = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += counts_[i].load(std::memory_order_relaxed);
+      if (seen >= target) return BucketHighestValue(i);
+    }
+    return BucketHighestValue(kBucketCount - 1);
+  }
+
+  int64_t min_value() const {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      if (counts_[i].load(std::memory_order_relaxed) > 0) {
+        return BucketLowestValue(i);
+      }
+    }
+    return 0;
+  }
+
+  int64_t max_value() const { return ValueAtPercentile(100.0); }
+
+  static size_t BucketIndex(int64_t value) {
+    uint64_t v = static_cast<uint64_t>(value);
+    if (v < static_cast<uint64_t>(kSubBucketCount)) {
+      return static_cast<size_t>(v);
+    }
+    int exponent = HighestBit(v);
+    if (exponent >= kMaxValueBits) return kBucketCount - 1;
+    int shift = exponent - kSubBucketBits;
+    return static_cast<size_t>(shift * kSubBucketCount +
+                               static_cast<int64_t>(v >> shift));
+  }
+
+  static int64_t BucketLowestValue(size_t index) {
+    int64_t i = static_cast<int64_t>(index);
+    if (i < kSubBucketCount) return i;
+    int shift = static_cast<int>((i - kSubBucketCount) / kSubBucketCount);
+    int64_t sub_bucket = (i - kSubBucketCount) % kSubBucketCount;
+    return (kSubBucketCount + sub_bucket) << shift;
+  }
+
+  static int64_t BucketHighestValue(size_t index) {
+    int64_t i = static_cast<int64_t>(index);
+    if (i < kSubBucketCount) return i;
+    int shift = static_cast<int>((i - kSubBucketCount) / kSubBucketCount);
+    return BucketLowestValue(index) + (int64_t{1} << shift) - 1;
+  }
+
+ private:
+  // Index of the highest set bit of a non-zero value
+  static int HighestBit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int bit = 0;
+    for (int step = 32; step > 0; step >>= 1) {
+      if (v >> step) {
+        v >>= step;
+        bit += step;
+      }
+    }
+    return bit;
+#endif
+  }
+
+  std::atomic<uint64_t> counts_[kBucketCount];
+  std::atomic<uint64_t> total_count_;
+  std::atomic<int64_t> total_value_;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "latency_histogram.h"
+
+// Latency of each stage between a mouse event and the cursor changing, one
+// histogram per stage, in nanoseconds. Recording is off by default; while
+// it is off every probe costs one relaxed load and a branch
+class LatencyRecorder {
+ public:
+  enum Stage {
+    kHookCallback,     // Time spent inside the low-level mouse hook
+    kEventToDecision,  // Event receipt to shake detector decision
+    kEventToEnlarge,   // Receipt of the shaking event to the first swap done
+    kCursorSwap,       // One round of SetSystemCursor calls
+    kRestoreDelay,     // Restore deadline to the restore starting
+    kStageCount
+  };
+
+  static const char* StageName(Stage stage) {
+    static const char* const kNames[kStageCount] = {
+        "hook callback", "event to decision", "event to enlarge",
+        "cursor swap",   "restore delay",
+    };
+    return kNames[stage];
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  // Callers check enabled() first so the timestamps are skipped as well
+  void Record(Stage stage, int64_t value_ns) {
+    histograms_[stage].Record(value_ns);
+  }
+
+  const LatencyHistogram& histogram(Stage stage) const {
+    return histograms_[stage];
+  }
+
+  void Reset() {
+    for (LatencyHistogram& histogram : histograms_) {
+      histogram.Reset();
+    }
+  }
+
+  // One line per stage with the count and the mean, percentiles and maximum
+  // in microseconds
+  std::string Report() const {
+    std::ostringstream out;
+    out << std::left << std::setw(20) << "stage" << std::right
+        << std::setw(10) << "count" << std::setw(10) << "mean"
+        << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10)
+        << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max"
+        << "  (us)\n";
+    out << std::fixed << std::setprecision(1);
+    for (int i = 0; i < kStageCount; ++i) {
+      const LatencyHistogram& histogram = histograms_[i];
+      out << std::left << std::setw(20) << StageName(static_cast<Stage>(i))
+          << std::right << std::setw(10) << histogram.count()
+          << std::setw(10) << histogram.mean() / 1000.0;
+      for (double percentile : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+        out << std::setw(10)
+            << static_cast<double>(histogram.ValueAtPercentile(percentile)) /
+                   1000.0;
+      }
+      out << '\n';
+    }
+    return out.str();
+  }
+
+ private:
+  std::atomic<bool> enabled_{false};
+  LatencyHistogram histograms_[kStageCount];
+};
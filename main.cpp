@@ -5,17 +5,47 @@
 // clang-format off
 #include <atlbase.h>
 #include <shellapi.h>
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
-#include <deque>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <stdexcept>
+#include "async_logger.h"
+#include "cursor_animation.h"
+#include "cursor_cache.h"
+#include "cursor_scaler.h"
+#include "cursor_set_cache.h"
+#include "cursor_snapshot.h"
+#include "cursor_swap_scheduler.h"
+#include "deadline_scheduler.h"
+#include "diagnostic_ring.h"
+#include "enlarge_state_machine.h"
+#include "event_loop.h"
+#include "latency_recorder.h"
+#include "monotonic_clock.h"
+#include "mouse_trace.h"
+#include "rcu_pointer.h"
 #include "resource.h"
+#include "runtime_config.h"
+#include "sample_worker.h"
+#include "shake_app.h"
+#include "shake_detector.h"
+#include "spotlight.h"
+#include "startup_profile.h"
+#include "work_stealing_pool.h"
 #include <taskschd.h>
 #include <comdef.h>
 #pragma comment(lib, "taskschd.lib")
@@ -27,18 +57,38 @@
 class CursorConfig {
  public:
   static constexpr double kScaleFactor = 3.0;           // Cursor enlargement factor
-  static constexpr size_t kHistorySize = 10;            // Keep last 10 movements
-  static constexpr int kMinDirectionChanges = 5;        // Minimum direction changes required
-  static constexpr double kMinMovementSpeed = 800.0;    // Minimum speed in pixels/second
-  static constexpr int kMaxTimeWindow = 500;            // Time window in milliseconds
-  static constexpr int kEnlargeDurationMs = 500;        // Cursor enlargement duration (milliseconds)
+  static constexpr ScaleFilter kScaleFilter = ScaleFilter::kLanczos3; // Cursor scaling filter
+  static constexpr bool kEnlargeCurrentCursorOnly = true; // Swap only the cursor shape on screen
+  static constexpr int kAnimationFrames = 6;            // Frames per grow/shrink animation, 1 disables it
+  static constexpr int kAnimationDurationMs = 120;      // Grow/shrink animation duration (milliseconds)
+  static constexpr unsigned kCursorBuildThreads = 4;    // Threads rendering the per-monitor-DPI cursor sets
+  static constexpr bool kSpotlight = false;             // Dim the screen around the cursor instead of enlarging it
+  static constexpr int kSpotlightRadius = 120;          // Clear circle around the cursor (pixels)
+  static constexpr int kSpotlightRingWidth = 6;         // Highlight ring around the circle (pixels)
+  static constexpr uint32_t kSpotlightDimColor = 0xA0000000; // Screen dimming color (0xAARRGGBB)
+  static constexpr uint32_t kSpotlightRingColor = 0xE0FFC800; // Highlight ring color (0xAARRGGBB)
   static constexpr UINT_PTR kTimerId = 1;               // Timer ID
-  static constexpr UINT kTimerInterval = 100;           // Timer interval (milliseconds)
+  static constexpr UINT kPollingInterval = 10;          // Polling mode sampling interval while the cursor moves (milliseconds)
+  static constexpr UINT kIdlePollingInterval = 100;     // Longest polling interval while the cursor is still (milliseconds)
+  static constexpr int kIdlePollingAfterMs = 1000;      // Stillness before polling slows down (milliseconds)
+  static constexpr uint32_t kDiagnosticRingCapacity = 4096; // Recent detector inputs kept in shared memory
+  static constexpr const char* kConfigFileName = "ShakeToFindCursor.conf"; // Runtime config file, reloaded on change
+  static constexpr UINT_PTR kConfigTimerId = 2;         // Config file check timer ID
+  static constexpr UINT kConfigCheckIntervalMs = 1000;  // Config file check interval (milliseconds)
+  static constexpr const char* kLogFileName = "ShakeToFindCursor.log"; // Debug log file
+  static constexpr uint64_t kLogMaxFileBytes = 1 << 20; // Rotate the debug log past this size
+  static constexpr int kLogMaxFiles = 2;                // Rotated debug logs kept
+  static constexpr const char* kLatencyReportFileName = "ShakeToFindCursor-latency.txt"; // Latency report file
   static constexpr UINT kTrayIconId = 1;                // Tray icon ID
   static constexpr UINT kTrayIconMessage = WM_APP + 1;  // Tray message ID
+  static constexpr UINT kAutoStartDoneMessage = WM_APP + 2; // Auto-start request finished message ID
+  static constexpr UINT kCursorSetsBuiltMessage = WM_APP + 3; // Display change cursor sets built message ID
+  static constexpr int kAutoStartRefreshIntervalMs = 10000; // Shortest time between auto-start state checks (milliseconds)
   static constexpr UINT kMenuExitId = 2000;             // Exit menu item ID
   static constexpr UINT kMenuAutoStartId = 2001;        // Enable auto-start menu item ID
   static constexpr UINT kMenuDisableAutoStartId = 2002; // Disable auto-start menu item ID
+  static constexpr UINT kMenuLatencyTracingId = 2003;   // Toggle latency tracing menu item ID
+  static constexpr UINT kMenuSaveLatencyReportId = 2004; // Save latency report menu item ID
 
   enum class MouseTrackingMode {
     kHook,    // Use SetWindowsHookEx
@@ -48,6 +98,8 @@ class CursorConfig {
 
 // clang-format on
 
+// Process-wide debug log. Records are written on the logger's own thread,
+// so logging from the hook callback never waits on the disk
 class Logger {
  public:
   static Logger& GetInstance() {
@@ -55,27 +107,16 @@ class Logger {
     return instance;
   }
 
-  void Log(const std::string& message) {
-    std::ofstream log_file("ShakeToFindCursor.log", std::ios_base::app);
-    if (log_file.is_open()) {
-      log_file << GetTimestamp() << " - " << message << std::endl;
-    }
-  }
+  void Log(std::string_view message) { logger_.Log(message); }
 
  private:
-  Logger() = default;
+  Logger()
+      : logger_({CursorConfig::kLogFileName, CursorConfig::kLogMaxFileBytes,
+                 CursorConfig::kLogMaxFiles}) {}
   Logger(const Logger&) = delete;
   Logger& operator=(const Logger&) = delete;
 
-  std::string GetTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    std::tm now_tm;
-    localtime_s(&now_tm, &now_time_t);
-    std::stringstream ss;
-    ss << std::put_time(&now_tm, "%Y-%m-%d %H:%M:%S");
-    return ss.str();
-  }
+  AsyncLogger logger_;
 };
 
 #ifdef _DEBUG
@@ -84,16 +125,24 @@ class Logger {
 #define DEBUG_LOG(msg)
 #endif
 
-// COM initialization class
+// Initializes COM on the calling thread while in scope
 class ComInitializer {
  public:
-  ComInitializer() {
-    if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {
-      throw std::runtime_error("Failed to initialize COM");
-    }
+  ComInitializer()
+      : initialized_(
+            SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {}
+
+  ~ComInitializer() {
+    if (initialized_) CoUninitialize();
   }
 
-  ~ComInitializer() { CoUninitialize(); }
+  ComInitializer(const ComInitializer&) = delete;
+  ComInitializer& operator=(const ComInitializer&) = delete;
+
+  bool initialized() const { return initialized_; }
+
+ private:
+  bool initialized_;
 };
 
 // Auto-start manager class to enable/disable auto-start
@@ -258,6 +307,108 @@ class AutoStartManager {
   }
 };
 
+// Runs auto-start requests on a thread of its own, so the tray menu never
+// waits on the Task Scheduler. The thread, and COM with it, only start with
+// the first request. The auto-start state is cached for the menu and
+// refreshed in the background
+class AutoStartService {
+ public:
+  enum class State { kUnknown, kEnabled, kDisabled };
+  enum Request : WPARAM { kRefresh, kEnable, kDisable };
+
+  AutoStartService() = default;
+  AutoStartService(const AutoStartService&) = delete;
+  AutoStartService& operator=(const AutoStartService&) = delete;
+
+  // Waits for a request in progress, queued ones are dropped
+  ~AutoStartService() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_cv_.notify_one();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // Each finished request is posted to hwnd as done_message, with the
+  // request as wParam and whether it succeeded as lParam
+  void Attach(HWND hwnd, UINT done_message) {
+    hwnd_ = hwnd;
+    done_message_ = done_message;
+  }
+
+  State state() const { return state_.load(); }
+
+  // Queues a state check unless one was queued within
+  // kAutoStartRefreshIntervalMs. UI thread only
+  void Refresh() {
+    int64_t now_us = MonotonicMicros();
+    if (refreshed_ && now_us - last_refresh_us_ <
+                          CursorConfig::kAutoStartRefreshIntervalMs * 1000LL) {
+      return;
+    }
+    refreshed_ = true;
+    last_refresh_us_ = now_us;
+    Post(kRefresh);
+  }
+
+  void Post(Request request) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      requests_.push_back(request);
+      if (!thread_.joinable()) {
+        thread_ = std::thread(&AutoStartService::ThreadMain, this);
+      }
+    }
+    wake_cv_.notify_one();
+  }
+
+ private:
+  void ThreadMain() {
+    ComInitializer com;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wake_cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+      if (stop_) return;
+      Request request = requests_.front();
+      requests_.pop_front();
+      lock.unlock();
+      bool succeeded = com.initialized() && Run(request);
+      PostMessage(hwnd_, done_message_, request, succeeded);
+      lock.lock();
+    }
+  }
+
+  bool Run(Request request) {
+    switch (request) {
+      case kEnable:
+        if (!AutoStartManager::EnableAutoStart()) return false;
+        state_.store(State::kEnabled);
+        return true;
+      case kDisable:
+        if (!AutoStartManager::DisableAutoStart()) return false;
+        state_.store(State::kDisabled);
+        return true;
+      default:
+        state_.store(AutoStartManager::IsAutoStartEnabled()
+                         ? State::kEnabled
+                         : State::kDisabled);
+        return true;
+    }
+  }
+
+  HWND hwnd_ = nullptr;
+  UINT done_message_ = 0;
+  std::atomic<State> state_{State::kUnknown};
+  bool refreshed_ = false;  // UI thread only, as is last_refresh_us_
+  int64_t last_refresh_us_ = 0;
+  std::mutex mutex_;
+  std::condition_variable wake_cv_;
+  std::deque<Request> requests_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
 // Cursor utilities class
 class CursorUtils {
  public:
@@ -266,98 +417,126 @@ class CursorUtils {
       return nullptr;
     }
 
-    // Get cursor information
-    ICONINFO icon_info;
-    if (!GetIconInfo(src_cursor, &icon_info)) {
+    CursorImage image;
+    if (!ReadCursorImage(src_cursor, &image)) {
       return nullptr;
     }
 
+    return CreateCursorFromImage(CursorScaler::ScaleCursorImage(
+        image, scale_factor, CursorConfig::kScaleFilter));
+  }
+
+  // Reads a cursor into 32-bit pixels. Color cursors without an alpha
+  // channel take their transparency from the AND mask
+  static bool ReadCursorImage(HCURSOR cursor, CursorImage* image) {
+    ICONINFO icon_info;
+    if (!GetIconInfo(cursor, &icon_info)) {
+      return false;
+    }
+
     // Use RAII to manage bitmap resources
     std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
         color_bitmap(icon_info.hbmColor, DeleteObject);
     std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
         mask_bitmap(icon_info.hbmMask, DeleteObject);
 
-    // Get bitmap information
     BITMAP bm;
-    if (!GetObject(icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask,
-                   sizeof(BITMAP), &bm)) {
-      return nullptr;
+    if (!GetObject(icon_info.hbmMask, sizeof(BITMAP), &bm)) {
+      return false;
     }
 
-    // Calculate new dimensions
-    int new_width = static_cast<int>(bm.bmWidth * scale_factor);
-    int new_height = static_cast<int>(bm.bmHeight * scale_factor);
+    image->hotspot_x = static_cast<int>(icon_info.xHotspot);
+    image->hotspot_y = static_cast<int>(icon_info.yHotspot);
+    image->monochrome = (icon_info.hbmColor == nullptr);
 
-    // Create compatible DC
-    HDC screen_dc = GetDC(nullptr);
-    if (!screen_dc) {
-      return nullptr;
+    // Monochrome cursors stack the AND and XOR planes in one mask bitmap
+    int width = bm.bmWidth;
+    int height = image->monochrome ? bm.bmHeight / 2 : bm.bmHeight;
+    std::vector<uint32_t> mask;
+    if (!ReadBitmapPixels(icon_info.hbmMask, width, bm.bmHeight, &mask)) {
+      return false;
+    }
+
+    BgraImage& pixels = image->pixels;
+    pixels.width = width;
+    pixels.height = height;
+    size_t plane_size = static_cast<size_t>(width) * height;
+
+    if (image->monochrome) {
+      pixels.pixels.resize(plane_size);
+      for (size_t i = 0; i < plane_size; ++i) {
+        uint32_t and_bit = (mask[i] & 0xFFFFFF) ? 0xFF : 0;
+        uint32_t xor_bit = (mask[plane_size + i] & 0xFFFFFF) ? 0xFF00 : 0;
+        pixels.pixels[i] = 0xFF000000 | xor_bit | and_bit;
+      }
+      return true;
+    }
+
+    if (!ReadBitmapPixels(icon_info.hbmColor, width, height, &pixels.pixels)) {
+      return false;
+    }
+    bool has_alpha = false;
+    for (uint32_t pixel : pixels.pixels) {
+      if (pixel >> 24) {
+        has_alpha = true;
+        break;
+      }
     }
-    HDC src_dc = CreateCompatibleDC(screen_dc);
-    HDC dst_dc = CreateCompatibleDC(screen_dc);
-    if (!src_dc || !dst_dc) {
-      if (src_dc) DeleteDC(src_dc);
-      if (dst_dc) DeleteDC(dst_dc);
-      ReleaseDC(nullptr, screen_dc);
+    if (!has_alpha) {
+      for (size_t i = 0; i < plane_size; ++i) {
+        uint32_t alpha = (mask[i] & 0xFFFFFF) ? 0 : 0xFF000000;
+        pixels.pixels[i] = (pixels.pixels[i] & 0xFFFFFF) | alpha;
+      }
+    }
+    return true;
+  }
+
+  static HCURSOR CreateCursorFromImage(const CursorImage& image) {
+    const BgraImage& pixels = image.pixels;
+    if (pixels.width <= 0 || pixels.height <= 0) {
       return nullptr;
     }
 
-    // Create new color bitmap and mask bitmap
+    std::vector<uint8_t> mask_bits = CursorScaler::BuildMaskBits(image);
+    HBITMAP new_mask =
+        CreateBitmap(pixels.width,
+                     image.monochrome ? pixels.height * 2 : pixels.height, 1, 1,
+                     mask_bits.data());
     HBITMAP new_color = nullptr;
-    HBITMAP new_mask = nullptr;
     HCURSOR new_cursor = nullptr;
 
     do {
-      // Create enlarged color bitmap
-      BITMAPINFO bmi = {0};
-      bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-      bmi.bmiHeader.biWidth = new_width;
-      bmi.bmiHeader.biHeight = new_height;
-      bmi.bmiHeader.biPlanes = 1;
-      bmi.bmiHeader.biBitCount = 32;
-      bmi.bmiHeader.biCompression = BI_RGB;
-
-      void* color_bits = nullptr;
-      new_color = CreateDIBSection(screen_dc, &bmi, DIB_RGB_COLORS, &color_bits,
-                                   nullptr, 0);
-      if (!new_color) break;
-
-      // Create mask bitmap
-      new_mask = CreateBitmap(new_width, new_height, 1, 1, nullptr);
       if (!new_mask) break;
 
-      // Select source bitmap
-      HBITMAP old_src_color = (HBITMAP)SelectObject(
-          src_dc, icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask);
-      HBITMAP old_dst_color = (HBITMAP)SelectObject(dst_dc, new_color);
-
-      // Perform scaling
-      SetStretchBltMode(dst_dc, HALFTONE);
-      SetBrushOrgEx(dst_dc, 0, 0, nullptr);
-      StretchBlt(dst_dc, 0, 0, new_width, new_height, src_dc, 0, 0, bm.bmWidth,
-                 bm.bmHeight, SRCCOPY);
-
-      // If there is a color bitmap, also process the mask bitmap
-      if (icon_info.hbmColor) {
-        SelectObject(src_dc, icon_info.hbmMask);
-        SelectObject(dst_dc, new_mask);
-        StretchBlt(dst_dc, 0, 0, new_width, new_height, src_dc, 0, 0,
-                   bm.bmWidth, bm.bmHeight, SRCCOPY);
+      if (!image.monochrome) {
+        HDC screen_dc = GetDC(nullptr);
+        if (!screen_dc) break;
+
+        BITMAPINFO bmi = {0};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = pixels.width;
+        bmi.bmiHeader.biHeight = -pixels.height;  // Top-down
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        void* color_bits = nullptr;
+        new_color = CreateDIBSection(screen_dc, &bmi, DIB_RGB_COLORS,
+                                     &color_bits, nullptr, 0);
+        ReleaseDC(nullptr, screen_dc);
+        if (!new_color) break;
+
+        memcpy(color_bits, pixels.pixels.data(),
+               pixels.pixels.size() * sizeof(uint32_t));
+        GdiFlush();
       }
 
-      // Restore DC
-      SelectObject(src_dc, old_src_color);
-      SelectObject(dst_dc, old_dst_color);
-
       // Create new cursor
       ICONINFO new_icon_info = {0};
       new_icon_info.fIcon =
           FALSE;  // Specify creating a cursor instead of an icon
-      new_icon_info.xHotspot =
-          static_cast<DWORD>(icon_info.xHotspot * scale_factor);
-      new_icon_info.yHotspot =
-          static_cast<DWORD>(icon_info.yHotspot * scale_factor);
+      new_icon_info.xHotspot = static_cast<DWORD>(image.hotspot_x);
+      new_icon_info.yHotspot = static_cast<DWORD>(image.hotspot_y);
       new_icon_info.hbmMask = new_mask;
       new_icon_info.hbmColor = new_color;
 
@@ -368,12 +547,33 @@ class CursorUtils {
     // Clean up resources
     if (new_color) DeleteObject(new_color);
     if (new_mask) DeleteObject(new_mask);
-    DeleteDC(src_dc);
-    DeleteDC(dst_dc);
-    ReleaseDC(nullptr, screen_dc);
 
     return new_cursor;
   }
+
+ private:
+  // Reads a bitmap as top-down 32-bit pixels
+  static bool ReadBitmapPixels(HBITMAP bitmap, int width, int height,
+                               std::vector<uint32_t>* pixels) {
+    HDC screen_dc = GetDC(nullptr);
+    if (!screen_dc) {
+      return false;
+    }
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;  // Top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    pixels->resize(static_cast<size_t>(width) * height);
+    int lines = GetDIBits(screen_dc, bitmap, 0, static_cast<UINT>(height),
+                          pixels->data(), &bmi, DIB_RGB_COLORS);
+    ReleaseDC(nullptr, screen_dc);
+    return lines == height;
+  }
 };
 
 HCURSOR GetSystemArrowCursor() {
@@ -384,258 +584,778 @@ HCURSOR GetSystemArrowCursor() {
   return nullptr;
 }
 
-// Large cursor class
-class LargeCursor {
+// Monitor DPI queries. Per-monitor DPI needs Windows 8.1, so its functions
+// are looked up at run time and the system DPI is used without them
+class DisplayDpi {
  public:
-  LargeCursor(LPCWSTR cursor_name, DWORD system_cursor_id)
-      : system_cursor_id_(system_cursor_id) {
-    // Load the system cursor
-    original_cursor_ = CopyCursor(LoadCursorW(nullptr, cursor_name));
-    if (!original_cursor_) {
-      throw std::runtime_error("Failed to load system cursor");
+  // Makes the process per-monitor DPI aware where supported, so monitor
+  // DPIs and cursor positions are reported unscaled
+  static void EnableAwareness() {
+    using SetContextFn = BOOL(WINAPI*)(HANDLE);
+    using SetAwarenessFn = HRESULT(WINAPI*)(int);
+    HMODULE user32 = GetModuleHandleW(L"user32.dll");
+    auto set_context = user32 ? reinterpret_cast<SetContextFn>(GetProcAddress(
+                                    user32, "SetProcessDpiAwarenessContext"))
+                              : nullptr;
+    // DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2
+    if (set_context && set_context(reinterpret_cast<HANDLE>(intptr_t{-4}))) {
+      return;
     }
-
-    // Create enlarged cursor
-    large_cursor_ = CursorUtils::ScaleCursor(
-        original_cursor_, CursorConfig::kScaleFactor);  // Enlarge by 2 times
-    if (!large_cursor_) {
-      throw std::runtime_error("Failed to create large cursor");
+    HMODULE shcore = Shcore();
+    auto set_awareness =
+        shcore ? reinterpret_cast<SetAwarenessFn>(
+                     GetProcAddress(shcore, "SetProcessDpiAwareness"))
+               : nullptr;
+    // PROCESS_PER_MONITOR_DPI_AWARE
+    if (set_awareness && SUCCEEDED(set_awareness(2))) {
+      return;
     }
+    SetProcessDPIAware();
   }
 
-  void Enlarge() {
-    if (large_cursor_) {
-      HCURSOR cursor_copy = CopyCursor(large_cursor_);
-      if (cursor_copy) {
-        SetSystemCursor(cursor_copy, system_cursor_id_);
-      } else {
-        DestroyCursor(cursor_copy);
-      }
+  static int System() {
+    HDC screen_dc = GetDC(nullptr);
+    if (!screen_dc) {
+      return USER_DEFAULT_SCREEN_DPI;
     }
+    int dpi = GetDeviceCaps(screen_dc, LOGPIXELSX);
+    ReleaseDC(nullptr, screen_dc);
+    return dpi;
   }
 
-  void Restore() {
-    if (original_cursor_) {
-      HCURSOR cursor_copy = CopyCursor(original_cursor_);
-      if (cursor_copy) {
-        SetSystemCursor(cursor_copy, system_cursor_id_);
-      } else {
-        DestroyCursor(cursor_copy);
-      }
+  static int ForMonitor(HMONITOR monitor) {
+    using GetDpiFn = HRESULT(WINAPI*)(HMONITOR, int, UINT*, UINT*);
+    static const GetDpiFn get_dpi =
+        Shcore() ? reinterpret_cast<GetDpiFn>(
+                       GetProcAddress(Shcore(), "GetDpiForMonitor"))
+                 : nullptr;
+    UINT dpi_x = 0;
+    UINT dpi_y = 0;
+    // MDT_EFFECTIVE_DPI
+    if (get_dpi && monitor && SUCCEEDED(get_dpi(monitor, 0, &dpi_x, &dpi_y)) &&
+        dpi_x > 0) {
+      return static_cast<int>(dpi_x);
     }
+    return System();
   }
 
-  ~LargeCursor() {
-    if (original_cursor_) {
-      DestroyCursor(original_cursor_);
-    }
-    if (large_cursor_) {
-      DestroyCursor(large_cursor_);
+  static int ForPoint(const POINT& pt) {
+    return ForMonitor(MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST));
+  }
+
+  // DPI of every monitor attached, with repeats
+  static std::vector<int> MonitorDpis() {
+    std::vector<int> dpis;
+    EnumDisplayMonitors(nullptr, nullptr, AddMonitorDpi,
+                        reinterpret_cast<LPARAM>(&dpis));
+    if (dpis.empty()) {
+      dpis.push_back(System());
     }
+    return dpis;
   }
 
  private:
-  DWORD system_cursor_id_;
-  HCURSOR original_cursor_ = nullptr;
-  HCURSOR large_cursor_ = nullptr;
+  static HMODULE Shcore() {
+    static const HMODULE shcore = LoadLibraryW(L"shcore.dll");
+    return shcore;
+  }
+
+  static BOOL CALLBACK AddMonitorDpi(HMONITOR monitor, HDC, LPRECT,
+                                     LPARAM dpis) {
+    reinterpret_cast<std::vector<int>*>(dpis)->push_back(ForMonitor(monitor));
+    return TRUE;
+  }
 };
 
-// Large cursor manager class
-class LargeCursorManager {
+// Enlarged cursors for one DPI, as animation frames of each shape
+class LargeCursorSet {
  public:
-  LargeCursorManager() {
-    // Create large cursor for each system cursor
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_ARROW, OCR_NORMAL));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_IBEAM, OCR_IBEAM));
-    large_cursors_.push_back(std::make_unique<LargeCursor>(IDC_WAIT, OCR_WAIT));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_CROSS, OCR_CROSS));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_UPARROW, OCR_UP));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZENWSE, OCR_SIZENWSE));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZENESW, OCR_SIZENESW));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZEWE, OCR_SIZEWE));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZENS, OCR_SIZENS));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZEALL, OCR_SIZEALL));
-    large_cursors_.push_back(std::make_unique<LargeCursor>(IDC_NO, OCR_NO));
-    large_cursors_.push_back(std::make_unique<LargeCursor>(IDC_HAND, OCR_HAND));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_APPSTARTING, OCR_APPSTARTING));
-  }
-
-  void EnlargeAll() {
-    for (const auto& cursor : large_cursors_) {
-      cursor->Enlarge();
-    }
-  }
-
-  void RestoreAll() {
-    for (const auto& cursor : large_cursors_) {
-      cursor->Restore();
+  explicit LargeCursorSet(const CursorSet& set) : dpi_(set.dpi) {
+    frame_count_ = set.shapes.empty() ? 0 : set.shapes[0].frame_count();
+    frames_.reserve(set.shapes.size() * static_cast<size_t>(frame_count_));
+    for (const FrameAtlas& atlas : set.shapes) {
+      for (int i = 0; i < frame_count_; ++i) {
+        HCURSOR frame =
+            CursorUtils::CreateCursorFromImage(atlas.FrameImage(i));
+        if (!frame) {
+          DestroyFrames();
+          throw std::runtime_error("Failed to create large cursor");
+        }
+        frames_.push_back(frame);
+      }
+    }
+  }
+
+  LargeCursorSet(const LargeCursorSet&) = delete;
+  LargeCursorSet& operator=(const LargeCursorSet&) = delete;
+
+  ~LargeCursorSet() { DestroyFrames(); }
+
+  int dpi() const { return dpi_; }
+
+  // Enlarged cursor for an animation frame of a shape, or nullptr
+  HCURSOR frame(int shape, int frame) const {
+    if (frame < 0 || frame >= frame_count_ || shape < 0) {
+      return nullptr;
     }
+    size_t index = static_cast<size_t>(shape * frame_count_ + frame);
+    return index < frames_.size() ? frames_[index] : nullptr;
   }
 
  private:
-  std::vector<std::unique_ptr<LargeCursor>> large_cursors_;
+  void DestroyFrames() {
+    for (HCURSOR frame : frames_) {
+      DestroyCursor(frame);
+    }
+    frames_.clear();
+  }
+
+  int dpi_;
+  int frame_count_ = 0;
+  std::vector<HCURSOR> frames_;  // By shape, then frame, smallest first
+};
+
+// Cursor sets of the monitors attached. Immutable once published, sets that
+// outlive a display change are shared with the next table
+struct LargeCursorTable {
+  std::vector<std::shared_ptr<const LargeCursorSet>> sets;
+
+  // Set for dpi, or the nearest one for a monitor not synced yet
+  const LargeCursorSet* Find(int dpi) const {
+    const LargeCursorSet* nearest = nullptr;
+    for (const auto& set : sets) {
+      if (!nearest ||
+          std::abs(set->dpi() - dpi) < std::abs(nearest->dpi() - dpi)) {
+        nearest = set.get();
+      }
+    }
+    return nearest;
+  }
 };
 
-// Cursor state management class
-class CursorState {
+// SystemCursorTable over the Win32 system cursors
+class Win32SystemCursorTable : public SystemCursorTable {
  public:
-  CursorState() {}
+  uintptr_t CopyCurrent(uint32_t id) override {
+    // OCR_* ids are also the IDC_* resource ids of the shared cursors
+    HCURSOR shared = LoadCursorW(nullptr, MAKEINTRESOURCEW(id));
+    return reinterpret_cast<uintptr_t>(shared ? CopyCursor(shared) : nullptr);
+  }
 
-  ~CursorState() {
-    DEBUG_LOG("CursorState destroyed");
-    // Use SystemParametersInfo to restore all system cursors
-    if (SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE)) {
-      is_enlarged_ = false;
+  bool Set(uint32_t id, uintptr_t cursor) override {
+    // SetSystemCursor takes ownership of the copy when it succeeds
+    HCURSOR copy = CopyCursor(reinterpret_cast<HCURSOR>(cursor));
+    if (!copy) return false;
+    if (!SetSystemCursor(copy, id)) {
+      DestroyCursor(copy);
+      return false;
     }
+    return true;
+  }
+
+  void Destroy(uintptr_t cursor) override {
+    DestroyCursor(reinterpret_cast<HCURSOR>(cursor));
   }
 
-  void Enlarge() {
-    if (!is_enlarged_) {
-      // Enlarge all system cursors
-      large_cursor_manager_.EnlargeAll();
-      is_enlarged_ = true;
-      enlarge_start_time_ = std::chrono::high_resolution_clock::now();
+  bool ReloadScheme(bool notify) override {
+    return SystemParametersInfo(SPI_SETCURSORS, 0, nullptr,
+                                notify ? SPIF_SENDCHANGE : 0) != FALSE;
+  }
+};
+
+// Large cursor manager class
+// Keeps a set of enlarged cursors per monitor DPI, so the cursor grows to
+// the same physical size on every monitor. The sets are rendered in
+// parallel and rebuilt only for DPIs that appear when the displays change
+class LargeCursorManager : public CursorSwapPlatform {
+ public:
+  LargeCursorManager()
+      : build_pool_(CursorConfig::kCursorBuildThreads),
+        cursors_(std::make_unique<LargeCursorTable>()),
+        reader_(cursors_.RegisterReader()) {
+    static const struct {
+      LPCWSTR name;
+      DWORD id;
+    } kSystemCursors[] = {
+        {IDC_ARROW, OCR_NORMAL},     {IDC_IBEAM, OCR_IBEAM},
+        {IDC_WAIT, OCR_WAIT},        {IDC_CROSS, OCR_CROSS},
+        {IDC_UPARROW, OCR_UP},       {IDC_SIZENWSE, OCR_SIZENWSE},
+        {IDC_SIZENESW, OCR_SIZENESW}, {IDC_SIZEWE, OCR_SIZEWE},
+        {IDC_SIZENS, OCR_SIZENS},    {IDC_SIZEALL, OCR_SIZEALL},
+        {IDC_NO, OCR_NO},            {IDC_HAND, OCR_HAND},
+        {IDC_APPSTARTING, OCR_APPSTARTING},
+    };
+
+    // Snapshot the saved scheme before any cursor is replaced, so exactly
+    // these are put back on exit. This also reloads the scheme cursors read
+    // below if a previous instance exited while enlarged
+    uint32_t ids[std::size(kSystemCursors)];
+    for (size_t i = 0; i < std::size(kSystemCursors); ++i) {
+      ids[i] = kSystemCursors[i].id;
+    }
+    if (!snapshot_.Capture(ids, std::size(ids))) {
+      throw std::runtime_error("Failed to load system cursor");
+    }
+
+    std::vector<CursorImage> sources;
+    for (const auto& cursor : kSystemCursors) {
+      // The shared handle stays the same when the cursor contents are
+      // replaced, so it identifies the shape on screen
+      HCURSOR shared_cursor = LoadCursorW(nullptr, cursor.name);
+      HCURSOR original_cursor = CopyCursor(shared_cursor);
+      if (!original_cursor) {
+        throw std::runtime_error("Failed to load system cursor");
+      }
+      CursorImage source;
+      bool read = CursorUtils::ReadCursorImage(original_cursor, &source);
+      DestroyCursor(original_cursor);
+      if (!read) {
+        throw std::runtime_error("Failed to read system cursor");
+      }
+      shared_cursors_.push_back(shared_cursor);
+      sources.push_back(std::move(source));
+    }
+
+    // System cursors are sized for the system DPI
+    cursor_sets_ = std::make_unique<CursorSetCache>(
+        std::move(sources),
+        CursorSetParams{CursorConfig::kScaleFactor,
+                        CursorConfig::kAnimationFrames,
+                        CursorConfig::kScaleFilter, DisplayDpi::System()},
+        &build_pool_);
+    std::filesystem::path cache_path = GetCachePath();
+    CursorCache::Reader cache;
+    if (!cache_path.empty()) {
+      cache.Open(cache_path);
     }
+    CursorSetCache::SyncResult result =
+        cursor_sets_->Sync(DisplayDpi::MonitorDpis(), &cache);
+    cache.Close();
+    PublishSets(result);
   }
 
-  void RestoreIfNeeded() {
-    if (is_enlarged_) {
-      auto now = std::chrono::high_resolution_clock::now();
-      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         now - enlarge_start_time_)
-                         .count();
+  int ShapeCount() const override {
+    return static_cast<int>(shared_cursors_.size());
+  }
 
-      if (elapsed > CursorConfig::kEnlargeDurationMs) {
-        RestoreOriginalCursor();
+  int CurrentShape() override {
+    CURSORINFO ci = {sizeof(CURSORINFO)};
+    if (!GetCursorInfo(&ci) || !(ci.flags & CURSOR_SHOWING)) {
+      return -1;
+    }
+    for (size_t i = 0; i < shared_cursors_.size(); ++i) {
+      if (shared_cursors_[i] == ci.hCursor) {
+        return static_cast<int>(i);
       }
     }
+    return -1;
+  }
+
+  ~LargeCursorManager() {
+    // Frames still scaling for a display change refer to the cursor sets
+    build_pool_.Wait();
+    size_t replaced = snapshot_.replaced_count();
+    if (!snapshot_.RestoreAll()) {
+      DEBUG_LOG("Failed to restore the system cursors");
+    } else if (replaced > 0) {
+      DEBUG_LOG("Restored " + std::to_string(replaced) + " system cursors");
+    }
+  }
+
+  // Shows the frame rendered for the DPI of the monitor under the cursor.
+  // Runs on the detection thread
+  void ShowEnlarged(int shape, int frame) override {
+    POINT pt;
+    int dpi = GetCursorPos(&pt) ? DisplayDpi::ForPoint(pt)
+                                : DisplayDpi::System();
+    cursors_.Enter(reader_);
+    const LargeCursorSet* set = cursors_.Read()->Find(dpi);
+    HCURSOR cursor = set ? set->frame(shape, frame) : nullptr;
+    if (cursor) {
+      // Replace() copies the cursor, so the set may be freed after Leave()
+      snapshot_.Replace(static_cast<size_t>(shape),
+                        reinterpret_cast<uintptr_t>(cursor));
+    }
+    cursors_.Leave(reader_);
+  }
+
+  void ShowOriginal(int shape) override {
+    snapshot_.Restore(static_cast<size_t>(shape));
+  }
+
+  // Each display change build that finishes is posted to hwnd as
+  // done_message, to be handed to OnSetsBuilt()
+  void Attach(HWND hwnd, UINT done_message) {
+    hwnd_ = hwnd;
+    done_message_ = done_message;
+  }
+
+  // Renders sets for monitor DPIs not seen before on the build pool and
+  // returns at once; until they are built, those monitors get the cursors
+  // of the nearest DPI. Runs on the UI thread whenever the displays change
+  void SyncMonitorDpis() {
+    if (pending_sync_) {
+      // Picked up when the build in flight is published
+      resync_ = true;
+      return;
+    }
+    auto cache = std::make_shared<CursorCache::Reader>();
+    std::filesystem::path cache_path = GetCachePath();
+    if (!cache_path.empty()) {
+      cache->Open(cache_path);
+    }
+    HWND hwnd = hwnd_;
+    UINT done_message = done_message_;
+    pending_sync_ = cursor_sets_->StartSync(
+        DisplayDpi::MonitorDpis(), std::move(cache),
+        [hwnd, done_message] { PostMessage(hwnd, done_message, 0, 0); });
+  }
+
+  // Publishes the sets SyncMonitorDpis() built. Runs on the UI thread
+  void OnSetsBuilt() {
+    if (!pending_sync_ || !pending_sync_->done()) return;
+    std::shared_ptr<CursorSetCache::PendingSync> pending =
+        std::move(pending_sync_);
+    PublishSets(cursor_sets_->FinishSync(pending.get()));
+    if (resync_) {
+      resync_ = false;
+      SyncMonitorDpis();
+    }
   }
 
  private:
-  void RestoreOriginalCursor() {
-    if (is_enlarged_) {
-      // Restore all system cursors
-      large_cursor_manager_.RestoreAll();
-      is_enlarged_ = false;
+  // Publishes a table holding the synced sets, keeping the ones already
+  // published, and rewrites the disk cache when anything was scaled. Only
+  // the UI thread publishes
+  void PublishSets(const CursorSetCache::SyncResult& result) {
+    cursors_.Reclaim();
+    // Only this thread publishes, so the current table stays put while it
+    // is read here
+    const LargeCursorTable* current = cursors_.Read();
+    auto table = std::make_unique<LargeCursorTable>();
+    bool changed = !result.dropped.empty();
+    for (int dpi : cursor_sets_->dpis()) {
+      std::shared_ptr<const LargeCursorSet> set;
+      for (const auto& existing : current->sets) {
+        if (existing->dpi() == dpi) set = existing;
+      }
+      if (!set) {
+        set = std::make_shared<LargeCursorSet>(*cursor_sets_->Find(dpi));
+        changed = true;
+      }
+      table->sets.push_back(std::move(set));
+    }
+    if (changed) {
+      cursors_.Publish(std::move(table));
+      DEBUG_LOG("Cursor sets: " + std::to_string(result.built.size()) +
+                " built, " + std::to_string(result.dropped.size()) +
+                " dropped, " + std::to_string(result.scaled_frames) +
+                " frames scaled");
+    }
+
+    // Rewrite the cache when anything was scaled, which also drops entries
+    // for cursors and DPIs that are no longer in use
+    std::filesystem::path cache_path = GetCachePath();
+    if (result.scaled_frames > 0 && !cache_path.empty()) {
+      CursorCache::Writer cache_writer;
+      cursor_sets_->AddTo(&cache_writer);
+      if (!cache_writer.Write(cache_path)) {
+        DEBUG_LOG("Failed to write cursor cache");
+      }
+    }
+  }
+
+  // Cache file under %LOCALAPPDATA%, or an empty path if unavailable
+  static std::filesystem::path GetCachePath() {
+    WCHAR local_app_data[MAX_PATH];
+    DWORD length =
+        GetEnvironmentVariableW(L"LOCALAPPDATA", local_app_data, MAX_PATH);
+    if (length == 0 || length >= MAX_PATH) {
+      return {};
     }
+
+    std::filesystem::path dir =
+        std::filesystem::path(local_app_data) / L"ShakeToFindCursor";
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    if (error) {
+      return {};
+    }
+    return dir / L"cursor_cache.bin";
   }
 
-  LargeCursorManager large_cursor_manager_;
-  bool is_enlarged_ = false;
-  std::chrono::high_resolution_clock::time_point enlarge_start_time_;
+  Win32SystemCursorTable system_cursors_;
+  CursorSnapshot snapshot_{&system_cursors_};
+  WorkStealingPool build_pool_;
+  std::vector<HCURSOR> shared_cursors_;
+  std::unique_ptr<CursorSetCache> cursor_sets_;
+  std::shared_ptr<CursorSetCache::PendingSync> pending_sync_;
+  bool resync_ = false;
+  HWND hwnd_ = nullptr;
+  UINT done_message_ = 0;
+  RcuPointer<LargeCursorTable> cursors_;
+  RcuPointer<LargeCursorTable>::ReaderId reader_;
 };
 
-// Mouse movement detector class with shake pattern recognition
-class MouseMoveDetector {
+// Dims the screen and rings the pointer over every application. The
+// spotlight is drawn once into a small layered window that follows the
+// pointer, and four plain dimmed windows cover the rest of the virtual
+// screen around it. A pointer move only moves the windows and the fade only
+// changes their alpha, so nothing is composited again after startup
+class SpotlightOverlay : public CursorSwapPlatform {
  public:
-  MouseMoveDetector() {
-    GetCursorPos(&last_pos_);
-    last_time_ = std::chrono::high_resolution_clock::now();
+  SpotlightOverlay() {
+    constexpr uint32_t kDim = CursorConfig::kSpotlightDimColor;
+    dim_brush_ = CreateSolidBrush(
+        RGB((kDim >> 16) & 0xFF, (kDim >> 8) & 0xFF, kDim & 0xFF));
+    WNDCLASSEXW wc = {sizeof(WNDCLASSEXW)};
+    wc.lpfnWndProc = DefWindowProcW;
+    wc.hInstance = GetModuleHandle(nullptr);
+    wc.hbrBackground = dim_brush_;
+    wc.lpszClassName = kClassName;
+    if (!dim_brush_ || !RegisterClassExW(&wc)) {
+      Release();
+      throw std::runtime_error("Failed to register overlay window class");
+    }
+
+    screen_.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    screen_.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    screen_.right = screen_.left + GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    screen_.bottom = screen_.top + GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    spotlight_window_ = CreateOverlayWindow(wc.hInstance);
+    bool created = spotlight_window_ != nullptr;
+    for (HWND& band : bands_) {
+      band = CreateOverlayWindow(wc.hInstance);
+      created = created && band != nullptr;
+    }
+    if (!created) {
+      Release();
+      throw std::runtime_error("Failed to create overlay window");
+    }
+
+    SpotlightCompositor compositor({CursorConfig::kSpotlightRadius,
+                                    CursorConfig::kSpotlightRingWidth,
+                                    CursorConfig::kSpotlightDimColor,
+                                    CursorConfig::kSpotlightRingColor});
+    PixelRect tile = compositor.Bounds(0, 0);
+    extent_ = -tile.left;
+    tile_size_ = {tile.width(), tile.height()};
+
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = tile_size_.cx;
+    bmi.bmiHeader.biHeight = -tile_size_.cy;  // Top-down rows
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits = nullptr;
+    memory_dc_ = CreateCompatibleDC(nullptr);
+    if (memory_dc_) {
+      bitmap_ = CreateDIBSection(memory_dc_, &bmi, DIB_RGB_COLORS, &bits,
+                                 nullptr, 0);
+    }
+    if (!bitmap_) {
+      Release();
+      throw std::runtime_error("Failed to create overlay bitmap");
+    }
+    previous_bitmap_ = SelectObject(memory_dc_, bitmap_);
+    FramebufferView frame = {static_cast<uint32_t*>(bits),
+                             static_cast<int>(tile_size_.cx),
+                             static_cast<int>(tile_size_.cy),
+                             static_cast<size_t>(tile_size_.cx)};
+    compositor.Draw(frame, extent_, extent_);
+
+    // The only time the spotlight pixels reach the window
+    POINT source = {0, 0};
+    POINT origin = {screen_.left, screen_.top};
+    BLENDFUNCTION blend = {AC_SRC_OVER, 0, alpha_, AC_SRC_ALPHA};
+    UPDATELAYEREDWINDOWINFO info = {sizeof(UPDATELAYEREDWINDOWINFO)};
+    info.hdcSrc = memory_dc_;
+    info.pptDst = &origin;
+    info.psize = &tile_size_;
+    info.pptSrc = &source;
+    info.pblend = &blend;
+    info.dwFlags = ULW_ALPHA;
+    if (!UpdateLayeredWindowIndirect(spotlight_window_, &info) ||
+        !FadeBands()) {
+      Release();
+      throw std::runtime_error("Failed to draw the spotlight overlay");
+    }
   }
 
-  bool ShouldEnlargeCursor(const POINT& current_pos) {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto delta_time =
-        std::chrono::duration_cast<std::chrono::milliseconds>(now - last_time_)
-            .count();
+  ~SpotlightOverlay() { Release(); }
+
+  SpotlightOverlay(const SpotlightOverlay&) = delete;
+  SpotlightOverlay& operator=(const SpotlightOverlay&) = delete;
 
-    if (delta_time <= 0) return false;
+  int ShapeCount() const override { return 1; }
 
-    // Calculate movement vector
-    int dx = current_pos.x - last_pos_.x;
-    int dy = current_pos.y - last_pos_.y;
+  // The spotlight looks the same for every cursor shape
+  int CurrentShape() override { return 0; }
 
-    // Update position history
-    movement_history_.push_back({dx, dy, delta_time});
-    if (movement_history_.size() > CursorConfig::kHistorySize) {
-      movement_history_.pop_front();
+  // Frames fade the overlay in, the last one at full opacity
+  void ShowEnlarged(int, int frame) override {
+    BYTE alpha = static_cast<BYTE>(255 * (frame + 1) /
+                                   CursorConfig::kAnimationFrames);
+    bool faded = alpha != alpha_;
+    alpha_ = alpha;
+    POINT pt;
+    if (!GetCursorPos(&pt)) pt = last_pos_;
+    Place(pt);
+    if (faded && !FadeBands()) {
+      DEBUG_LOG("Failed to fade the spotlight overlay");
+    }
+    if (!visible_) {
+      // Async so the sample worker never waits on the UI thread
+      ShowWindowAsync(spotlight_window_, SW_SHOWNOACTIVATE);
+      for (HWND band : bands_) ShowWindowAsync(band, SW_SHOWNOACTIVATE);
+      visible_ = true;
     }
+  }
 
-    last_pos_ = current_pos;
-    last_time_ = now;
+  void ShowOriginal(int) override {
+    if (visible_) {
+      ShowWindowAsync(spotlight_window_, SW_HIDE);
+      for (HWND band : bands_) ShowWindowAsync(band, SW_HIDE);
+      visible_ = false;
+    }
+  }
 
-    return DetectShakePattern();
+  // Keeps the spotlight on the pointer while the overlay is shown
+  void MoveTo(const POINT& pt) {
+    if (visible_ && (pt.x != last_pos_.x || pt.y != last_pos_.y)) {
+      Place(pt);
+    }
   }
 
  private:
-  struct Movement {
-    int dx;
-    int dy;
-    long long dt;
-  };
+  static constexpr const wchar_t* kClassName = L"ShakeToFindCursorSpotlight";
+  static constexpr int kBandCount = 4;  // Above, below, left and right
+
+  static HWND CreateOverlayWindow(HINSTANCE instance) {
+    return CreateWindowExW(WS_EX_LAYERED | WS_EX_TRANSPARENT | WS_EX_TOPMOST |
+                               WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE,
+                           kClassName, L"", WS_POPUP, 0, 0, 0, 0, nullptr,
+                           nullptr, instance, nullptr);
+  }
 
-  bool DetectShakePattern() {
-    if (movement_history_.size() < CursorConfig::kHistorySize) return false;
+  // Moves the spotlight window onto pt at the current alpha and the bands
+  // around it. Bands that keep their place are left alone
+  void Place(const POINT& pt) {
+    last_pos_ = pt;
+    POINT corner = {pt.x - extent_, pt.y - extent_};
+    BLENDFUNCTION blend = {AC_SRC_OVER, 0, alpha_, AC_SRC_ALPHA};
+    UPDATELAYEREDWINDOWINFO info = {sizeof(UPDATELAYEREDWINDOWINFO)};
+    info.pptDst = &corner;
+    info.pblend = &blend;
+    info.dwFlags = ULW_ALPHA;
+    if (!UpdateLayeredWindowIndirect(spotlight_window_, &info)) {
+      DEBUG_LOG("Failed to move the spotlight overlay");
+    }
 
-    int direction_changes = 0;
-    double total_speed = 0.0;
-    long long total_time = 0;
+    LONG left = std::clamp(corner.x, screen_.left, screen_.right);
+    LONG top = std::clamp(corner.y, screen_.top, screen_.bottom);
+    LONG right =
+        std::clamp(corner.x + tile_size_.cx, screen_.left, screen_.right);
+    LONG bottom =
+        std::clamp(corner.y + tile_size_.cy, screen_.top, screen_.bottom);
+    const RECT rects[kBandCount] = {
+        {screen_.left, screen_.top, screen_.right, top},
+        {screen_.left, bottom, screen_.right, screen_.bottom},
+        {screen_.left, top, left, bottom},
+        {right, top, screen_.right, bottom}};
+    for (int i = 0; i < kBandCount; ++i) {
+      const RECT& rect = rects[i];
+      if (EqualRect(&rect, &band_rects_[i])) continue;
+      band_rects_[i] = rect;
+      // Posted to the UI thread, like showing the windows
+      SetWindowPos(bands_[i], nullptr, rect.left, rect.top,
+                   rect.right - rect.left, rect.bottom - rect.top,
+                   SWP_ASYNCWINDOWPOS | SWP_NOACTIVATE | SWP_NOZORDER |
+                       SWP_NOOWNERZORDER);
+    }
+  }
 
-    // Previous movement direction (-1: negative, 1: positive, 0: neutral)
-    int last_x_dir = 0;
-    int last_y_dir = 0;
+  // Matches the bands to the dimmed pixels of the spotlight window
+  bool FadeBands() {
+    BYTE alpha = static_cast<BYTE>(
+        (CursorConfig::kSpotlightDimColor >> 24) * alpha_ / 255);
+    bool ok = true;
+    for (HWND band : bands_) {
+      ok = SetLayeredWindowAttributes(band, 0, alpha, LWA_ALPHA) && ok;
+    }
+    return ok;
+  }
 
-    for (const auto& mov : movement_history_) {
-      // Calculate current direction
-      int curr_x_dir = (mov.dx > 0) ? 1 : (mov.dx < 0) ? -1 : 0;
-      int curr_y_dir = (mov.dy > 0) ? 1 : (mov.dy < 0) ? -1 : 0;
+  void Release() {
+    if (memory_dc_) {
+      if (previous_bitmap_) SelectObject(memory_dc_, previous_bitmap_);
+      DeleteDC(memory_dc_);
+      memory_dc_ = nullptr;
+    }
+    if (bitmap_) {
+      DeleteObject(bitmap_);
+      bitmap_ = nullptr;
+    }
+    if (spotlight_window_) {
+      DestroyWindow(spotlight_window_);
+      spotlight_window_ = nullptr;
+    }
+    for (HWND& band : bands_) {
+      if (band) DestroyWindow(band);
+      band = nullptr;
+    }
+    UnregisterClassW(kClassName, GetModuleHandle(nullptr));
+    if (dim_brush_) {
+      DeleteObject(dim_brush_);
+      dim_brush_ = nullptr;
+    }
+  }
 
-      // Count direction changes
-      if (last_x_dir != 0 && curr_x_dir != 0 && last_x_dir != curr_x_dir) {
-        direction_changes++;
-      }
-      if (last_y_dir != 0 && curr_y_dir != 0 && last_y_dir != curr_y_dir) {
-        direction_changes++;
-      }
+  HWND spotlight_window_ = nullptr;
+  HWND bands_[kBandCount] = {};
+  RECT band_rects_[kBandCount] = {};
+  HBRUSH dim_brush_ = nullptr;
+  HDC memory_dc_ = nullptr;
+  HBITMAP bitmap_ = nullptr;
+  HGDIOBJ previous_bitmap_ = nullptr;
+  RECT screen_ = {};  // Virtual screen
+  LONG extent_ = 0;   // Pointer to the spotlight window's edge
+  SIZE tile_size_ = {};
+  POINT last_pos_ = {};
+  BYTE alpha_ = 255;
+  bool visible_ = false;
+};
 
-      // Update last direction
-      last_x_dir = curr_x_dir;
-      last_y_dir = curr_y_dir;
+// Animation and polling as set in CursorConfig
+inline ShakeAppParams DefaultAppParams(bool polling) {
+  ShakeAppParams params;
+  params.config = DefaultRuntimeConfig();
+  params.gestures = DefaultGestureOptions();
+  params.animation = {params.config.timing, CursorConfig::kAnimationFrames,
+                      CursorConfig::kAnimationDurationMs * 1000LL,
+                      CursorConfig::kEnlargeCurrentCursorOnly
+                          ? CursorSwapScheduler::Mode::kCurrentOnly
+                          : CursorSwapScheduler::Mode::kAll};
+  params.polling = polling;
+  params.poll = {CursorConfig::kPollingInterval * 1000LL,
+                 CursorConfig::kIdlePollingInterval * 1000LL,
+                 CursorConfig::kIdlePollingAfterMs * 1000LL};
+  return params;
+}
 
-      // Calculate speed
-      double distance = std::sqrt(mov.dx * mov.dx + mov.dy * mov.dy);
-      double speed = (mov.dt > 0) ? (distance / mov.dt) * 1000.0 : 0;
-      total_speed += speed;
-      total_time += mov.dt;
+// The desktop as ShakeApp sees it: the enlarged system cursors or the
+// spotlight in their place, the pointer, the monitors and the tray icon
+class Win32AppPlatform : public AppPlatform {
+ public:
+  // Only the cursor platform in use is created, the large cursors take a
+  // while to render
+  explicit Win32AppPlatform(const MonotonicClock* clock) : clock_(clock) {
+    if constexpr (CursorConfig::kSpotlight) {
+      spotlight_ = std::make_unique<SpotlightOverlay>();
+    } else {
+      large_cursor_manager_ = std::make_unique<LargeCursorManager>();
     }
+  }
 
-    // Check if we're within the time window
-    if (total_time > CursorConfig::kMaxTimeWindow) return false;
+  // Window the tray icon and the cursor set builds report to
+  void set_window(HWND hwnd) {
+    hwnd_ = hwnd;
+    if (large_cursor_manager_) {
+      large_cursor_manager_->Attach(hwnd,
+                                    CursorConfig::kCursorSetsBuiltMessage);
+    }
+  }
+
+  const MonotonicClock* clock() const override { return clock_; }
+
+  CursorSwapPlatform* cursors() override {
+    if (spotlight_) return spotlight_.get();
+    return large_cursor_manager_.get();
+  }
+
+  bool PointerPosition(int32_t* x, int32_t* y) override {
+    POINT pt;
+    if (!GetCursorPos(&pt)) return false;
+    *x = static_cast<int32_t>(pt.x);
+    *y = static_cast<int32_t>(pt.y);
+    return true;
+  }
+
+  void MovePointer(int32_t x, int32_t y) override { SetCursorPos(x, y); }
 
-    // Calculate average speed
-    double avg_speed = total_speed / movement_history_.size();
+  void PointerMoved(int32_t x, int32_t y) override {
+    if (spotlight_) spotlight_->MoveTo(POINT{x, y});
+  }
 
-    // Return true if we have enough direction changes and sufficient speed
-    return direction_changes >= CursorConfig::kMinDirectionChanges &&
-           avg_speed >= CursorConfig::kMinMovementSpeed;
+  bool MonitorBounds(int32_t x, int32_t y, ScreenRect* bounds) override {
+    MONITORINFO info = {sizeof(MONITORINFO)};
+    HMONITOR monitor = MonitorFromPoint(POINT{x, y}, MONITOR_DEFAULTTONEAREST);
+    if (!GetMonitorInfoW(monitor, &info)) {
+      return false;
+    }
+    const RECT& rc = info.rcMonitor;
+    *bounds = {static_cast<int32_t>(rc.left), static_cast<int32_t>(rc.top),
+               static_cast<int32_t>(rc.right),
+               static_cast<int32_t>(rc.bottom)};
+    return true;
   }
 
-  POINT last_pos_;
-  std::chrono::high_resolution_clock::time_point last_time_;
-  std::deque<Movement> movement_history_;
+  bool AddTrayIcon() override {
+    NOTIFYICONDATAW nid = {sizeof(NOTIFYICONDATAW)};
+    nid.hWnd = hwnd_;
+    nid.uID = CursorConfig::kTrayIconId;
+    nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
+    nid.uCallbackMessage = CursorConfig::kTrayIconMessage;
+    nid.hIcon =
+        LoadIcon(GetModuleHandle(nullptr), MAKEINTRESOURCE(IDI_APP_ICON));
+    wcscpy_s(nid.szTip, L"Shake to Find Cursor");
+    tray_icon_added_ = Shell_NotifyIconW(NIM_ADD, &nid) != FALSE;
+    return tray_icon_added_;
+  }
+
+  void RemoveTrayIcon() override {
+    if (tray_icon_added_ && hwnd_) {
+      NOTIFYICONDATAW nid = {sizeof(NOTIFYICONDATAW)};
+      nid.hWnd = hwnd_;
+      nid.uID = CursorConfig::kTrayIconId;
+      Shell_NotifyIconW(NIM_DELETE, &nid);
+      tray_icon_added_ = false;
+    }
+  }
+
+  // Called on the UI thread when monitors are added, removed or rescaled
+  void OnDisplayChange() {
+    if (large_cursor_manager_) large_cursor_manager_->SyncMonitorDpis();
+  }
+
+  // Called on the UI thread once the cursor sets for a display change are
+  // built
+  void OnCursorSetsBuilt() {
+    if (large_cursor_manager_) large_cursor_manager_->OnSetsBuilt();
+  }
+
+ private:
+  const MonotonicClock* clock_;
+  std::unique_ptr<LargeCursorManager> large_cursor_manager_;
+  std::unique_ptr<SpotlightOverlay> spotlight_;
+  HWND hwnd_ = nullptr;
+  bool tray_icon_added_ = false;
 };
 
-class ShakeToFindCursor {
+class ShakeToFindCursor : private SampleSink, private DetectionListener {
  public:
   static ShakeToFindCursor& GetInstance() {
     static ShakeToFindCursor instance;
     return instance;
   }
 
-  bool Initialize(CursorConfig::MouseTrackingMode mode) {
-    if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {
-      throw std::runtime_error("Failed to initialize COM");
-    }
+  // Samples are also recorded to record_path as a mouse trace if it is set.
+  // Thresholds are read from config_path and reloaded when it changes
+  bool Initialize(CursorConfig::MouseTrackingMode mode,
+                  const std::filesystem::path& record_path = {},
+                  const std::filesystem::path& config_path =
+                      CursorConfig::kConfigFileName) {
     tracking_mode_ = mode;
 
     // Register window class
@@ -661,61 +1381,101 @@ class ShakeToFindCursor {
 
     // Set window instance pointer
     SetWindowLongPtr(hwnd_, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+    platform_.set_window(hwnd_);
+    auto_start_.Attach(hwnd_, CursorConfig::kAutoStartDoneMessage);
+    startup_.Mark(StartupProfile::kWindowCreated);
+
+    // Hook mode runs at the device rate, which is not known here
+    if (!record_path.empty()) {
+      MouseTraceInfo info = {};
+      if (tracking_mode_ == CursorConfig::MouseTrackingMode::kPolling) {
+        info.sample_rate_hz = 1000 / CursorConfig::kPollingInterval;
+      }
+      info.dpi = static_cast<uint32_t>(DisplayDpi::System());
+      if (!trace_writer_.Open(record_path, info)) {
+        DestroyWindow(hwnd_);
+        throw std::runtime_error("Failed to open trace file");
+      }
+    }
 
-    // Create timer with different interval based on mode
-    UINT timer_interval =
-        (tracking_mode_ == CursorConfig::MouseTrackingMode::kPolling)
-            ? 10  // Poll more frequently when using timer
-            : CursorConfig::kTimerInterval;
+    // Restores and animation frames run on a deadline timer that is only
+    // armed while the cursor is enlarged or animating. Polling mode also
+    // samples the cursor on a timer; the app's timers run on the window
+    // timer there, and on the sample worker thread in hook mode
+    app_ = std::make_unique<ShakeApp>(
+        &platform_, &latency_,
+        DefaultAppParams(tracking_mode_ ==
+                         CursorConfig::MouseTrackingMode::kPolling));
+    app_->set_listener(this);
+
+    // A bad config file is logged and the defaults are used until it is
+    // fixed; the detector picks up each new snapshot on its next batch
+    config_path_ = config_path;
+    ReloadConfig();
+    ApplyConfig();
+    if (!SetTimer(hwnd_, CursorConfig::kConfigTimerId,
+                  CursorConfig::kConfigCheckIntervalMs, nullptr)) {
+      DEBUG_LOG("Failed to create the config check timer");
+    }
+    startup_.Mark(StartupProfile::kConfigLoaded);
 
-    if (!SetTimer(hwnd_, CursorConfig::kTimerId, timer_interval, nullptr)) {
-      DestroyWindow(hwnd_);
-      throw std::runtime_error("Failed to create timer");
+    // The app works without the diagnostic ring, it only feeds shake_monitor
+    if (!diagnostics_.Create(DiagnosticRing::kDefaultName,
+                             CursorConfig::kDiagnosticRingCapacity,
+                             app_->detector().params())) {
+      DEBUG_LOG("Failed to create the diagnostic ring");
+    }
+
+    if (tracking_mode_ == CursorConfig::MouseTrackingMode::kPolling) {
+      if (!SetTimer(hwnd_, CursorConfig::kTimerId,
+                    CursorConfig::kPollingInterval, nullptr)) {
+        DestroyWindow(hwnd_);
+        throw std::runtime_error("Failed to create timer");
+      }
     }
 
     // Only install hook if using hook mode
     if (tracking_mode_ == CursorConfig::MouseTrackingMode::kHook) {
+      sample_worker_.Start(this);
       mouse_hook_ =
           SetWindowsHookEx(WH_MOUSE_LL, MouseProc, GetModuleHandle(nullptr), 0);
 
       if (!mouse_hook_) {
-        KillTimer(hwnd_, CursorConfig::kTimerId);
+        sample_worker_.Stop();
         DestroyWindow(hwnd_);
         throw std::runtime_error("Failed to install mouse hook");
       }
     }
+    startup_.Mark(StartupProfile::kInputStarted);
 
     // Set Ctrl+C handler
     SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
 
-    // Create tray icon
-    NOTIFYICONDATAW nid = {sizeof(NOTIFYICONDATAW)};
-    nid.hWnd = hwnd_;
-    nid.uID = CursorConfig::kTrayIconId;
-    nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
-    nid.uCallbackMessage = CursorConfig::kTrayIconMessage;
-    nid.hIcon =
-        LoadIcon(GetModuleHandle(nullptr), MAKEINTRESOURCE(IDI_APP_ICON));
-    wcscpy_s(nid.szTip, L"Shake to Find Cursor");
-
-    if (!Shell_NotifyIconW(NIM_ADD, &nid)) {
+    if (!platform_.AddTrayIcon()) {
       KillTimer(hwnd_, CursorConfig::kTimerId);
+      KillTimer(hwnd_, CursorConfig::kConfigTimerId);
       DestroyWindow(hwnd_);
       throw std::runtime_error("Failed to create tray icon");
     }
-
-    tray_icon_added_ = true;
-
+    startup_.Mark(StartupProfile::kTrayIconAdded);
     return true;
   }
 
   void Run() {
     MSG msg;
     running_ = true;
+    // Hook callbacks and polling timers only run inside the loop below
+    startup_.Mark(StartupProfile::kDetectionReady);
+    DEBUG_LOG("Startup phases:\n" + startup_.Report());
 
     while (running_) {
-      // Use PeekMessage instead of GetMessage to handle timers even when there
-      // are no messages
+      // Block until a message, a timer or a shutdown request arrives. Timers
+      // and hook callbacks are delivered through the message queue
+      if (event_loop_.Wait(EventLoop::kNoDeadline) ==
+          EventLoop::WakeReason::kShutdown) {
+        break;
+      }
+
       while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
         if (msg.message == WM_QUIT) {
           running_ = false;
@@ -724,51 +1484,223 @@ class ShakeToFindCursor {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
       }
-
-      // Yield CPU time slice
-      Sleep(1);
     }
   }
 
   void Stop() {
     running_ = false;
+    event_loop_.Shutdown();
     if (hwnd_) {
       PostMessage(hwnd_, WM_QUIT, 0, 0);
     }
   }
 
   ~ShakeToFindCursor() {
-    RemoveTrayIcon();
+    platform_.RemoveTrayIcon();
     if (mouse_hook_) {
       UnhookWindowsHookEx(mouse_hook_);
     }
+    sample_worker_.Stop();
+    trace_writer_.Close();
+    if (app_) {
+      DEBUG_LOG("Detection stopped after " +
+                std::to_string(app_->enlarge_count()) +
+                " enlargements and " + std::to_string(app_->swap_count()) +
+                " cursor swaps");
+    }
     if (hwnd_) {
       KillTimer(hwnd_, CursorConfig::kTimerId);
+      KillTimer(hwnd_, CursorConfig::kConfigTimerId);
       DestroyWindow(hwnd_);
     }
     SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
-    CoUninitialize();
   }
 
-  void ProcessMouseMove(const MSLLHOOKSTRUCT* mouse_info) {
-    if (move_detector_.ShouldEnlargeCursor(mouse_info->pt)) {
-      cursor_state_.Enlarge();
-    }
+  void EnableLatencyTracing() { latency_.set_enabled(true); }
+
+  // Latency of each stage, followed by the startup phases
+  std::string LatencyReport() const {
+    return latency_.Report() + "\n" + startup_.Report();
+  }
+
+  bool SaveLatencyReport() const {
+    std::ofstream out(CursorConfig::kLatencyReportFileName);
+    out << LatencyReport();
+    return static_cast<bool>(out);
   }
 
  private:
-  ShakeToFindCursor() = default;
+  // WM_DPICHANGED, which needs a newer _WIN32_WINNT
+  static constexpr UINT kWmDpiChanged = 0x02E0;
+
+  ShakeToFindCursor() {
+#ifdef _DEBUG
+    // Statics are destroyed in reverse order of construction, so the logger
+    // built here outlives this and the destructors can still log
+    Logger::GetInstance();
+#endif
+    startup_.Mark(StartupProfile::kCursorsReady);
+  }
   ShakeToFindCursor(const ShakeToFindCursor&) = delete;
   ShakeToFindCursor& operator=(const ShakeToFindCursor&) = delete;
 
+  // DetectionListener, called on the thread that runs detection
+  void OnDetection(const MouseSample& sample,
+                   const MouseMoveDetector::Gestures& gestures,
+                   EnlargeStateMachine::Action action) override {
+    if (trace_writer_.is_open()) trace_writer_.Append(sample);
+    if (diagnostics_.is_open()) {
+      AppendDiagnostics(sample, gestures.shaking, action);
+    }
+    startup_.Mark(StartupProfile::kFirstSample);
+  }
+
+  void AppendDiagnostics(const MouseSample& sample, bool shaking,
+                         EnlargeStateMachine::Action action) {
+    ShakeFeatures features = app_->detector().features();
+    DiagnosticRecord record = {};
+    record.timestamp_us = sample.timestamp_us;
+    record.x = sample.x;
+    record.y = sample.y;
+    record.average_speed = features.average_speed;
+    record.total_time_us = features.total_time_us;
+    record.direction_changes = features.direction_changes;
+    record.movement_count = static_cast<uint16_t>(features.movement_count);
+    int flags = shaking ? DiagnosticRecord::kShaking : 0;
+    if (action == EnlargeStateMachine::Action::kEnlarge) {
+      flags |= DiagnosticRecord::kEnlarged;
+    } else if (action == EnlargeStateMachine::Action::kRestore) {
+      flags |= DiagnosticRecord::kRestored;
+    }
+    record.flags = static_cast<uint8_t>(flags);
+    diagnostics_.Append(record);
+  }
+
+  // The hook only queues the sample. Detection and the cursor swaps run on
+  // the sample worker so the global mouse pipeline is never stalled
   static LRESULT CALLBACK MouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
     if (nCode == HC_ACTION && wParam == WM_MOUSEMOVE) {
-      auto& instance = GetInstance();
-      instance.ProcessMouseMove(reinterpret_cast<MSLLHOOKSTRUCT*>(lParam));
+      // MSLLHOOKSTRUCT::time only has millisecond resolution, so stamp the
+      // event with the performance counter on receipt
+      int64_t receipt_ns = MonotonicNanos();
+      const auto* mouse_info = reinterpret_cast<MSLLHOOKSTRUCT*>(lParam);
+      MouseSample sample = {static_cast<int32_t>(mouse_info->pt.x),
+                            static_cast<int32_t>(mouse_info->pt.y),
+                            receipt_ns / 1000};
+      ShakeToFindCursor& instance = GetInstance();
+      instance.sample_worker_.Post(sample);
+      if (instance.latency_.enabled()) {
+        instance.latency_.Record(LatencyRecorder::kHookCallback,
+                                 MonotonicNanos() - receipt_ns);
+      }
     }
     return CallNextHookEx(nullptr, nCode, wParam, lParam);
   }
 
+  // SampleSink, called on the sample worker thread in hook mode
+  void OnSamples(const MouseSample* samples, size_t count) override {
+    ApplyConfig();
+    app_->OnSamples(samples, count);
+  }
+
+  // Sleeps until the next deadline, or until the next sample while the
+  // cursor is at rest
+  Clock::time_point OnWake(Clock::time_point now) override {
+    app_->RunTimers(std::chrono::duration_cast<std::chrono::microseconds>(
+                        now.time_since_epoch())
+                        .count());
+    int64_t deadline_us = app_->NextDeadline();
+    if (deadline_us == DeadlineScheduler::kNoDeadline) {
+      return Clock::time_point::max();
+    }
+    return Clock::time_point{std::chrono::microseconds(deadline_us)};
+  }
+
+  // Polling mode window timer
+  void OnWindowTimer() {
+    ApplyConfig();
+    int64_t now_us = MonotonicMicros();
+    app_->RunTimers(now_us);
+    ArmWindowTimer(now_us);
+  }
+
+  // Points the periodic window timer at the earliest deadline, resetting it
+  // only when the interval changes
+  void ArmWindowTimer(int64_t now_us) {
+    int64_t deadline_us = app_->NextDeadline();
+    if (deadline_us == DeadlineScheduler::kNoDeadline) {
+      KillTimer(hwnd_, CursorConfig::kTimerId);
+      window_timer_ms_ = 0;
+      return;
+    }
+    int64_t delay_ms = (deadline_us - now_us + 999) / 1000;
+    UINT interval_ms = delay_ms > USER_TIMER_MINIMUM
+                           ? static_cast<UINT>(delay_ms)
+                           : static_cast<UINT>(USER_TIMER_MINIMUM);
+    if (interval_ms != window_timer_ms_ &&
+        SetTimer(hwnd_, CursorConfig::kTimerId, interval_ms, nullptr)) {
+      window_timer_ms_ = interval_ms;
+    }
+  }
+
+  // Switches the detector and the cursor to the latest config snapshot.
+  // Called on the thread that runs detection, once per batch of samples
+  void ApplyConfig() {
+    config_.Enter(config_reader_);
+    const RuntimeConfig* config = config_.Read();
+    if (config->version != applied_config_version_) {
+      app_->Configure(*config);
+      applied_config_version_ = config->version;
+    }
+    config_.Leave(config_reader_);
+  }
+
+  // Publishes a new snapshot when the config file's write time changes, the
+  // defaults once it is deleted, and frees the snapshots the detector has
+  // moved past. Runs on the UI thread
+  void ReloadConfig() {
+    config_.Reclaim();
+    std::error_code error;
+    std::filesystem::file_time_type write_time =
+        std::filesystem::last_write_time(config_path_, error);
+    if (error) write_time = {};
+    if (write_time == config_write_time_) return;
+    config_write_time_ = write_time;
+
+    auto config = std::make_unique<RuntimeConfig>(DefaultRuntimeConfig());
+    if (error) {
+      DEBUG_LOG("Config file removed, using the defaults");
+    } else {
+      std::string message;
+      if (!LoadRuntimeConfig(config_path_, config.get(), &message)) {
+        DEBUG_LOG("Config not reloaded: " + message);
+        return;
+      }
+      DEBUG_LOG("Config reloaded from " + config_path_.string());
+    }
+    config->version = ++config_version_;
+    config_.Publish(std::move(config));
+  }
+
+  // Starts rendering cursors for the DPIs of new monitors, which
+  // OnCursorSetsBuilt() publishes. Until then, or after a failure, those
+  // monitors get the cursors of the nearest DPI
+  void OnDisplayChange() {
+    try {
+      platform_.OnDisplayChange();
+    } catch (const std::exception& e) {
+      DEBUG_LOG(std::string("Failed to update cursor sets: ") + e.what());
+    }
+  }
+
+  void OnCursorSetsBuilt() {
+    try {
+      platform_.OnCursorSetsBuilt();
+    } catch (const std::exception& e) {
+      DEBUG_LOG(std::string("Failed to publish cursor sets: ") + e.what());
+    }
+  }
+
   static LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wParam,
                                      LPARAM lParam) {
     auto* instance = reinterpret_cast<ShakeToFindCursor*>(
@@ -777,39 +1709,45 @@ class ShakeToFindCursor {
     switch (msg) {
       case WM_TIMER:
         if (wParam == CursorConfig::kTimerId && instance) {
-          if (instance->tracking_mode_ ==
-              CursorConfig::MouseTrackingMode::kPolling) {
-            POINT pt;
-            GetCursorPos(&pt);
-            instance->ProcessMouseMove(reinterpret_cast<MSLLHOOKSTRUCT*>(&pt));
-          }
-          instance->cursor_state_.RestoreIfNeeded();
+          instance->OnWindowTimer();
+        } else if (wParam == CursorConfig::kConfigTimerId && instance) {
+          instance->ReloadConfig();
         }
         return 0;
 
+      case WM_DISPLAYCHANGE:
+      case kWmDpiChanged:
+        if (instance) instance->OnDisplayChange();
+        break;
+
+      case CursorConfig::kCursorSetsBuiltMessage:
+        if (instance) instance->OnCursorSetsBuilt();
+        return 0;
+
       case WM_DESTROY:
         PostQuitMessage(0);
         return 0;
 
       case CursorConfig::kTrayIconMessage:
-        if (LOWORD(lParam) == WM_RBUTTONUP) {
+        // Hovering the icon checks the auto-start state ahead of the menu
+        if (LOWORD(lParam) == WM_MOUSEMOVE) {
+          instance->auto_start_.Refresh();
+        } else if (LOWORD(lParam) == WM_RBUTTONUP) {
           instance->ShowContextMenu(hwnd);
         }
         return 0;
 
-      case WM_COMMAND:
-        if (LOWORD(wParam) == CursorConfig::kMenuExitId) {
-          instance->Stop();
-        } else if (LOWORD(wParam) == CursorConfig::kMenuAutoStartId) {
-          if (AutoStartManager::EnableAutoStart()) {
+      case CursorConfig::kAutoStartDoneMessage:
+        if (wParam == AutoStartService::kEnable) {
+          if (lParam) {
             MessageBoxW(hwnd, L"Auto-start enabled successfully.", L"Success",
                         MB_OK | MB_ICONINFORMATION);
           } else {
             MessageBoxW(hwnd, L"Failed to enable auto-start.", L"Error",
                         MB_OK | MB_ICONERROR);
           }
-        } else if (LOWORD(wParam) == CursorConfig::kMenuDisableAutoStartId) {
-          if (AutoStartManager::DisableAutoStart()) {
+        } else if (wParam == AutoStartService::kDisable) {
+          if (lParam) {
             MessageBoxW(hwnd, L"Auto-start disabled successfully.", L"Success",
                         MB_OK | MB_ICONINFORMATION);
           } else {
@@ -818,6 +1756,26 @@ class ShakeToFindCursor {
           }
         }
         return 0;
+
+      case WM_COMMAND:
+        if (LOWORD(wParam) == CursorConfig::kMenuExitId) {
+          instance->Stop();
+        } else if (LOWORD(wParam) == CursorConfig::kMenuAutoStartId) {
+          instance->auto_start_.Post(AutoStartService::kEnable);
+        } else if (LOWORD(wParam) == CursorConfig::kMenuDisableAutoStartId) {
+          instance->auto_start_.Post(AutoStartService::kDisable);
+        } else if (LOWORD(wParam) == CursorConfig::kMenuLatencyTracingId) {
+          instance->latency_.set_enabled(!instance->latency_.enabled());
+        } else if (LOWORD(wParam) == CursorConfig::kMenuSaveLatencyReportId) {
+          if (instance->SaveLatencyReport()) {
+            MessageBoxW(hwnd, L"Latency report saved.", L"Success",
+                        MB_OK | MB_ICONINFORMATION);
+          } else {
+            MessageBoxW(hwnd, L"Failed to save the latency report.", L"Error",
+                        MB_OK | MB_ICONERROR);
+          }
+        }
+        return 0;
     }
 
     return DefWindowProc(hwnd, msg, wParam, lParam);
@@ -831,16 +1789,6 @@ class ShakeToFindCursor {
     return FALSE;
   }
 
-  void RemoveTrayIcon() {
-    if (tray_icon_added_ && hwnd_) {
-      NOTIFYICONDATA nid = {sizeof(NOTIFYICONDATA)};
-      nid.hWnd = hwnd_;
-      nid.uID = CursorConfig::kTrayIconId;
-      Shell_NotifyIcon(NIM_DELETE, &nid);
-      tray_icon_added_ = false;
-    }
-  }
-
   void ShowContextMenu(HWND hwnd) {
     POINT pt;
     GetCursorPos(&pt);
@@ -848,15 +1796,29 @@ class ShakeToFindCursor {
     HMENU menu = CreatePopupMenu();
     if (!menu) return;
 
-    bool is_auto_start = AutoStartManager::IsAutoStartEnabled();
-    if (is_auto_start) {
-      AppendMenuW(menu, MF_STRING, CursorConfig::kMenuDisableAutoStartId,
-                  L"Disable Auto-start");
-    } else {
-      AppendMenuW(menu, MF_STRING, CursorConfig::kMenuAutoStartId,
-                  L"Enable Auto-start");
+    // Labelled from the cached state; the next menu picks up the refresh
+    auto_start_.Refresh();
+    switch (auto_start_.state()) {
+      case AutoStartService::State::kEnabled:
+        AppendMenuW(menu, MF_STRING, CursorConfig::kMenuDisableAutoStartId,
+                    L"Disable Auto-start");
+        break;
+      case AutoStartService::State::kDisabled:
+        AppendMenuW(menu, MF_STRING, CursorConfig::kMenuAutoStartId,
+                    L"Enable Auto-start");
+        break;
+      default:
+        AppendMenuW(menu, MF_STRING | MF_GRAYED, 0, L"Checking Auto-start...");
+        break;
     }
     AppendMenuW(menu, MF_SEPARATOR, 0, nullptr);
+    UINT latency_flags =
+        MF_STRING | (latency_.enabled() ? MF_CHECKED : MF_UNCHECKED);
+    AppendMenuW(menu, latency_flags, CursorConfig::kMenuLatencyTracingId,
+                L"Trace Latency");
+    AppendMenuW(menu, MF_STRING, CursorConfig::kMenuSaveLatencyReportId,
+                L"Save Latency Report");
+    AppendMenuW(menu, MF_SEPARATOR, 0, nullptr);
     AppendMenuW(menu, MF_STRING, CursorConfig::kMenuExitId, L"Exit");
 
     SetForegroundWindow(hwnd);
@@ -866,10 +1828,26 @@ class ShakeToFindCursor {
 
   HHOOK mouse_hook_ = nullptr;
   HWND hwnd_ = nullptr;
-  CursorState cursor_state_;
-  MouseMoveDetector move_detector_;
+  Win32EventLoop event_loop_;
+  SteadyMonotonicClock clock_;
+  StartupProfile startup_{&clock_};  // Before platform_, timed from here
+  LatencyRecorder latency_;
+  Win32AppPlatform platform_{&clock_};
+  std::unique_ptr<ShakeApp> app_;  // Created once the tracking mode is known
+  RcuPointer<RuntimeConfig> config_{
+      std::make_unique<RuntimeConfig>(DefaultRuntimeConfig())};
+  RcuPointer<RuntimeConfig>::ReaderId config_reader_ =
+      config_.RegisterReader();
+  uint64_t applied_config_version_ = 0;  // Detection thread only
+  uint64_t config_version_ = 0;
+  std::filesystem::path config_path_;
+  std::filesystem::file_time_type config_write_time_ = {};
+  SampleWorker sample_worker_;
+  MouseTraceWriter trace_writer_;
+  DiagnosticRingWriter diagnostics_;
+  UINT window_timer_ms_ = CursorConfig::kPollingInterval;
   std::atomic<bool> running_{false};
-  bool tray_icon_added_ = false;
+  AutoStartService auto_start_;
   CursorConfig::MouseTrackingMode tracking_mode_;
 };
 
@@ -897,19 +1875,29 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  ComInitializer com_initializer;
-
-  SetProcessDPIAware();
+  DisplayDpi::EnableAwareness();
 
   CursorConfig::MouseTrackingMode mode =
       CursorConfig::MouseTrackingMode::kPolling;
-  if (argc > 1 && std::string(argv[1]) == "--hook") {
-    mode = CursorConfig::MouseTrackingMode::kHook;
+  std::filesystem::path record_path;
+  std::filesystem::path config_path = CursorConfig::kConfigFileName;
+  bool trace_latency = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--hook") {
+      mode = CursorConfig::MouseTrackingMode::kHook;
+    } else if (arg == "--record" && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (arg == "--config" && i + 1 < argc) {
+      config_path = argv[++i];
+    } else if (arg == "--latency") {
+      trace_latency = true;
+    }
   }
 
   try {
     auto& cursor_finder = ShakeToFindCursor::GetInstance();
-    if (!cursor_finder.Initialize(mode)) {
+    if (!cursor_finder.Initialize(mode, record_path, config_path)) {
       return 1;
     }
 
@@ -918,10 +1906,12 @@ int main(int argc, char* argv[]) {
               << std::endl;
     std::cout << "Press Ctrl + C to exit." << std::endl;
 
+    if (trace_latency) cursor_finder.EnableLatencyTracing();
     cursor_finder.Run();
+    if (trace_latency) std::cout << cursor_finder.LatencyReport();
   } catch (const std::exception& e) {
+    // Replaced cursors are put back when the instance is destroyed
     std::cerr << "Error: " << e.what() << std::endl;
-    SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE);
     return 1;
   }
   return 0;
@@ -941,19 +1931,33 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     return 1;
   }
 
-  ComInitializer com_initializer;
-
-  SetProcessDPIAware();
+  DisplayDpi::EnableAwareness();
 
   CursorConfig::MouseTrackingMode mode =
       CursorConfig::MouseTrackingMode::kPolling;
-  if (wcsstr(lpCmdLine, L"--hook")) {
-    mode = CursorConfig::MouseTrackingMode::kHook;
+  std::filesystem::path record_path;
+  std::filesystem::path config_path = CursorConfig::kConfigFileName;
+  bool trace_latency = false;
+  int argc = 0;
+  LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+  if (argv) {
+    for (int i = 1; i < argc; ++i) {
+      if (wcscmp(argv[i], L"--hook") == 0) {
+        mode = CursorConfig::MouseTrackingMode::kHook;
+      } else if (wcscmp(argv[i], L"--record") == 0 && i + 1 < argc) {
+        record_path = argv[++i];
+      } else if (wcscmp(argv[i], L"--config") == 0 && i + 1 < argc) {
+        config_path = argv[++i];
+      } else if (wcscmp(argv[i], L"--latency") == 0) {
+        trace_latency = true;
+      }
+    }
+    LocalFree(argv);
   }
 
   try {
     auto& cursor_finder = ShakeToFindCursor::GetInstance();
-    if (!cursor_finder.Initialize(mode)) {
+    if (!cursor_finder.Initialize(mode, record_path, config_path)) {
       return 1;
     }
 
@@ -961,13 +1965,13 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
         "Shake to Find Cursor started. Move the mouse quickly to trigger "
         "zoom.");
 
+    if (trace_latency) cursor_finder.EnableLatencyTracing();
     cursor_finder.Run();
   } catch (const std::exception& e) {
     std::wstringstream ws;
     ws << L"Error: " << e.what();
     MessageBoxW(nullptr, ws.str().c_str(), L"Error", MB_OK | MB_ICONERROR);
     DEBUG_LOG("Error: " + std::string(e.what()));
-    SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE);
     return 1;
   }
   return 0;
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Microseconds on the monotonic clock. On Windows steady_clock is backed by
+// QueryPerformanceCounter, so this has sub-microsecond resolution
+inline int64_t MonotonicMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline int64_t MonotonicNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Source of monotonic time in microseconds. Timing logic reads time through
+// this so it can be driven by a simulated clock
+class MonotonicClock {
+ public:
+  virtual ~MonotonicClock() = default;
+  virtual int64_t NowMicros() const = 0;
+};
+
+class SteadyMonotonicClock : public MonotonicClock {
+ public:
+  int64_t NowMicros() const override { return MonotonicMicros(); }
+};
+
+// Clock that only moves when told to, for replaying recorded traces
+class ManualClock : public MonotonicClock {
+ public:
+  int64_t NowMicros() const override { return now_us_; }
+
+  void Set(int64_t now_us) { now_us_ = now_us; }
+  void Advance(int64_t delta_us) { now_us_ += delta_us; }
+
+ private:
+  int64_t now_us_ = 0;
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "mapped_file.h"
+#include "sample_worker.h"
+
+// Compact recording of timestamped pointer positions. The file is
+// little-endian and laid out as
+//
+//   Header | record*
+//
+// Each record holds the time, x and y deltas from the previous sample (the
+// first one from (0, 0, start_time_us)) as zigzag LEB128 varints, so a
+// typical sample takes 3 to 4 bytes. sample_count is written when the
+// recording is closed; readers decode to the end of the data regardless, so
+// a recording cut short by a crash is still usable
+struct MouseTraceInfo {
+  uint32_t sample_rate_hz;  // Device or polling rate, 0 if unknown
+  uint32_t dpi;             // Screen DPI at recording time, 0 if unknown
+};
+
+class MouseTrace {
+ public:
+  static constexpr uint32_t kMagic = 0x54465453;  // "STFT"
+  static constexpr uint32_t kVersion = 1;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sample_rate_hz;
+    uint32_t dpi;
+    uint64_t sample_count;
+    int64_t start_time_us;
+  };
+
+  static_assert(sizeof(Header) == 32, "Unexpected trace header layout");
+
+  // Longest encoding of one record: three 64-bit varints
+  static constexpr size_t kMaxRecordSize = 30;
+
+  static uint64_t ZigZag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^
+           static_cast<uint64_t>(value >> 63);
+  }
+
+  static int64_t UnZigZag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+
+  static uint8_t* PutVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+      *out++ = static_cast<uint8_t>(value | 0x80);
+      value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+  }
+
+  // Returns false on a truncated or overlong varint
+  static bool GetVarint(const uint8_t*& in, const uint8_t* end,
+                        uint64_t* value) {
+    // Deltas between consecutive samples nearly always fit one byte
+    if (in < end && *in < 0x80) {
+      *value = *in++;
+      return true;
+    }
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && in < end; shift += 7) {
+      uint8_t byte = *in++;
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Appends samples to a trace file through an in-memory buffer
+class MouseTraceWriter {
+ public:
+  MouseTraceWriter() = default;
+  MouseTraceWriter(const MouseTraceWriter&) = delete;
+  MouseTraceWriter& operator=(const MouseTraceWriter&) = delete;
+
+  ~MouseTraceWriter() { Close(); }
+
+  bool Open(const std::filesystem::path& path, const MouseTraceInfo& info) {
+    Close();
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_) return false;
+
+    header_ = {};
+    header_.magic = MouseTrace::kMagic;
+    header_.version = MouseTrace::kVersion;
+    header_.sample_rate_hz = info.sample_rate_hz;
+    header_.dpi = info.dpi;
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+
+    buffer_.resize(kBufferSize);
+    used_ = 0;
+    last_ = {0, 0, 0};
+    return static_cast<bool>(out_);
+  }
+
+  void Append(const MouseSample& sample) {
+    if (!out_.is_open()) return;
+    if (header_.sample_count == 0) {
+      header_.start_time_us = sample.timestamp_us;
+      last_.timestamp_us = sample.timestamp_us;
+    }
+    if (kBufferSize - used_ < MouseTrace::kMaxRecordSize) Flush();
+
+    uint8_t* out = buffer_.data() + used_;
+    out = MouseTrace::PutVarint(
+        out, MouseTrace::ZigZag(sample.timestamp_us - last_.timestamp_us));
+    out = MouseTrace::PutVarint(
+        out, MouseTrace::ZigZag(static_cast<int64_t>(sample.x) - last_.x));
+    out = MouseTrace::PutVarint(
+        out, MouseTrace::ZigZag(static_cast<int64_t>(sample.y) - last_.y));
+    used_ = static_cast<size_t>(out - buffer_.data());
+    last_ = sample;
+    ++header_.sample_count;
+  }
+
+  // Flushes the buffer and writes the final sample count into the header
+  bool Close() {
+    if (!out_.is_open()) return false;
+    Flush();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    bool ok = static_cast<bool>(out_);
+    out_.close();
+    return ok;
+  }
+
+  bool is_open() const { return out_.is_open(); }
+  uint64_t sample_count() const { return header_.sample_count; }
+
+ private:
+  static constexpr size_t kBufferSize = 64 * 1024;
+
+  void Flush() {
+    out_.write(reinterpret_cast<const char*>(buffer_.data()),
+               static_cast<std::streamsize>(used_));
+    used_ = 0;
+  }
+
+  std::ofstream out_;
+  MouseTrace::Header header_ = {};
+  std::vector<uint8_t> buffer_;
+  size_t used_ = 0;
+  MouseSample last_ = {0, 0, 0};
+};
+
+// Sequential decoder over the records of a trace held in memory. Copies are
+// independent, so several threads can decode the same mapped trace
+class MouseTraceDecoder {
+ public:
+  MouseTraceDecoder() = default;
+  MouseTraceDecoder(const uint8_t* begin, const uint8_t* end,
+                    int64_t start_time_us)
+      : next_(begin), end_(end), last_{0, 0, start_time_us} {}
+
+  // Decodes up to max_count samples and returns how many were decoded. Stops
+  // at the end of the data or at a malformed record
+  size_t Read(MouseSample* samples, size_t max_count) {
+    const uint8_t* in = next_;
+    MouseSample last = last_;
+    size_t count = 0;
+    while (count < max_count && in < end_) {
+      const uint8_t* record = in;
+      uint64_t dt, dx, dy;
+      if (!MouseTrace::GetVarint(in, end_, &dt) ||
+          !MouseTrace::GetVarint(in, end_, &dx) ||
+          !MouseTrace::GetVarint(in, end_, &dy)) {
+        in = record;
+        end_ = record;
+        break;
+      }
+      last.timestamp_us += MouseTrace::UnZigZag(dt);
+      last.x = static_cast<int32_t>(last.x + MouseTrace::UnZigZag(dx));
+      last.y = static_cast<int32_t>(last.y + MouseTrace::UnZigZag(dy));
+      samples[count++] = last;
+    }
+    next_ = in;
+    last_ = last;
+    return count;
+  }
+
+ private:
+  const uint8_t* next_ = nullptr;
+  const uint8_t* end_ = nullptr;
+  MouseSample last_ = {0, 0, 0};
+};
+
+// Memory-maps a trace file and decodes it sequentially
+class MouseTraceReader {
+ public:
+  bool Open(const std::filesystem::path& path) {
+    if (!file_.Open(path)) return false;
+    if (file_.size() < sizeof(MouseTrace::Header) ||
+        FileHeader()->magic != MouseTrace::kMagic ||
+        FileHeader()->version != MouseTrace::kVersion) {
+      file_.Close();
+      return false;
+    }
+    Rewind();
+    return true;
+  }
+
+  void Close() { file_.Close(); }
+
+  MouseTraceInfo info() const {
+    return {FileHeader()->sample_rate_hz, FileHeader()->dpi};
+  }
+
+  // Timestamp of the first sample
+  int64_t start_time_us() const { return FileHeader()->start_time_us; }
+
+  // Count recorded in the header, 0 if the recording was not closed
+  uint64_t recorded_sample_count() const {
+    return FileHeader()->sample_count;
+  }
+
+  // A decoder positioned at the first sample
+  MouseTraceDecoder Decoder() const {
+    return MouseTraceDecoder(file_.data() + sizeof(MouseTrace::Header),
+                             file_.data() + file_.size(),
+                             FileHeader()->start_time_us);
+  }
+
+  void Rewind() { decoder_ = Decoder(); }
+
+  size_t Read(MouseSample* samples, size_t max_count) {
+    return decoder_.Read(samples, max_count);
+  }
+
+  bool is_open() const { return file_.is_open(); }
+
+ private:
+  const MouseTrace::Header* FileHeader() const {
+    return reinterpret_cast<const MouseTrace::Header*>(file_.data());
+  }
+
+  MappedFile file_;
+  MouseTraceDecoder decoder_;
+};
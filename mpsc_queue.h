@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4324)  // Structure padded due to alignas
+#endif
+
+// Bounded lock-free multi-producer/single-consumer queue. Every cell carries
+// a sequence number telling whose turn it is: producers claim a position with
+// one compare-exchange on the tail, fill the cell in place and publish it by
+// bumping its sequence, so producers never wait on each other or on the
+// consumer. The consumer takes cells strictly in claim order
+template <typename T, size_t Capacity>
+class MpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+ public:
+  static constexpr size_t kCapacity = Capacity;
+
+  MpscQueue() {
+    for (size_t i = 0; i < Capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Producer side, any thread. Claims a cell and calls fill(T&) on it.
+  // Returns false without calling fill if the queue is full
+  template <typename Fill>
+  bool TryPush(Fill fill) {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[position & kMask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(cell->value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Calls visit(const T&) on up to max_count items in claim
+  // order and returns the count. Stops early at a cell that is claimed but
+  // not yet filled
+  template <typename Visit>
+  size_t PopBatch(Visit visit, size_t max_count) {
+    size_t count = 0;
+    while (count < max_count) {
+      Cell& cell = cells_[head_ & kMask];
+      if (cell.sequence.load(std::memory_order_acquire) != head_ + 1) break;
+      visit(static_cast<const T&>(cell.value));
+      cell.sequence.store(head_ + Capacity, std::memory_order_release);
+      ++head_;
+      ++count;
+    }
+    return count;
+  }
+
+  // Consumer side. True if the next item is not yet published
+  bool Empty() const {
+    return cells_[head_ & kMask].sequence.load(std::memory_order_acquire) !=
+           head_ + 1;
+  }
+
+  // Positions claimed so far, including items not yet published
+  uint64_t claimed_count() const {
+    return tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr size_t kMask = Capacity - 1;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  // Consumer-owned line
+  alignas(64) size_t head_ = 0;
+
+  // Producer-shared line
+  alignas(64) std::atomic<size_t> tail_{0};
+
+  alignas(64) Cell cells_[Capacity];
+};
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "shake_detector.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MULTI_STREAM_DETECTOR_SSE2 1
+#endif
+
+// One pointer sample tagged with the stream it belongs to
+struct StreamSample {
+  uint32_t stream;
+  int32_t x;
+  int32_t y;
+  int64_t timestamp_us;
+};
+
+// Shake detection for many independent pointer streams sharing one set of
+// thresholds, e.g. one stream per session on a terminal server. Decisions
+// are identical to one ShakeDetector per stream.
+//
+// State is kept structure-of-arrays: per-stream scalars in parallel arrays
+// and each stream's window as a contiguous slice of per-field ring arrays,
+// about 170 bytes per stream with a 10-entry window against about 460 for a
+// ShakeDetector. Process() works in three passes over a batch: computing
+// movements (sequential, cheap), computing speeds two at a time with SSE2
+// and updating the windows. SSE2 square root and division are correctly
+// rounded, so the speeds match the scalar ones bit for bit.
+//
+// Windows hold at most 65535 movements
+class MultiStreamDetector {
+ public:
+  static constexpr size_t kBatchSize = 256;
+
+  MultiStreamDetector(const ShakeParams& params, size_t stream_count)
+      : params_(params),
+        capacity_(params.history_size > 0 ? params.history_size : 1),
+        stream_count_(stream_count) {
+    ring_dt_.resize(stream_count * capacity_);
+    ring_speed_.resize(stream_count * capacity_);
+    ring_meta_.resize(stream_count * capacity_);
+    head_.resize(stream_count);
+    count_.resize(stream_count);
+    updates_since_resum_.resize(stream_count);
+    direction_changes_.resize(stream_count);
+    total_speed_.resize(stream_count);
+    total_time_.resize(stream_count);
+    last_x_.resize(stream_count);
+    last_y_.resize(stream_count);
+    last_time_us_.resize(stream_count);
+    flags_.resize(stream_count);
+  }
+
+  // Adds samples in order and writes one decision per sample, as
+  // ShakeDetector::AddSample would for the sample's stream
+  void Process(const StreamSample* samples, size_t count, bool* decisions) {
+    for (size_t begin = 0; begin < count; begin += kBatchSize) {
+      size_t size = count - begin < kBatchSize ? count - begin : kBatchSize;
+      ProcessBatch(samples + begin, size, decisions + begin);
+    }
+  }
+
+  bool AddSample(uint32_t stream, int x, int y, int64_t timestamp_us) {
+    StreamSample sample = {stream, x, y, timestamp_us};
+    bool decision;
+    ProcessBatch(&sample, 1, &decision);
+    return decision;
+  }
+
+  void ResetStream(uint32_t stream) {
+    head_[stream] = 0;
+    count_[stream] = 0;
+    updates_since_resum_[stream] = 0;
+    direction_changes_[stream] = 0;
+    total_speed_[stream] = 0.0;
+    total_time_[stream] = 0;
+    flags_[stream] = 0;
+  }
+
+  size_t stream_count() const { return stream_count_; }
+
+  // Detector state held for each stream
+  size_t bytes_per_stream() const {
+    size_t ring_entry = sizeof(int32_t) + sizeof(double) + sizeof(uint8_t);
+    size_t scalars = 3 * sizeof(uint16_t) + sizeof(int32_t) + sizeof(double) +
+                     sizeof(int64_t) + 2 * sizeof(int32_t) + sizeof(int64_t) +
+                     sizeof(uint8_t);
+    return capacity_ * ring_entry + scalars;
+  }
+
+ private:
+  enum : uint8_t { kHasLastSample = 1, kLastDecision = 2 };
+  enum : uint8_t { kSeed, kCoalesced, kMovement };
+
+  // Window durations are far below this, so clamping a longer gap to it
+  // leaves every decision unchanged
+  static constexpr int64_t kMaxDt = std::numeric_limits<int32_t>::max();
+
+  // Ring entry metadata packed in one byte: x and y direction + 1 in two bits
+  // each, then the direction changes against the previous entry
+  static uint8_t Direction(int value) {
+    return static_cast<uint8_t>((value > 0) ? 2 : (value < 0) ? 0 : 1);
+  }
+  static uint8_t XDir(uint8_t meta) { return meta & 3; }
+  static uint8_t YDir(uint8_t meta) { return (meta >> 2) & 3; }
+  static int Changes(uint8_t meta) { return meta >> 4; }
+
+  static size_t Wrap(size_t index, size_t capacity) {
+    return (index >= capacity) ? index - capacity : index;
+  }
+
+  // Stores through the uint8_t arrays may alias anything, so the hot loops
+  // work on raw pointers held in locals rather than reloading each vector's
+  // data pointer after every store
+  void ProcessBatch(const StreamSample* samples, size_t count,
+                    bool* decisions) {
+    uint8_t kind[kBatchSize];
+    int move_dx[kBatchSize];
+    int move_dy[kBatchSize];
+    int move_distance_sq[kBatchSize];
+    int64_t move_dt[kBatchSize];
+    double move_dt_double[kBatchSize];
+    double move_speed[kBatchSize];
+
+    uint8_t* flags = flags_.data();
+    int32_t* last_x = last_x_.data();
+    int32_t* last_y = last_y_.data();
+    int64_t* last_time_us = last_time_us_.data();
+    const int64_t min_interval_us = params_.min_sample_interval_us;
+
+    // Pass 1: coalescing and deltas, in sample order since a stream may
+    // appear several times in one batch
+    size_t movement_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const StreamSample& sample = samples[i];
+      uint32_t s = sample.stream;
+      if (!(flags[s] & kHasLastSample)) {
+        last_x[s] = sample.x;
+        last_y[s] = sample.y;
+        last_time_us[s] = sample.timestamp_us;
+        flags[s] |= kHasLastSample;
+        kind[i] = kSeed;
+        continue;
+      }
+      int64_t dt = sample.timestamp_us - last_time_us[s];
+      if (dt < min_interval_us || dt <= 0) {
+        kind[i] = kCoalesced;
+        continue;
+      }
+      kind[i] = kMovement;
+      int dx = sample.x - last_x[s];
+      int dy = sample.y - last_y[s];
+      move_dx[movement_count] = dx;
+      move_dy[movement_count] = dy;
+      move_distance_sq[movement_count] = dx * dx + dy * dy;
+      move_dt[movement_count] = dt;
+      move_dt_double[movement_count] = static_cast<double>(dt);
+      ++movement_count;
+      last_x[s] = sample.x;
+      last_y[s] = sample.y;
+      last_time_us[s] = sample.timestamp_us;
+    }
+
+    // Pass 2: speeds, the same arithmetic as ShakeDetector
+    size_t j = 0;
+#if defined(MULTI_STREAM_DETECTOR_SSE2)
+    const __m128d scale = _mm_set1_pd(1000000.0);
+    for (; j + 2 <= movement_count; j += 2) {
+      __m128i distance_sq = _mm_loadl_epi64(
+          reinterpret_cast<const __m128i*>(move_distance_sq + j));
+      __m128d distance = _mm_sqrt_pd(_mm_cvtepi32_pd(distance_sq));
+      __m128d speed =
+          _mm_div_pd(distance, _mm_loadu_pd(move_dt_double + j));
+      _mm_storeu_pd(move_speed + j, _mm_mul_pd(speed, scale));
+    }
+#endif
+    for (; j < movement_count; ++j) {
+      double distance = std::sqrt(static_cast<double>(move_distance_sq[j]));
+      move_speed[j] = (distance / move_dt_double[j]) * 1000000.0;
+    }
+
+    // Pass 3: window updates and decisions
+    j = 0;
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t s = samples[i].stream;
+      if (kind[i] == kSeed) {
+        decisions[i] = false;
+      } else if (kind[i] == kCoalesced) {
+        decisions[i] = (flags[s] & kLastDecision) != 0;
+      } else {
+        bool decision =
+            AddMovement(s, move_dx[j], move_dy[j], move_dt[j], move_speed[j]);
+        ++j;
+        flags[s] = static_cast<uint8_t>(
+            decision ? flags[s] | kLastDecision : flags[s] & ~kLastDecision);
+        decisions[i] = decision;
+      }
+    }
+  }
+
+  bool AddMovement(uint32_t s, int dx, int dy, int64_t dt, double speed) {
+    const size_t capacity = capacity_;
+    const size_t base = s * capacity;
+    int32_t* ring_dt = ring_dt_.data() + base;
+    double* ring_speed = ring_speed_.data() + base;
+    uint8_t* ring_meta = ring_meta_.data() + base;
+    size_t head = head_[s];
+    size_t count = count_[s];
+    int32_t direction_changes = direction_changes_[s];
+    double total_speed = total_speed_[s];
+    int64_t total_time = total_time_[s];
+
+    if (count == capacity) {
+      total_speed -= ring_speed[head];
+      total_time -= ring_dt[head];
+      head = (head + 1 == capacity) ? 0 : head + 1;
+      --count;
+      if (count > 0) {
+        direction_changes -= Changes(ring_meta[head]);
+        ring_meta[head] &= 0x0f;
+      }
+    }
+
+    uint8_t x_dir = Direction(dx);
+    uint8_t y_dir = Direction(dy);
+    int changes = 0;
+    if (count > 0) {
+      uint8_t prev = ring_meta[Wrap(head + count - 1, capacity)];
+      if (XDir(prev) != 1 && x_dir != 1 && XDir(prev) != x_dir) ++changes;
+      if (YDir(prev) != 1 && y_dir != 1 && YDir(prev) != y_dir) ++changes;
+    }
+
+    int32_t clamped_dt = static_cast<int32_t>(dt < kMaxDt ? dt : kMaxDt);
+    size_t slot = Wrap(head + count, capacity);
+    ring_dt[slot] = clamped_dt;
+    ring_speed[slot] = speed;
+    ring_meta[slot] = static_cast<uint8_t>(x_dir | (y_dir << 2) |
+                                           (changes << 4));
+    ++count;
+    direction_changes += changes;
+    total_speed += speed;
+    total_time += clamped_dt;
+
+    if (++updates_since_resum_[s] >= capacity) {
+      total_speed = ExactTotalSpeed(ring_speed, head, count, capacity);
+      updates_since_resum_[s] = 0;
+    }
+
+    head_[s] = static_cast<uint16_t>(head);
+    count_[s] = static_cast<uint16_t>(count);
+    direction_changes_[s] = direction_changes;
+    total_speed_[s] = total_speed;
+    total_time_[s] = total_time;
+
+    if (count < params_.history_size) return false;
+    if (total_time > params_.max_time_window_us) return false;
+    if (direction_changes < params_.min_direction_changes) return false;
+
+    // Same exact-sum fallback near the threshold as ShakeDetector
+    double size = static_cast<double>(count);
+    double avg_speed = total_speed / size;
+    double margin = 1e-9 * std::abs(params_.min_movement_speed) + 1e-12;
+    if (std::abs(avg_speed - params_.min_movement_speed) <= margin) {
+      avg_speed = ExactTotalSpeed(ring_speed, head, count, capacity) / size;
+    }
+    return avg_speed >= params_.min_movement_speed;
+  }
+
+  // Sums a window's speeds oldest to newest
+  static double ExactTotalSpeed(const double* ring_speed, size_t head,
+                                size_t count, size_t capacity) {
+    double total = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+      total += ring_speed[Wrap(head + i, capacity)];
+    }
+    return total;
+  }
+
+  ShakeParams params_;
+  size_t capacity_;
+  size_t stream_count_;
+
+  // Windows, capacity_ entries per stream
+  std::vector<int32_t> ring_dt_;
+  std::vector<double> ring_speed_;
+  std::vector<uint8_t> ring_meta_;
+
+  // Per-stream scalars
+  std::vector<uint16_t> head_;
+  std::vector<uint16_t> count_;
+  std::vector<uint16_t> updates_since_resum_;
+  std::vector<int32_t> direction_changes_;
+  std::vector<double> total_speed_;
+  std::vector<int64_t> total_time_;
+  std::vector<int32_t> last_x_;
+  std::vector<int32_t> last_y_;
+  std::vector<int64_t> last_time_us_;
+  std::vector<uint8_t> flags_;
+};
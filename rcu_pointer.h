@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Read-copy-update pointer to an immutable value. Readers never lock or
+// copy: they load the current pointer inside a read section, and writers
+// publish a whole new value with one atomic swap. A replaced value is freed
+// once every reader has left the read section it might have been loaded in
+// (epoch-based reclamation), so a reader only pays for entering and leaving
+// a section, which it does once per batch of work rather than per item.
+//
+// Each reader slot is used by one thread at a time. Writers may run on any
+// thread and are serialized internally
+template <typename T, size_t MaxReaders = 8>
+class RcuPointer {
+ public:
+  using ReaderId = size_t;
+
+  explicit RcuPointer(std::unique_ptr<T> initial)
+      : current_(initial.release()) {
+    for (std::atomic<uint64_t>& epoch : reader_epochs_) {
+      epoch.store(kOffline);
+    }
+  }
+
+  RcuPointer(const RcuPointer&) = delete;
+  RcuPointer& operator=(const RcuPointer&) = delete;
+
+  // Readers must have left their sections
+  ~RcuPointer() {
+    delete current_.load();
+    for (const Retired& retired : retired_) delete retired.value;
+  }
+
+  // Returns a reader slot, or MaxReaders when all are taken
+  ReaderId RegisterReader() {
+    size_t id = reader_count_.fetch_add(1);
+    return id < MaxReaders ? id : MaxReaders;
+  }
+
+  // Values loaded with Read() stay valid until the matching Leave()
+  void Enter(ReaderId reader) { reader_epochs_[reader].store(epoch_.load()); }
+  void Leave(ReaderId reader) { reader_epochs_[reader].store(kOffline); }
+
+  const T* Read() const { return current_.load(); }
+
+  // Replaces the value and frees the replaced ones no reader can still see
+  void Publish(std::unique_ptr<T> value) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    T* previous = current_.exchange(value.release());
+    retired_.push_back({previous, epoch_.fetch_add(1) + 1});
+    ReclaimLocked();
+  }
+
+  // Frees what it can of the replaced values, returning how many are left.
+  // Publish() already does this; call it to free values a reader was still
+  // in a section for
+  size_t Reclaim() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    ReclaimLocked();
+    return retired_.size();
+  }
+
+ private:
+  static constexpr uint64_t kOffline = std::numeric_limits<uint64_t>::max();
+
+  struct Retired {
+    T* value;
+    uint64_t epoch;  // Readers that entered at this epoch or later saw its
+                     // replacement
+  };
+
+  void ReclaimLocked() {
+    uint64_t oldest = kOffline;
+    for (const std::atomic<uint64_t>& reader_epoch : reader_epochs_) {
+      uint64_t epoch = reader_epoch.load();
+      if (epoch < oldest) oldest = epoch;
+    }
+    size_t kept = 0;
+    for (const Retired& retired : retired_) {
+      if (retired.epoch <= oldest) {
+        delete retired.value;
+      } else {
+        retired_[kept++] = retired;
+      }
+    }
+    retired_.resize(kept);
+  }
+
+  // Sequentially consistent throughout: a reclaim that sees a reader
+  // offline orders before the reader's next Enter(), so the reader's Read()
+  // after that returns the new value
+  std::atomic<T*> current_;
+  std::atomic<uint64_t> epoch_{0};
+  std::atomic<uint64_t> reader_epochs_[MaxReaders];
+  std::atomic<size_t> reader_count_{0};
+  std::mutex writer_mutex_;
+  std::vector<Retired> retired_;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "enlarge_state_machine.h"
+#include "shake_detector.h"
+
+// Thresholds that can change while the app runs. A snapshot is immutable
+// once published; version tells snapshots apart without comparing pointers
+struct RuntimeConfig {
+  ShakeParams shake;
+  EnlargeTiming timing;
+  uint64_t version = 0;
+};
+
+// Shorter sample intervals are raised to this. The gesture windows hold one
+// movement per interval, so a tiny interval would grow them to megabytes
+constexpr int64_t kMinSampleIntervalUs = 100;
+
+// Thresholds used until a config file overrides them, by the app and the
+// tools alike
+inline RuntimeConfig DefaultRuntimeConfig() {
+  RuntimeConfig config;
+  config.shake.history_size = 10;             // Movements in the window
+  config.shake.min_direction_changes = 5;
+  config.shake.min_movement_speed = 800.0;    // Pixels/second
+  config.shake.max_time_window_us = 500 * 1000;
+  config.shake.min_sample_interval_us = 1000;  // Closer samples coalesce
+  config.timing.enlarge_duration_us = 500 * 1000;  // After the last shake
+  config.timing.max_enlarge_duration_us = 5000 * 1000;  // While shaking
+  config.timing.cooldown_us = 300 * 1000;  // Shakes ignored after a restore
+  return config;
+}
+
+// Reads "key = value" lines over base, so keys left out keep base's value.
+// Blank lines and lines starting with '#' are skipped. Times are in
+// milliseconds except min_sample_interval_us, which must not be 0 and is
+// raised to kMinSampleIntervalUs. On error *config is left as it was and
+// *error names the line
+inline bool ParseRuntimeConfig(const std::string& text, RuntimeConfig* config,
+                               std::string* error) {
+  RuntimeConfig parsed = *config;
+  std::istringstream in(text);
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    ++line_number;
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#') continue;
+    size_t equals = line.find('=');
+    if (equals == std::string::npos) {
+      *error = "line " + std::to_string(line_number) + ": expected key = value";
+      return false;
+    }
+    size_t key_end = line.find_last_not_of(" \t", equals - 1);
+    std::string key = key_end == std::string::npos || key_end < begin
+                          ? std::string()
+                          : line.substr(begin, key_end - begin + 1);
+    std::string value = line.substr(equals + 1);
+
+    errno = 0;
+    char* end = nullptr;
+    double number = std::strtod(value.c_str(), &end);
+    // Bounded so the conversions to microseconds cannot overflow
+    bool valid = end != value.c_str() && errno == 0 && number >= 0 &&
+                 number <= 1e9;
+    while (valid && *end != '\0') {
+      valid = *end == ' ' || *end == '\t' || *end == '\r';
+      ++end;
+    }
+    if (!valid) {
+      *error = "line " + std::to_string(line_number) + ": bad value for " + key;
+      return false;
+    }
+
+    int64_t whole = static_cast<int64_t>(number);
+    if (key == "history_size") {
+      parsed.shake.history_size = static_cast<size_t>(whole);
+    } else if (key == "min_direction_changes") {
+      parsed.shake.min_direction_changes = static_cast<int>(whole);
+    } else if (key == "min_movement_speed") {
+      parsed.shake.min_movement_speed = number;
+    } else if (key == "max_time_window_ms") {
+      parsed.shake.max_time_window_us = whole * 1000;
+    } else if (key == "min_sample_interval_us") {
+      parsed.shake.min_sample_interval_us = whole;
+    } else if (key == "enlarge_duration_ms") {
+      parsed.timing.enlarge_duration_us = whole * 1000;
+    } else if (key == "max_enlarge_duration_ms") {
+      parsed.timing.max_enlarge_duration_us = whole * 1000;
+    } else if (key == "restore_cooldown_ms") {
+      parsed.timing.cooldown_us = whole * 1000;
+    } else {
+      *error = "line " + std::to_string(line_number) + ": unknown key " + key;
+      return false;
+    }
+  }
+
+  // The detector window is preallocated, so bound it
+  if (parsed.shake.history_size < 1 || parsed.shake.history_size > 1024) {
+    *error = "history_size must be between 1 and 1024";
+    return false;
+  }
+  if (parsed.shake.min_sample_interval_us < 1) {
+    *error = "min_sample_interval_us must not be 0";
+    return false;
+  }
+  if (parsed.shake.min_sample_interval_us < kMinSampleIntervalUs) {
+    parsed.shake.min_sample_interval_us = kMinSampleIntervalUs;
+  }
+  *config = parsed;
+  return true;
+}
+
+// A missing file is not an error: the config stays as it was
+inline bool LoadRuntimeConfig(const std::filesystem::path& path,
+                              RuntimeConfig* config, std::string* error) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return true;
+  std::ostringstream text;
+  text << in.rdbuf();
+  if (in.bad()) {
+    *error = "failed to read " + path.string();
+    return false;
+  }
+  return ParseRuntimeConfig(text.str(), config, error);
+}
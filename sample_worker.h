@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "spsc_ring.h"
+
+// Pointer position stamped when the input event was received
+struct MouseSample {
+  int32_t x;
+  int32_t y;
+  int64_t timestamp_us;
+};
+
+// Receives drained samples on the worker thread
+class SampleSink {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  virtual ~SampleSink() = default;
+
+  virtual void OnSamples(const MouseSample* samples, size_t count) = 0;
+
+  // Called after every wakeup, with or without samples. Returns the latest
+  // time at which the worker must wake up again, or Clock::time_point::max()
+  // to sleep until the next sample
+  virtual Clock::time_point OnWake(Clock::time_point now) = 0;
+};
+
+// Moves sample processing off the producer thread. Post() only writes to a
+// wait-free ring and returns; a worker thread drains the ring in batches and
+// hands them to the sink. The producer only takes the wakeup lock when the
+// worker is asleep, i.e. on the first sample after an idle period
+class SampleWorker {
+ public:
+  static constexpr size_t kRingCapacity = 4096;
+  static constexpr size_t kBatchSize = 64;
+
+  SampleWorker() = default;
+  SampleWorker(const SampleWorker&) = delete;
+  SampleWorker& operator=(const SampleWorker&) = delete;
+
+  ~SampleWorker() { Stop(); }
+
+  void Start(SampleSink* sink) {
+    if (thread_.joinable()) return;
+    sink_ = sink;
+    stop_.store(false);
+    thread_ = std::thread(&SampleWorker::ThreadMain, this);
+  }
+
+  void Stop() {
+    if (!thread_.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_.store(true);
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+  }
+
+  // Producer side. Drops the sample and returns false if the ring is full
+  bool Post(const MouseSample& sample) {
+    if (!ring_.TryPush(sample)) {
+      dropped_count_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    // Pairs with the fence in WaitForWork() so either the worker sees the new
+    // sample or this thread sees that the worker is asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      sleeping_.store(false, std::memory_order_relaxed);
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      wake_cv_.notify_one();
+    }
+    return true;
+  }
+
+  uint64_t dropped_count() const {
+    return dropped_count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void ThreadMain() {
+    MouseSample batch[kBatchSize];
+    SampleSink::Clock::time_point deadline = SampleSink::Clock::now();
+
+    while (!stop_.load()) {
+      size_t count;
+      while ((count = ring_.PopBatch(batch, kBatchSize)) > 0) {
+        sink_->OnSamples(batch, count);
+      }
+      deadline = sink_->OnWake(SampleSink::Clock::now());
+      WaitForWork(deadline);
+    }
+  }
+
+  void WaitForWork(SampleSink::Clock::time_point deadline) {
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ring_.Empty()) {
+      sleeping_.store(false, std::memory_order_relaxed);
+      return;
+    }
+
+    auto woken = [this] {
+      return !sleeping_.load(std::memory_order_relaxed) || stop_.load();
+    };
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (deadline == SampleSink::Clock::time_point::max()) {
+      wake_cv_.wait(lock, woken);
+    } else {
+      wake_cv_.wait_until(lock, deadline, woken);
+    }
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+
+  SpscRing<MouseSample, kRingCapacity> ring_;
+  std::atomic<bool> sleeping_{false};
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> dropped_count_{0};
+  std::mutex mutex_;
+  std::condition_variable wake_cv_;
+  SampleSink* sink_ = nullptr;
+  std::thread thread_;
+};
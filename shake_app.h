@@ -0,0 +1,347 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "adaptive_poll_rate.h"
+#include "cursor_animation.h"
+#include "cursor_animator.h"
+#include "cursor_swap_scheduler.h"
+#include "deadline_scheduler.h"
+#include "enlarge_state_machine.h"
+#include "gesture_engine.h"
+#include "latency_recorder.h"
+#include "monotonic_clock.h"
+#include "runtime_config.h"
+#include "sample_worker.h"
+#include "shake_detector.h"
+
+// Virtual screen rectangle, right and bottom exclusive
+struct ScreenRect {
+  int32_t left;
+  int32_t top;
+  int32_t right;
+  int32_t bottom;
+};
+
+// What the app needs from the desktop: the clock, the pointer, the system
+// cursors and the tray icon. Win32AppPlatform in main.cpp drives the real
+// desktop; HeadlessPlatform runs the app from synthetic or recorded input.
+// Timers are not part of it: the host wakes the app at
+// ShakeApp::NextDeadline() however it waits
+class AppPlatform {
+ public:
+  virtual ~AppPlatform() = default;
+
+  virtual const MonotonicClock* clock() const = 0;
+
+  // System cursors to enlarge and restore
+  virtual CursorSwapPlatform* cursors() = 0;
+
+  // Pointer position, read by polling mode
+  virtual bool PointerPosition(int32_t* x, int32_t* y) = 0;
+
+  // Moves the pointer, for the corner flick
+  virtual void MovePointer(int32_t x, int32_t y) = 0;
+
+  // Latest pointer position, once per batch of samples, for platforms that
+  // draw around the pointer
+  virtual void PointerMoved(int32_t x, int32_t y) = 0;
+
+  // Bounds of the monitor nearest to (x, y)
+  virtual bool MonitorBounds(int32_t x, int32_t y, ScreenRect* bounds) = 0;
+
+  virtual bool AddTrayIcon() = 0;
+  virtual void RemoveTrayIcon() = 0;
+};
+
+// Gestures recognized besides the shake, which is always on
+struct GestureOptions {
+  bool circle;  // Drawing a circle enlarges the cursor like a shake
+  int64_t circle_max_duration_us;
+  double circle_min_turns;       // Full turns
+  double circle_min_path_length;  // Pixels
+  bool corner_flick;  // Flicking into a monitor corner re-centers the pointer
+  int64_t flick_max_duration_us;
+  double flick_min_distance;  // Pixels
+  int flick_corner_size;      // Corner area a flick must land in (pixels)
+};
+
+// Gestures used by the app and, unless told otherwise, the tools
+inline GestureOptions DefaultGestureOptions() {
+  GestureOptions options;
+  options.circle = false;
+  options.circle_max_duration_us = 1000 * 1000;  // Time to draw the circle
+  options.circle_min_turns = 0.9;  // Net turning that counts as a circle
+  options.circle_min_path_length = 300.0;
+  options.corner_flick = false;
+  options.flick_max_duration_us = 150 * 1000;
+  options.flick_min_distance = 300.0;
+  options.flick_corner_size = 8;
+  return options;
+}
+
+struct ShakeAppParams {
+  RuntimeConfig config;
+  GestureOptions gestures;
+  CursorAnimationParams animation;  // Timing comes from config
+  bool polling;  // Poll PointerPosition() instead of being fed samples
+  AdaptivePollParams poll;
+};
+
+// Recognizes the shake and the optional circle and flick gestures from one
+// pass over the pointer motion
+class MouseMoveDetector {
+ public:
+  struct Gestures {
+    bool shaking;
+    bool circled;   // A circle closed with this sample
+    bool flicking;
+
+    // Whether the sample counts as a shake for enlarging the cursor
+    bool enlarge() const { return shaking || circled; }
+  };
+
+  MouseMoveDetector(const ShakeParams& shake_params,
+                    const GestureOptions& options)
+      : options_(options), engine_(shake_params.min_sample_interval_us) {
+    Configure(shake_params);
+  }
+
+  // Rebuilds the gestures for new shake thresholds. This allocates, so it
+  // runs when the config changes, never per sample; the motion seen so far
+  // is dropped
+  void Configure(const ShakeParams& shake_params) {
+    shake_params_ = shake_params;
+    engine_ = GestureEngine(shake_params.min_sample_interval_us);
+    shake_ = engine_.Register(ShakeGesture(shake_params_));
+    if (options_.circle) {
+      circle_ = engine_.Register(CircleGesture(
+          {MovementsIn(options_.circle_max_duration_us),
+           options_.circle_max_duration_us, options_.circle_min_turns,
+           options_.circle_min_path_length, 2}));
+    }
+    if (options_.corner_flick) {
+      flick_ = engine_.Register(FlickGesture(
+          {MovementsIn(options_.flick_max_duration_us),
+           options_.flick_max_duration_us, options_.flick_min_distance,
+           0.9}));
+    }
+    last_matches_ = 0;
+  }
+
+  // Drops the motion seen so far, keeping the gestures
+  void Reset() {
+    engine_.Reset();
+    last_matches_ = 0;
+  }
+
+  // timestamp_us is taken when the event is received, not when it is
+  // processed
+  Gestures AddSample(int32_t x, int32_t y, int64_t timestamp_us) {
+    uint32_t matches = engine_.AddSample(x, y, timestamp_us);
+    Gestures gestures;
+    gestures.shaking = Matched(matches, shake_);
+    gestures.circled =
+        Matched(matches, circle_) && !Matched(last_matches_, circle_);
+    gestures.flicking = Matched(matches, flick_);
+    last_matches_ = matches;
+    return gestures;
+  }
+
+  ShakeFeatures features() const {
+    const MotionFeatures& features = engine_.features(shake_);
+    return {features.movement_count, features.direction_changes,
+            features.average_speed, features.duration_us};
+  }
+
+  const ShakeParams& params() const { return shake_params_; }
+
+ private:
+  static constexpr size_t kNoGesture = GestureEngine::kMaxGestures;
+
+  // Window length that fits duration_us of uncoalesced movements
+  size_t MovementsIn(int64_t duration_us) const {
+    int64_t interval_us = shake_params_.min_sample_interval_us > 0
+                              ? shake_params_.min_sample_interval_us
+                              : 1;
+    return static_cast<size_t>(duration_us / interval_us) + 1;
+  }
+
+  static bool Matched(uint32_t matches, size_t gesture) {
+    return gesture != kNoGesture && ((matches >> gesture) & 1) != 0;
+  }
+
+  GestureOptions options_;
+  ShakeParams shake_params_;
+  GestureEngine engine_;
+  size_t shake_ = kNoGesture;
+  size_t circle_ = kNoGesture;
+  size_t flick_ = kNoGesture;
+  uint32_t last_matches_ = 0;
+};
+
+// Sees every sample the app detects on, on the detection thread
+class DetectionListener {
+ public:
+  virtual ~DetectionListener() = default;
+
+  virtual void OnDetection(const MouseSample& sample,
+                           const MouseMoveDetector::Gestures& gestures,
+                           EnlargeStateMachine::Action action) = 0;
+};
+
+// The app without the desktop: pointer samples in, cursor swaps and pointer
+// moves out through an AppPlatform. In hook mode samples are fed through
+// OnSamples(); in polling mode the app reads PointerPosition() on a timer of
+// its own. The host calls RunTimers() after every batch and again at
+// NextDeadline(). Everything runs on the one detection thread, and nothing
+// allocates per sample
+class ShakeApp {
+ public:
+  ShakeApp(AppPlatform* platform, LatencyRecorder* latency,
+           const ShakeAppParams& params)
+      : platform_(platform),
+        latency_(latency),
+        params_(params),
+        detector_(params.config.shake, params.gestures),
+        animator_(platform->cursors(), platform->clock(), latency,
+                  AnimationParams(params)),
+        poll_rate_(params.poll) {
+    int64_t now_us = platform->clock()->NowMicros();
+    int32_t x;
+    int32_t y;
+    if (platform->PointerPosition(&x, &y)) {
+      detector_.AddSample(x, y, now_us);
+    }
+    cursor_timer_ = timers_.Add([this](int64_t) { animator_.Tick(); });
+    if (params.polling) {
+      poll_timer_ = timers_.Add([this](int64_t time_us) { Poll(time_us); });
+      timers_.Arm(poll_timer_, now_us);
+    }
+  }
+
+  ShakeApp(const ShakeApp&) = delete;
+  ShakeApp& operator=(const ShakeApp&) = delete;
+
+  void set_listener(DetectionListener* listener) { listener_ = listener; }
+
+  // Switches to new thresholds. Allocates, so only call it when they change
+  void Configure(const RuntimeConfig& config) {
+    detector_.Configure(config.shake);
+    animator_.set_timing(config.timing);
+  }
+
+  // Detects on a batch of samples stamped on receipt
+  void OnSamples(const MouseSample* samples, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      OnSample(samples[i]);
+    }
+    if (count > 0) {
+      platform_->PointerMoved(samples[count - 1].x, samples[count - 1].y);
+    }
+  }
+
+  // Runs the due timers, then follows the cursor to its next restore or
+  // animation frame
+  void RunTimers(int64_t now_us) {
+    static_assert(FramePacer::kNoDeadline == DeadlineScheduler::kNoDeadline &&
+                      EnlargeStateMachine::kNoDeadline ==
+                          DeadlineScheduler::kNoDeadline,
+                  "An idle cursor must disarm its timer");
+    timers_.RunExpired(now_us);
+    timers_.Arm(cursor_timer_, animator_.NextDeadline());
+  }
+
+  // Time the host must call RunTimers() at, or DeadlineScheduler::kNoDeadline
+  int64_t NextDeadline() const { return timers_.NextDeadline(); }
+
+  const MouseMoveDetector& detector() const { return detector_; }
+  const ShakeAppParams& params() const { return params_; }
+  uint64_t enlarge_count() const { return animator_.enlarge_count(); }
+  uint64_t swap_count() const { return animator_.swap_count(); }
+  uint64_t flick_count() const { return flick_count_; }
+
+ private:
+  static CursorAnimationParams AnimationParams(const ShakeAppParams& params) {
+    CursorAnimationParams animation = params.animation;
+    animation.timing = params.config.timing;
+    return animation;
+  }
+
+  void OnSample(const MouseSample& sample) {
+    MouseMoveDetector::Gestures gestures =
+        detector_.AddSample(sample.x, sample.y, sample.timestamp_us);
+    bool tracing = latency_->enabled();
+    if (tracing) {
+      latency_->Record(LatencyRecorder::kEventToDecision,
+                       MonotonicNanos() - sample.timestamp_us * 1000);
+    }
+    EnlargeStateMachine::Action action =
+        animator_.OnDetection(gestures.enlarge());
+    if (action == EnlargeStateMachine::Action::kEnlarge && tracing) {
+      latency_->Record(LatencyRecorder::kEventToEnlarge,
+                       MonotonicNanos() - sample.timestamp_us * 1000);
+    }
+    if (listener_) listener_->OnDetection(sample, gestures, action);
+
+    // Only arriving in the corner counts, so the cursor can rest there
+    int32_t center_x = 0;
+    int32_t center_y = 0;
+    bool corner_flick = gestures.flicking &&
+                        InMonitorCorner(sample.x, sample.y, &center_x,
+                                        &center_y);
+    if (corner_flick && !corner_flicked_) {
+      platform_->MovePointer(center_x, center_y);
+      ++flick_count_;
+    }
+    corner_flicked_ = corner_flick;
+  }
+
+  // Samples the pointer and schedules the next poll: fast while the pointer
+  // moves, slowing down once it is still
+  void Poll(int64_t now_us) {
+    int32_t x;
+    int32_t y;
+    bool moved = false;
+    if (platform_->PointerPosition(&x, &y)) {
+      moved = x != polled_x_ || y != polled_y_;
+      polled_x_ = x;
+      polled_y_ = y;
+      OnSample({x, y, now_us});
+      platform_->PointerMoved(x, y);
+    }
+    timers_.Arm(poll_timer_, now_us + poll_rate_.OnPoll(moved, now_us));
+  }
+
+  // Checks whether (x, y) is within flick_corner_size of a corner of its
+  // monitor and returns the monitor's center
+  bool InMonitorCorner(int32_t x, int32_t y, int32_t* center_x,
+                       int32_t* center_y) {
+    ScreenRect rc;
+    if (!platform_->MonitorBounds(x, y, &rc)) return false;
+    int corner = params_.gestures.flick_corner_size;
+    bool left = x < rc.left + corner;
+    bool right = x >= rc.right - corner;
+    bool top = y < rc.top + corner;
+    bool bottom = y >= rc.bottom - corner;
+    *center_x = rc.left + (rc.right - rc.left) / 2;
+    *center_y = rc.top + (rc.bottom - rc.top) / 2;
+    return (left || right) && (top || bottom);
+  }
+
+  AppPlatform* platform_;
+  LatencyRecorder* latency_;
+  ShakeAppParams params_;
+  DetectionListener* listener_ = nullptr;
+  MouseMoveDetector detector_;
+  CursorAnimator animator_;
+  DeadlineScheduler timers_;
+  DeadlineScheduler::TimerId cursor_timer_ = 0;
+  DeadlineScheduler::TimerId poll_timer_ = 0;
+  AdaptivePollRate poll_rate_;
+  int32_t polled_x_ = 0;
+  int32_t polled_y_ = 0;
+  bool corner_flicked_ = false;
+  uint64_t flick_count_ = 0;
+};
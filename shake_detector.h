@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Shake detection thresholds
+struct ShakeParams {
+  size_t history_size;             // Number of movements in the sliding window
+  int min_direction_changes;       // Minimum direction changes required
+  double min_movement_speed;       // Minimum average speed in pixels/second
+  int64_t max_time_window_us;      // Maximum window duration in microseconds
+  int64_t min_sample_interval_us;  // Closer samples are coalesced
+};
+
+// What the detector sees in its current window
+struct ShakeFeatures {
+  size_t movement_count;
+  int direction_changes;
+  double average_speed;  // Pixels/second
+  int64_t total_time_us;
+};
+
+// Sliding-window shake detector. Direction changes, the speed sum and the
+// time sum are updated as movements enter and leave a fixed-capacity ring,
+// so each movement costs O(1) regardless of the window size. Decisions are
+// identical to rescanning the whole window.
+//
+// Timestamps are in microseconds. High polling rate mice deliver several
+// samples per millisecond; samples closer than min_sample_interval_us are
+// merged into the next movement rather than dropped
+class ShakeDetector {
+ public:
+  explicit ShakeDetector(const ShakeParams& params)
+      : params_(params),
+        ring_(params.history_size > 0 ? params.history_size : 1) {}
+
+  // Adds a pointer position sampled at timestamp_us and returns true if the
+  // window now matches a shake. A coalesced sample leaves the window as it
+  // was, so it repeats the previous decision
+  bool AddSample(int x, int y, int64_t timestamp_us) {
+    if (!has_last_sample_) {
+      last_x_ = x;
+      last_y_ = y;
+      last_time_us_ = timestamp_us;
+      has_last_sample_ = true;
+      return false;
+    }
+
+    // Keep the last position and time so the motion accumulates until the
+    // interval is long enough to yield a meaningful speed
+    int64_t dt = timestamp_us - last_time_us_;
+    if (dt < params_.min_sample_interval_us || dt <= 0) return last_decision_;
+
+    int dx = x - last_x_;
+    int dy = y - last_y_;
+    last_x_ = x;
+    last_y_ = y;
+    last_time_us_ = timestamp_us;
+
+    last_decision_ = AddMovement(dx, dy, dt);
+    return last_decision_;
+  }
+
+  // Adds a movement of (dx, dy) pixels over dt microseconds and returns true
+  // if the window now matches a shake
+  bool AddMovement(int dx, int dy, int64_t dt) {
+    const size_t capacity = ring_.size();
+
+    if (count_ == capacity) {
+      // The second oldest entry becomes the first in the window, so the
+      // direction change counted against the evicted one no longer applies
+      const Entry& oldest = ring_[head_];
+      total_speed_ -= oldest.speed;
+      total_time_ -= oldest.dt;
+      head_ = Next(head_);
+      --count_;
+      if (count_ > 0) {
+        direction_changes_ -= ring_[head_].changes;
+        ring_[head_].changes = 0;
+      }
+    }
+
+    Entry entry;
+    entry.dt = dt;
+    entry.x_dir = Sign(dx);
+    entry.y_dir = Sign(dy);
+    entry.speed = Speed(dx, dy, dt);
+    entry.changes = 0;
+    if (count_ > 0) {
+      const Entry& newest = ring_[Index(count_ - 1)];
+      entry.changes = DirectionChanges(newest, entry);
+    }
+
+    ring_[Index(count_)] = entry;
+    ++count_;
+    direction_changes_ += entry.changes;
+    total_speed_ += entry.speed;
+    total_time_ += dt;
+
+    // Re-summing once per window length bounds floating point drift at an
+    // amortized O(1) cost
+    if (++updates_since_resum_ >= capacity) {
+      total_speed_ = ExactTotalSpeed();
+      updates_since_resum_ = 0;
+    }
+
+    return Detect();
+  }
+
+  void Reset() {
+    head_ = 0;
+    count_ = 0;
+    direction_changes_ = 0;
+    total_speed_ = 0.0;
+    total_time_ = 0;
+    updates_since_resum_ = 0;
+    has_last_sample_ = false;
+    last_decision_ = false;
+  }
+
+  const ShakeParams& params() const { return params_; }
+
+  // The running sums, without the exact-sum fallback Detect() applies near
+  // the speed threshold
+  ShakeFeatures features() const {
+    double average_speed =
+        count_ > 0 ? total_speed_ / static_cast<double>(count_) : 0.0;
+    return {count_, direction_changes_, average_speed, total_time_};
+  }
+
+ private:
+  struct Entry {
+    int64_t dt;
+    double speed;
+    int x_dir;    // -1: negative, 1: positive, 0: neutral
+    int y_dir;
+    int changes;  // Direction changes against the previous entry
+  };
+
+  static int Sign(int value) { return (value > 0) ? 1 : (value < 0) ? -1 : 0; }
+
+  static double Speed(int dx, int dy, int64_t dt) {
+    double distance = std::sqrt(dx * dx + dy * dy);
+    return (dt > 0) ? (distance / static_cast<double>(dt)) * 1000000.0 : 0;
+  }
+
+  static int DirectionChanges(const Entry& prev, const Entry& curr) {
+    int changes = 0;
+    if (prev.x_dir != 0 && curr.x_dir != 0 && prev.x_dir != curr.x_dir) {
+      changes++;
+    }
+    if (prev.y_dir != 0 && curr.y_dir != 0 && prev.y_dir != curr.y_dir) {
+      changes++;
+    }
+    return changes;
+  }
+
+  size_t Next(size_t index) const {
+    return (index + 1 == ring_.size()) ? 0 : index + 1;
+  }
+
+  size_t Index(size_t offset) const {
+    size_t index = head_ + offset;
+    return (index >= ring_.size()) ? index - ring_.size() : index;
+  }
+
+  // Sums speeds oldest to newest, in the same order as a full rescan
+  double ExactTotalSpeed() const {
+    double total = 0.0;
+    for (size_t i = 0; i < count_; ++i) {
+      total += ring_[Index(i)].speed;
+    }
+    return total;
+  }
+
+  bool Detect() const {
+    if (count_ < params_.history_size) return false;
+
+    // Check if we're within the time window
+    if (total_time_ > params_.max_time_window_us) return false;
+
+    if (direction_changes_ < params_.min_direction_changes) return false;
+
+    // The running sum may differ from a rescan in the last bits, so fall
+    // back to an exact sum when the average is close to the threshold
+    double size = static_cast<double>(count_);
+    double avg_speed = total_speed_ / size;
+    double margin = 1e-9 * std::abs(params_.min_movement_speed) + 1e-12;
+    if (std::abs(avg_speed - params_.min_movement_speed) <= margin) {
+      avg_speed = ExactTotalSpeed() / size;
+    }
+    return avg_speed >= params_.min_movement_speed;
+  }
+
+  ShakeParams params_;
+  std::vector<Entry> ring_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+  int direction_changes_ = 0;
+  double total_speed_ = 0.0;
+  int64_t total_time_ = 0;
+  size_t updates_since_resum_ = 0;
+  bool has_last_sample_ = false;
+  int last_x_ = 0;
+  int last_y_ = 0;
+  int64_t last_time_us_ = 0;
+  bool last_decision_ = false;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Named shared memory region. The creator maps it read-write; other
+// processes attach read-only by name. On Windows this is a pagefile-backed
+// file mapping that disappears with its last handle, elsewhere a POSIX
+// shared memory object that the creator unlinks when it closes
+class SharedMemory {
+ public:
+  SharedMemory() = default;
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+
+  ~SharedMemory() { Close(); }
+
+  // Creates the region, or reuses one left with the same name, zero-filled
+  // on first creation
+  bool Create(const std::string& name, size_t size) {
+    Close();
+#ifdef _WIN32
+    uint64_t size64 = size;
+    mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr,
+                                  PAGE_READWRITE,
+                                  static_cast<DWORD>(size64 >> 32),
+                                  static_cast<DWORD>(size64), name.c_str());
+    if (!mapping_) return false;
+    data_ = static_cast<uint8_t*>(
+        MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, size));
+    if (!data_) {
+      Close();
+      return false;
+    }
+#else
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+      data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      return false;
+    }
+    data_ = static_cast<uint8_t*>(data);
+    name_ = name;
+#endif
+    size_ = size;
+    return true;
+  }
+
+  // Attaches read-only to a region created by another process
+  bool Open(const std::string& name) {
+    Close();
+#ifdef _WIN32
+    mapping_ = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+    if (!mapping_) return false;
+    data_ = static_cast<uint8_t*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info;
+    if (!data_ || !VirtualQuery(data_, &info, sizeof(info))) {
+      Close();
+      return false;
+    }
+    size_ = info.RegionSize;
+#else
+    int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                  MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    data_ = static_cast<uint8_t*>(data);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+  }
+
+  void Close() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    mapping_ = nullptr;
+#else
+    if (data_) munmap(data_, size_);
+    if (!name_.empty()) shm_unlink(name_.c_str());
+    name_.clear();
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  bool is_open() const { return data_ != nullptr; }
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+#ifdef _WIN32
+  HANDLE mapping_ = nullptr;
+#else
+  std::string name_;  // Set for the creator, which unlinks the name
+#endif
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
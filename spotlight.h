@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPOTLIGHT_AVX2 1
+#define SPOTLIGHT_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPOTLIGHT_SSE2 1
+#endif
+
+// Pixel rectangle, right and bottom exclusive
+struct PixelRect {
+  int left = 0;
+  int top = 0;
+  int right = 0;
+  int bottom = 0;
+
+  bool empty() const { return right <= left || bottom <= top; }
+  int width() const { return empty() ? 0 : right - left; }
+  int height() const { return empty() ? 0 : bottom - top; }
+  int64_t area() const { return static_cast<int64_t>(width()) * height(); }
+};
+
+inline PixelRect UnionRect(const PixelRect& a, const PixelRect& b) {
+  if (a.empty()) return b;
+  if (b.empty()) return a;
+  return {std::min(a.left, b.left), std::min(a.top, b.top),
+          std::max(a.right, b.right), std::max(a.bottom, b.bottom)};
+}
+
+inline PixelRect IntersectRect(const PixelRect& a, const PixelRect& b) {
+  PixelRect r = {std::max(a.left, b.left), std::max(a.top, b.top),
+                 std::min(a.right, b.right), std::min(a.bottom, b.bottom)};
+  return r.empty() ? PixelRect() : r;
+}
+
+// 32-bit premultiplied BGRA pixels owned elsewhere, such as a DIB section.
+// stride is in pixels
+struct FramebufferView {
+  uint32_t* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  size_t stride = 0;
+
+  PixelRect bounds() const { return {0, 0, width, height}; }
+};
+
+// Tracks what to redraw when a shape moves over a background that does not
+// change: the area it covered last time plus the area it covers now
+class DirtyRectTracker {
+ public:
+  // The next update redraws all of frame
+  void Invalidate() { invalid_ = true; }
+
+  // Returns the area to redraw for the shape now covering bounds, clipped to
+  // frame
+  PixelRect Update(const PixelRect& bounds, const PixelRect& frame) {
+    PixelRect dirty = invalid_ ? frame : UnionRect(last_, bounds);
+    invalid_ = false;
+    last_ = bounds;
+    return IntersectRect(dirty, frame);
+  }
+
+ private:
+  PixelRect last_;
+  bool invalid_ = true;
+};
+
+// Colors are straight alpha 0xAARRGGBB
+struct SpotlightParams {
+  int radius;           // Clear circle around the pointer (pixels)
+  int ring_width;       // Highlight ring around the circle (pixels)
+  uint32_t dim_color;   // Everything outside the ring
+  uint32_t ring_color;
+};
+
+// Software rasterizer for the spotlight overlay: the screen dimmed, a clear
+// circle around the pointer and an anti-aliased ring around the circle.
+// Moving the spotlight only redraws the rectangle it left and the one it
+// entered, so an update costs the same on an 8K screen as on a 1080p one.
+// The shading loop uses AVX2 or SSE2 when the compiler targets them, with a
+// scalar fallback otherwise
+class SpotlightCompositor {
+ public:
+  explicit SpotlightCompositor(const SpotlightParams& params)
+      : params_(params),
+        dim_(Premultiply(params.dim_color)),
+        ring_(Premultiply(params.ring_color)),
+        dim_pixel_(Pack(dim_)) {}
+
+  static const char* KernelName() {
+#if defined(SPOTLIGHT_AVX2)
+    return "avx2";
+#elif defined(SPOTLIGHT_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+  }
+
+  // Area the spotlight centered on (x, y) differs from the dimmed
+  // background in
+  PixelRect Bounds(int x, int y) const {
+    int extent = params_.radius + params_.ring_width + 1;
+    return {x - extent, y - extent, x + extent + 1, y + extent + 1};
+  }
+
+  // Draws the overlay with the spotlight centered on (x, y), redrawing only
+  // what changed since the last Draw() into the same framebuffer, and
+  // returns the area that was redrawn
+  PixelRect Draw(const FramebufferView& frame, int x, int y) {
+    PixelRect dirty = tracker_.Update(Bounds(x, y), frame.bounds());
+    for (int row = dirty.top; row < dirty.bottom; ++row) {
+      DrawRow(frame.pixels + static_cast<size_t>(row) * frame.stride, row,
+              dirty.left, dirty.right, x, y);
+    }
+    return dirty;
+  }
+
+  // The next Draw() redraws the whole framebuffer, for a new or resized one
+  void Invalidate() { tracker_.Invalidate(); }
+
+  // Pixel Draw() leaves at (px, py) with the spotlight on (x, y)
+  uint32_t Shade(int px, int py, int x, int y) const {
+    float dx = static_cast<float>(px - x);
+    float dy = static_cast<float>(py - y);
+    float distance = std::sqrt(dx * dx + dy * dy);
+    float inner = static_cast<float>(params_.radius);
+    float outer = inner + static_cast<float>(params_.ring_width);
+    float clear = Clamp01((inner + 0.5f) - distance);
+    float ring = Clamp01(
+        std::min(distance - (inner - 0.5f), (outer + 0.5f) - distance));
+    float dim = (1.0f - clear) * (1.0f - ring);
+    uint32_t pixel = 0;
+    for (int ch = 0; ch < 4; ++ch) {
+      float v = ring_.c[ch] * ring + dim_.c[ch] * dim;
+      pixel |= static_cast<uint32_t>(std::nearbyint(v)) << (ch * 8);
+    }
+    return pixel;
+  }
+
+ private:
+  struct Color {
+    float c[4];  // B, G, R, A, premultiplied
+  };
+
+  static Color Premultiply(uint32_t color) {
+    float alpha = static_cast<float>(color >> 24);
+    Color result;
+    for (int ch = 0; ch < 3; ++ch) {
+      result.c[ch] = static_cast<float>(std::lround(
+          static_cast<float>((color >> (ch * 8)) & 0xFF) * alpha / 255.0f));
+    }
+    result.c[3] = alpha;
+    return result;
+  }
+
+  static uint32_t Pack(const Color& color) {
+    uint32_t pixel = 0;
+    for (int ch = 0; ch < 4; ++ch) {
+      pixel |= static_cast<uint32_t>(color.c[ch]) << (ch * 8);
+    }
+    return pixel;
+  }
+
+  static float Clamp01(float v) { return std::min(1.0f, std::max(0.0f, v)); }
+
+  // Fills [left, right) of the row, shading only the part the spotlight can
+  // reach
+  void DrawRow(uint32_t* row, int py, int left, int right, int x,
+               int y) const {
+    int extent = params_.radius + params_.ring_width + 1;
+    if (py < y - extent || py > y + extent) {
+      std::fill(row + left, row + right, dim_pixel_);
+      return;
+    }
+    int shade_left = std::max(left, x - extent);
+    int shade_right = std::min(right, x + extent + 1);
+    if (shade_left >= shade_right) {
+      std::fill(row + left, row + right, dim_pixel_);
+      return;
+    }
+    std::fill(row + left, row + shade_left, dim_pixel_);
+    ShadeSpan(row, py, shade_left, shade_right, x, y);
+    std::fill(row + shade_right, row + right, dim_pixel_);
+  }
+
+  void ShadeSpan(uint32_t* row, int py, int left, int right, int x,
+                 int y) const {
+    int px = left;
+#if defined(SPOTLIGHT_SSE2)
+    float dy = static_cast<float>(py - y);
+    float inner = static_cast<float>(params_.radius);
+    float outer = inner + static_cast<float>(params_.ring_width);
+#endif
+#if defined(SPOTLIGHT_AVX2)
+    {
+      const __m256 zero = _mm256_setzero_ps();
+      const __m256 one = _mm256_set1_ps(1.0f);
+      const __m256 dy2 = _mm256_set1_ps(dy * dy);
+      const __m256 clear_edge = _mm256_set1_ps(inner + 0.5f);
+      const __m256 ring_inner = _mm256_set1_ps(inner - 0.5f);
+      const __m256 ring_outer = _mm256_set1_ps(outer + 0.5f);
+      const __m256 steps = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+      for (; px + 8 <= right; px += 8) {
+        __m256 dx = _mm256_add_ps(
+            _mm256_set1_ps(static_cast<float>(px - x)), steps);
+        __m256 distance =
+            _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), dy2));
+        __m256 clear = _mm256_min_ps(
+            one, _mm256_max_ps(zero, _mm256_sub_ps(clear_edge, distance)));
+        __m256 ring = _mm256_min_ps(
+            _mm256_sub_ps(distance, ring_inner),
+            _mm256_sub_ps(ring_outer, distance));
+        ring = _mm256_min_ps(one, _mm256_max_ps(zero, ring));
+        __m256 dim = _mm256_mul_ps(_mm256_sub_ps(one, clear),
+                                   _mm256_sub_ps(one, ring));
+        __m256i b = Channel256(0, ring, dim);
+        __m256i g = _mm256_slli_epi32(Channel256(1, ring, dim), 8);
+        __m256i r = _mm256_slli_epi32(Channel256(2, ring, dim), 16);
+        __m256i a = _mm256_slli_epi32(Channel256(3, ring, dim), 24);
+        __m256i pixels =
+            _mm256_or_si256(_mm256_or_si256(b, g), _mm256_or_si256(r, a));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + px), pixels);
+      }
+    }
+#endif
+#if defined(SPOTLIGHT_SSE2)
+    {
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 one = _mm_set1_ps(1.0f);
+      const __m128 dy2 = _mm_set1_ps(dy * dy);
+      const __m128 clear_edge = _mm_set1_ps(inner + 0.5f);
+      const __m128 ring_inner = _mm_set1_ps(inner - 0.5f);
+      const __m128 ring_outer = _mm_set1_ps(outer + 0.5f);
+      const __m128 steps = _mm_setr_ps(0, 1, 2, 3);
+      for (; px + 4 <= right; px += 4) {
+        __m128 dx =
+            _mm_add_ps(_mm_set1_ps(static_cast<float>(px - x)), steps);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2));
+        __m128 clear = _mm_min_ps(
+            one, _mm_max_ps(zero, _mm_sub_ps(clear_edge, distance)));
+        __m128 ring = _mm_min_ps(_mm_sub_ps(distance, ring_inner),
+                                 _mm_sub_ps(ring_outer, distance));
+        ring = _mm_min_ps(one, _mm_max_ps(zero, ring));
+        __m128 dim = _mm_mul_ps(_mm_sub_ps(one, clear), _mm_sub_ps(one, ring));
+        __m128i b = Channel128(0, ring, dim);
+        __m128i g = _mm_slli_epi32(Channel128(1, ring, dim), 8);
+        __m128i r = _mm_slli_epi32(Channel128(2, ring, dim), 16);
+        __m128i a = _mm_slli_epi32(Channel128(3, ring, dim), 24);
+        __m128i pixels = _mm_or_si128(_mm_or_si128(b, g), _mm_or_si128(r, a));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + px), pixels);
+      }
+    }
+#endif
+    for (; px < right; ++px) {
+      row[px] = Shade(px, py, x, y);
+    }
+  }
+
+  // One channel of ring and dim coverage blended, rounded as in Shade()
+#if defined(SPOTLIGHT_AVX2)
+  __m256i Channel256(int ch, __m256 ring, __m256 dim) const {
+    return _mm256_cvtps_epi32(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ring_.c[ch]), ring),
+                      _mm256_mul_ps(_mm256_set1_ps(dim_.c[ch]), dim)));
+  }
+#endif
+#if defined(SPOTLIGHT_SSE2)
+  __m128i Channel128(int ch, __m128 ring, __m128 dim) const {
+    return _mm_cvtps_epi32(
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ring_.c[ch]), ring),
+                   _mm_mul_ps(_mm_set1_ps(dim_.c[ch]), dim)));
+  }
+#endif
+
+  SpotlightParams params_;
+  Color dim_;
+  Color ring_;
+  uint32_t dim_pixel_;
+  DirtyRectTracker tracker_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4324)  // Structure padded due to alignas
+#endif
+
+// Wait-free single-producer/single-consumer ring buffer. Indices grow
+// monotonically and are masked on access; each side caches the other side's
+// index so the shared cache lines are only touched when the cache runs out
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+ public:
+  static constexpr size_t kCapacity = Capacity;
+
+  SpscRing() = default;
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Producer side. Returns false if the ring is full
+  bool TryPush(const T& item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == Capacity) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == Capacity) return false;
+    }
+    items_[tail & kMask] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Moves up to max_count items into out and returns the count
+  size_t PopBatch(T* out, size_t max_count) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ == head) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (cached_tail_ == head) return 0;
+    }
+    size_t available = cached_tail_ - head;
+    size_t count = (available < max_count) ? available : max_count;
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = items_[(head + i) & kMask];
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer side
+  bool Empty() const {
+    return head_.load(std::memory_order_relaxed) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr size_t kMask = Capacity - 1;
+
+  // Consumer-owned line
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+
+  // Producer-owned line
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+
+  alignas(64) T items_[Capacity];
+};
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
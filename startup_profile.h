@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "monotonic_clock.h"
+
+// Time from startup to each startup phase. Only the first mark of a phase
+// counts, so a phase reached on every event, such as the first sample, can
+// be marked unconditionally; marking is lock-free and may happen on any
+// thread
+class StartupProfile {
+ public:
+  enum Phase {
+    kCursorsReady,    // Enlarged cursors rendered
+    kWindowCreated,   // Message window created
+    kConfigLoaded,    // Config file read
+    kInputStarted,    // Mouse hook installed or polling timer set
+    kTrayIconAdded,   // Tray icon shown
+    kDetectionReady,  // Input callbacks can run, samples are detected
+    kFirstSample,     // First sample run through the detector
+    kPhaseCount
+  };
+
+  static constexpr int64_t kNotReached = -1;
+
+  static const char* PhaseName(Phase phase) {
+    static const char* const kNames[kPhaseCount] = {
+        "cursors ready",   "window created",  "config loaded",
+        "input started",   "tray icon added", "detection ready",
+        "first sample",
+    };
+    return kNames[phase];
+  }
+
+  explicit StartupProfile(const MonotonicClock* clock)
+      : clock_(clock), start_us_(clock->NowMicros()) {
+    for (std::atomic<int64_t>& mark : marks_) {
+      mark.store(kNotReached, std::memory_order_relaxed);
+    }
+  }
+
+  void Mark(Phase phase) {
+    if (reached(phase)) return;
+    int64_t expected = kNotReached;
+    marks_[phase].compare_exchange_strong(expected,
+                                          clock_->NowMicros() - start_us_,
+                                          std::memory_order_relaxed);
+  }
+
+  bool reached(Phase phase) const {
+    return marks_[phase].load(std::memory_order_relaxed) != kNotReached;
+  }
+
+  // Microseconds from startup to the phase, or kNotReached
+  int64_t elapsed_us(Phase phase) const {
+    return marks_[phase].load(std::memory_order_relaxed);
+  }
+
+  // One line per phase with the time since startup and since the previous
+  // phase reached, in milliseconds. Phases not reached show as "-"
+  std::string Report() const {
+    std::ostringstream out;
+    out << std::left << std::setw(20) << "phase" << std::right
+        << std::setw(12) << "since start" << std::setw(12) << "step"
+        << "  (ms)\n";
+    out << std::fixed << std::setprecision(2);
+    int64_t previous_us = 0;
+    for (int i = 0; i < kPhaseCount; ++i) {
+      int64_t elapsed = elapsed_us(static_cast<Phase>(i));
+      out << std::left << std::setw(20) << PhaseName(static_cast<Phase>(i))
+          << std::right;
+      if (elapsed == kNotReached) {
+        out << std::setw(12) << "-" << std::setw(12) << "-" << '\n';
+        continue;
+      }
+      out << std::setw(12) << static_cast<double>(elapsed) / 1000.0
+          << std::setw(12)
+          << static_cast<double>(elapsed - previous_us) / 1000.0 << '\n';
+      previous_us = elapsed;
+    }
+    return out.str();
+  }
+
+ private:
+  const MonotonicClock* clock_;
+  int64_t start_us_;
+  std::atomic<int64_t> marks_[kPhaseCount];
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "sample_worker.h"
+
+// Endless deterministic pointer motion: still gaps, shakes, circles, flicks
+// and slow drift in turn. The path is laid out at 2 kHz; with substeps > 1
+// each step is split into that many evenly spaced samples along it, so 4
+// traces the same path as an 8 kHz mouse would
+class SyntheticMotion {
+ public:
+  explicit SyntheticMotion(int substeps = 1)
+      : substeps_(substeps > 0 ? substeps : 1) {}
+
+  MouseSample Next() {
+    if (substep_ == 0) {
+      from_x_ = x_;
+      from_y_ = y_;
+      Step();
+    }
+    int k = ++substep_;
+    if (substep_ == substeps_) substep_ = 0;
+    return {from_x_ + (x_ - from_x_) * k / substeps_,
+            from_y_ + (y_ - from_y_) * k / substeps_,
+            time_us_ - kStepUs * (substeps_ - k) / substeps_};
+  }
+
+  // True while the last sample returned is part of a shake
+  bool shaking() const { return phase_ == 1; }
+
+ private:
+  static constexpr int64_t kStepUs = 500;
+
+  void Step() {
+    constexpr int kPhaseEvents = 1200;
+    phase_ = static_cast<int>(index_ / kPhaseEvents % 5);
+    int i = static_cast<int>(index_ % kPhaseEvents);
+    ++index_;
+    time_us_ += kStepUs;
+    switch (phase_) {
+      case 0:  // Still, then a gap as if the hook saw nothing
+        if (i == kPhaseEvents - 1) time_us_ += 2 * 1000 * 1000;
+        break;
+      case 1:  // Shake, reversing every 2 ms
+        x_ += (i / 4) % 2 == 0 ? 6 : -6;
+        break;
+      case 2: {  // Circles of radius 150
+        double angle = 2.0 * 3.14159265358979323846 * i / 600.0;
+        x_ = 960 + static_cast<int>(std::lround(150.0 * std::cos(angle)));
+        y_ = 540 + static_cast<int>(std::lround(150.0 * std::sin(angle)));
+        break;
+      }
+      case 3:  // Flicks to the right
+        x_ = 100 + (i % 200) * 5;
+        break;
+      default:  // Drift
+        x_ += i % 3 == 0 ? 1 : 0;
+        y_ += i % 7 == 0 ? 1 : 0;
+        break;
+    }
+  }
+
+  int substeps_;
+  int substep_ = 0;
+  int phase_ = 0;
+  uint64_t index_ = 0;
+  int64_t time_us_ = 0;
+  int32_t x_ = 960;
+  int32_t y_ = 540;
+  int32_t from_x_ = 960;
+  int32_t from_y_ = 540;
+};
@@ -0,0 +1,234 @@
+// Runs the app's event path after startup with every heap allocation
+// counted, and fails if the steady state allocates. Samples go through the
+// sample ring into ShakeApp on the headless platform in hook mode, and are
+// polled on the app's own timer in polling mode, with latency recording on
+// and every gesture enabled.
+//
+//   alloc_check [events]
+//
+// Registered as a test, so an allocation on the event path fails the build's
+// test run
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#include "headless_platform.h"
+#include "latency_recorder.h"
+#include "runtime_config.h"
+#include "sample_worker.h"
+#include "shake_app.h"
+#include "spsc_ring.h"
+#include "synthetic_motion.h"
+
+// Every allocation function in the process is replaced, all of them on top
+// of malloc and free, so no pair mixes this allocator with the library's.
+// They are kept out of line: GCC otherwise inlines a replaced delete into
+// the caller and, seeing free() on a pointer from operator new, reports
+// -Wmismatched-new-delete although the two are a matching pair here
+#if defined(_MSC_VER)
+#define ALLOC_CHECK_NOINLINE __declspec(noinline)
+#else
+#define ALLOC_CHECK_NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+
+void* CountedAlloc(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size > 0 ? size : 1);
+}
+
+void* CountedAlignedAlloc(std::size_t size, std::align_val_t align) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  std::size_t alignment = static_cast<std::size_t>(align);
+  if (size == 0) size = 1;
+#if defined(_MSC_VER)
+  return _aligned_malloc(size, alignment);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  return std::aligned_alloc(alignment,
+                            (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+void AlignedFree(void* memory) {
+#if defined(_MSC_VER)
+  _aligned_free(memory);
+#else
+  std::free(memory);
+#endif
+}
+
+}  // namespace
+
+ALLOC_CHECK_NOINLINE void* operator new(std::size_t size) {
+  if (void* memory = CountedAlloc(size)) return memory;
+  throw std::bad_alloc();
+}
+ALLOC_CHECK_NOINLINE void* operator new[](std::size_t size) {
+  if (void* memory = CountedAlloc(size)) return memory;
+  throw std::bad_alloc();
+}
+ALLOC_CHECK_NOINLINE void* operator new(std::size_t size,
+                                        const std::nothrow_t&) noexcept {
+  return CountedAlloc(size);
+}
+ALLOC_CHECK_NOINLINE void* operator new[](std::size_t size,
+                                          const std::nothrow_t&) noexcept {
+  return CountedAlloc(size);
+}
+ALLOC_CHECK_NOINLINE void* operator new(std::size_t size,
+                                        std::align_val_t align) {
+  if (void* memory = CountedAlignedAlloc(size, align)) return memory;
+  throw std::bad_alloc();
+}
+ALLOC_CHECK_NOINLINE void* operator new[](std::size_t size,
+                                          std::align_val_t align) {
+  if (void* memory = CountedAlignedAlloc(size, align)) return memory;
+  throw std::bad_alloc();
+}
+
+ALLOC_CHECK_NOINLINE void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete[](void* memory) noexcept {
+  std::free(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete(void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete[](void* memory,
+                                            std::size_t) noexcept {
+  std::free(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete(void* memory,
+                                          const std::nothrow_t&) noexcept {
+  std::free(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete[](void* memory,
+                                            const std::nothrow_t&) noexcept {
+  std::free(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete(void* memory,
+                                          std::align_val_t) noexcept {
+  AlignedFree(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete[](void* memory,
+                                            std::align_val_t) noexcept {
+  AlignedFree(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete(void* memory, std::size_t,
+                                          std::align_val_t) noexcept {
+  AlignedFree(memory);
+}
+ALLOC_CHECK_NOINLINE void operator delete[](void* memory, std::size_t,
+                                            std::align_val_t) noexcept {
+  AlignedFree(memory);
+}
+
+namespace {
+
+// The app after startup on the headless platform. In hook mode samples are
+// posted to the sample ring and drained in batches, with the timers run
+// after each batch and at their deadlines, as the sample worker does; in
+// polling mode they only move the pointer. All of it is set up before
+// counting
+class EventPath {
+ public:
+  explicit EventPath(bool polling)
+      : app_(&platform_, &latency_, Params(polling)), polling_(polling) {
+    platform_.headless_cursors().set_recording(false);
+    latency_.set_enabled(true);
+  }
+
+  void Post(const MouseSample& sample) {
+    // Deadlines before the sample fire first, as the host wakes for them
+    while (app_.NextDeadline() <= sample.timestamp_us) {
+      RunTimers(app_.NextDeadline());
+    }
+    platform_.SetTime(sample.timestamp_us);
+    platform_.SetPointer(sample.x, sample.y);
+    if (polling_) return;
+    if (!ring_.TryPush(sample)) {
+      Drain();
+      ring_.TryPush(sample);
+    }
+    if (++posted_ % 16 == 0) Drain();
+  }
+
+  void Drain() {
+    MouseSample batch[SampleWorker::kBatchSize];
+    size_t count;
+    while ((count = ring_.PopBatch(batch, SampleWorker::kBatchSize)) > 0) {
+      app_.OnSamples(batch, count);
+      RunTimers(platform_.clock()->NowMicros());
+    }
+  }
+
+  const ShakeApp& app() const { return app_; }
+
+ private:
+  static ShakeAppParams Params(bool polling) {
+    ShakeAppParams params;
+    params.config = DefaultRuntimeConfig();
+    params.gestures = DefaultGestureOptions();
+    params.gestures.circle = true;
+    params.gestures.corner_flick = true;
+    params.animation = {params.config.timing, 6, 120 * 1000LL,
+                        CursorSwapScheduler::Mode::kAll};
+    params.polling = polling;
+    params.poll = {10 * 1000LL, 100 * 1000LL, 1000 * 1000LL};
+    return params;
+  }
+
+  void RunTimers(int64_t now_us) {
+    platform_.SetTime(now_us);
+    app_.RunTimers(now_us);
+  }
+
+  HeadlessPlatform platform_;
+  LatencyRecorder latency_;
+  ShakeApp app_;
+  SpscRing<MouseSample, SampleWorker::kRingCapacity> ring_;
+  bool polling_;
+  uint64_t posted_ = 0;
+};
+
+// Returns the allocations made by events after one pass over the motion
+// pattern warms the path up
+uint64_t CountAllocations(bool polling, uint64_t events) {
+  auto path = std::make_unique<EventPath>(polling);
+  SyntheticMotion motion;
+  for (int i = 0; i < 6000; ++i) path->Post(motion.Next());
+  path->Drain();
+
+  uint64_t before = allocation_count.load();
+  for (uint64_t i = 0; i < events; ++i) path->Post(motion.Next());
+  path->Drain();
+  uint64_t allocations = allocation_count.load() - before;
+
+  std::cout << (polling ? "polling" : "hook") << " mode: " << events
+            << " events, " << path->app().enlarge_count() << " enlargements, "
+            << path->app().swap_count() << " cursor swaps, " << allocations
+            << " allocations" << std::endl;
+  return allocations;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint64_t events = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  if (events == 0) {
+    std::cerr << "Usage: alloc_check [events]" << std::endl;
+    return 1;
+  }
+  uint64_t allocations = CountAllocations(false, events);
+  allocations += CountAllocations(true, events);
+  return allocations == 0 ? 0 : 1;
+}
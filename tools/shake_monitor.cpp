@@ -0,0 +1,115 @@
+// Attaches to the diagnostic ring of a running ShakeToFindCursor and prints
+// the recent detector inputs, then every new one as it arrives, with the
+// window features next to the thresholds they are judged against.
+//
+//   shake_monitor [options]
+//
+// The monitor only reads the shared memory, so the app never waits on it
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "diagnostic_ring.h"
+
+namespace {
+
+struct Options {
+  std::string name = DiagnosticRing::kDefaultName;
+  int poll_ms = 10;
+  bool once = false;
+};
+
+void PrintUsage() {
+  std::cerr << "Usage: shake_monitor [options]\n"
+               "  --name NAME          Shared memory name ("
+            << DiagnosticRing::kDefaultName
+            << ")\n"
+               "  --poll-ms N          Poll interval (10)\n"
+               "  --once               Print the buffered records and exit\n";
+}
+
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--once") {
+      options->once = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* value = argv[++i];
+    if (arg == "--name") {
+      options->name = value;
+    } else if (arg == "--poll-ms") {
+      options->poll_ms = std::atoi(value);
+    } else {
+      return false;
+    }
+  }
+  return options->poll_ms > 0;
+}
+
+void PrintRecord(const DiagnosticRecord& record, const ShakeParams& params,
+                 int64_t start_time_us) {
+  std::cout << std::fixed << std::setprecision(3) << std::setw(10)
+            << static_cast<double>(record.timestamp_us - start_time_us) / 1e6
+            << " s  " << std::setw(6) << record.x << std::setw(6) << record.y
+            << "  moves " << std::setw(3) << record.movement_count << '/'
+            << params.history_size << "  changes " << std::setw(3)
+            << record.direction_changes << '/' << params.min_direction_changes
+            << "  speed " << std::setprecision(0) << std::setw(6)
+            << record.average_speed << '/' << params.min_movement_speed
+            << "  window " << std::setw(4) << record.total_time_us / 1000 << '/'
+            << params.max_time_window_us / 1000 << " ms";
+  if (record.flags & DiagnosticRecord::kShaking) std::cout << "  SHAKE";
+  if (record.flags & DiagnosticRecord::kEnlarged) std::cout << "  ENLARGE";
+  if (record.flags & DiagnosticRecord::kRestored) std::cout << "  RESTORE";
+  std::cout << std::defaultfloat << '\n';
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  DiagnosticRingReader reader;
+  if (!reader.Open(options.name)) {
+    std::cerr << options.name << ": no diagnostic ring, is the app running?"
+              << std::endl;
+    return 1;
+  }
+  ShakeParams params = reader.params();
+
+  constexpr size_t kBatchSize = 256;
+  DiagnosticRecord records[kBatchSize];
+  uint64_t end = reader.write_position();
+  uint64_t position = end > reader.capacity() ? end - reader.capacity() : 0;
+  uint64_t lost = 0;
+  uint64_t reported_lost = 0;
+  int64_t start_time_us = -1;
+  for (;;) {
+    size_t count;
+    while ((count = reader.Read(&position, records, kBatchSize, &lost)) > 0) {
+      for (size_t i = 0; i < count; ++i) {
+        if (start_time_us < 0) start_time_us = records[i].timestamp_us;
+        PrintRecord(records[i], params, start_time_us);
+      }
+    }
+    if (lost != reported_lost) {
+      std::cout << "  (" << lost - reported_lost
+                << " records overwritten before they were read)\n";
+      reported_lost = lost;
+    }
+    std::cout.flush();
+    if (options.once) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.poll_ms));
+  }
+  return 0;
+}
@@ -0,0 +1,333 @@
+// Runs the whole app without a desktop: recorded or synthetic pointer motion
+// goes through the same ShakeApp as on Windows, with detection, enlargement,
+// the grow and shrink animation and the restore on a simulated clock, and
+// the cursor swaps land in an in-memory cursor table. Reports the throughput
+// and the timeline of cursor swaps.
+//
+//   shake_sim [options] [trace...]
+//
+// Detector options default to DefaultRuntimeConfig(), the gestures to
+// DefaultGestureOptions() and the others to the values in CursorConfig.
+// --synthetic needs no traces
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "deadline_scheduler.h"
+#include "headless_platform.h"
+#include "latency_recorder.h"
+#include "mouse_trace.h"
+#include "runtime_config.h"
+#include "sample_worker.h"
+#include "shake_app.h"
+#include "synthetic_motion.h"
+
+namespace {
+
+ShakeAppParams DefaultParams() {
+  ShakeAppParams params;
+  params.config = DefaultRuntimeConfig();
+  params.gestures = DefaultGestureOptions();
+  params.animation = {params.config.timing, 6, 120 * 1000LL,
+                      CursorSwapScheduler::Mode::kCurrentOnly};
+  params.polling = false;
+  params.poll = {10 * 1000LL, 100 * 1000LL, 1000 * 1000LL};
+  return params;
+}
+
+struct Options {
+  ShakeAppParams params = DefaultParams();
+  uint64_t synthetic_events = 0;
+  int repeat = 1;
+  bool timeline = false;
+  std::vector<std::string> paths;
+};
+
+void PrintUsage() {
+  std::cerr
+      << "Usage: shake_sim [options] [trace...]\n"
+         "  --synthetic N        Run N events of synthetic motion\n"
+         "  --poll               Poll the pointer instead of hooking it\n"
+         "  --circle             Enlarge on circles as well as shakes\n"
+         "  --flick              Re-center the pointer on corner flicks\n"
+         "  --all-shapes         Swap every cursor shape, not only the one\n"
+         "                       on screen\n"
+         "  --history N          Movements in the detector window (10)\n"
+         "  --changes N          Minimum direction changes (5)\n"
+         "  --speed F            Minimum average speed in pixels/second (800)\n"
+         "  --window-ms N        Maximum window duration (500)\n"
+         "  --enlarge-ms N       Enlarged time after the last shake (500)\n"
+         "  --max-enlarge-ms N   Longest enlargement while shaking (5000)\n"
+         "  --cooldown-ms N      Cooldown after a restore (300)\n"
+         "  --frames N           Animation frames, 1 disables it (6)\n"
+         "  --animation-ms N     Grow and shrink duration (120)\n"
+         "  --poll-ms N          Polling interval while moving (10)\n"
+         "  --idle-poll-ms N     Longest polling interval when still (100)\n"
+         "  --repeat N           Run each input N times for timing (1)\n"
+         "  --timeline           Print every cursor swap\n";
+}
+
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  ShakeAppParams& params = options->params;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--poll") {
+      params.polling = true;
+      continue;
+    }
+    if (arg == "--circle") {
+      params.gestures.circle = true;
+      continue;
+    }
+    if (arg == "--flick") {
+      params.gestures.corner_flick = true;
+      continue;
+    }
+    if (arg == "--all-shapes") {
+      params.animation.swap_mode = CursorSwapScheduler::Mode::kAll;
+      continue;
+    }
+    if (arg == "--timeline") {
+      options->timeline = true;
+      continue;
+    }
+    if (arg.rfind("--", 0) != 0) {
+      options->paths.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* value = argv[++i];
+    if (arg == "--synthetic") {
+      options->synthetic_events = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--history") {
+      params.config.shake.history_size = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--changes") {
+      params.config.shake.min_direction_changes = std::atoi(value);
+    } else if (arg == "--speed") {
+      params.config.shake.min_movement_speed = std::strtod(value, nullptr);
+    } else if (arg == "--window-ms") {
+      params.config.shake.max_time_window_us = std::atoll(value) * 1000;
+    } else if (arg == "--enlarge-ms") {
+      params.config.timing.enlarge_duration_us = std::atoll(value) * 1000;
+    } else if (arg == "--max-enlarge-ms") {
+      params.config.timing.max_enlarge_duration_us = std::atoll(value) * 1000;
+    } else if (arg == "--cooldown-ms") {
+      params.config.timing.cooldown_us = std::atoll(value) * 1000;
+    } else if (arg == "--frames") {
+      params.animation.frame_count = std::atoi(value);
+    } else if (arg == "--animation-ms") {
+      params.animation.duration_us = std::atoll(value) * 1000;
+    } else if (arg == "--poll-ms") {
+      params.poll.fast_interval_us = std::atoll(value) * 1000;
+    } else if (arg == "--idle-poll-ms") {
+      params.poll.slow_interval_us = std::atoll(value) * 1000;
+    } else if (arg == "--repeat") {
+      options->repeat = std::atoi(value);
+    } else {
+      return false;
+    }
+  }
+  return (!options->paths.empty() || options->synthetic_events > 0) &&
+         options->repeat > 0 && params.animation.frame_count > 0 &&
+         params.poll.fast_interval_us > 0 &&
+         params.poll.slow_interval_us >= params.poll.fast_interval_us;
+}
+
+// Counts the samples the app detected on
+class DetectionCounter : public DetectionListener {
+ public:
+  void OnDetection(const MouseSample&, const MouseMoveDetector::Gestures&,
+                   EnlargeStateMachine::Action) override {
+    ++count_;
+  }
+
+  uint64_t count() const { return count_; }
+
+ private:
+  uint64_t count_ = 0;
+};
+
+struct SimResult {
+  uint64_t detections = 0;  // Samples detected on; polls in polling mode
+  int64_t start_time_us = 0;
+  int64_t end_time_us = 0;  // Last sample or timer
+  uint64_t enlarge_count = 0;
+  uint64_t swap_count = 0;
+  uint64_t flick_count = 0;
+  bool restored = true;  // Every cursor is the original again at the end
+  std::vector<CursorSwapEvent> timeline;  // Only when recorded
+};
+
+// Runs samples through a ShakeApp on a HeadlessPlatform. The driver plays
+// the host: in hook mode each sample is delivered at its timestamp after
+// the timers due before it, with the timers run again after it as the
+// sample worker does; in polling mode the samples only move the pointer and
+// the app polls it on its own schedule. Afterwards time runs on until the
+// cursor is restored
+SimResult Simulate(const std::vector<MouseSample>& samples,
+                   const ShakeAppParams& params, bool record) {
+  SimResult result;
+  if (samples.empty()) return result;
+
+  HeadlessPlatform platform;
+  platform.headless_cursors().set_recording(record);
+  platform.SetTime(samples.front().timestamp_us);
+  platform.SetPointer(samples.front().x, samples.front().y);
+  LatencyRecorder latency;
+  ShakeApp app(&platform, &latency, params);
+  DetectionCounter counter;
+  app.set_listener(&counter);
+  platform.AddTrayIcon();
+
+  int64_t now_us = samples.front().timestamp_us;
+  auto run_timers_until = [&](int64_t until_us) {
+    int64_t deadline_us;
+    while ((deadline_us = app.NextDeadline()) <= until_us) {
+      now_us = deadline_us;
+      platform.SetTime(now_us);
+      app.RunTimers(now_us);
+    }
+  };
+
+  for (const MouseSample& sample : samples) {
+    run_timers_until(sample.timestamp_us);
+    now_us = sample.timestamp_us;
+    platform.SetTime(now_us);
+    platform.SetPointer(sample.x, sample.y);
+    if (!params.polling) {
+      app.OnSamples(&sample, 1);
+      app.RunTimers(now_us);
+    }
+  }
+
+  // The poll timer never stops, so polling runs until the longest
+  // enlargement that could still be on screen has shrunk back
+  int64_t last_sample_us = samples.back().timestamp_us;
+  if (params.polling) {
+    run_timers_until(last_sample_us +
+                     params.config.timing.max_enlarge_duration_us +
+                     2 * params.animation.duration_us +
+                     params.poll.slow_interval_us);
+  } else {
+    run_timers_until(DeadlineScheduler::kNoDeadline - 1);
+  }
+  platform.RemoveTrayIcon();
+
+  const HeadlessCursors& cursors = platform.headless_cursors();
+  result.detections = counter.count();
+  result.start_time_us = samples.front().timestamp_us;
+  result.end_time_us = now_us > last_sample_us ? now_us : last_sample_us;
+  result.enlarge_count = app.enlarge_count();
+  result.swap_count = cursors.swap_count();
+  result.flick_count = app.flick_count();
+  for (int shape = 0; shape < cursors.ShapeCount(); ++shape) {
+    result.restored = result.restored && cursors.shown(shape) == -1;
+  }
+  result.timeline = cursors.timeline();
+  return result;
+}
+
+bool LoadTrace(const std::string& path, std::vector<MouseSample>* samples) {
+  MouseTraceReader trace;
+  if (!trace.Open(path)) return false;
+  constexpr size_t kBatchSize = 256;
+  MouseTraceDecoder decoder = trace.Decoder();
+  MouseSample batch[kBatchSize];
+  size_t count;
+  while ((count = decoder.Read(batch, kBatchSize)) > 0) {
+    samples->insert(samples->end(), batch, batch + count);
+  }
+  return true;
+}
+
+// Runs one input repeat times with the timeline off for timing, then once
+// more recording it. Every run must end the same way
+bool Report(const std::string& name, const std::vector<MouseSample>& samples,
+            const Options& options) {
+  SimResult result;
+  bool deterministic = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.repeat; ++i) {
+    SimResult run = Simulate(samples, options.params, false);
+    deterministic = deterministic &&
+                    (i == 0 || (run.swap_count == result.swap_count &&
+                                run.enlarge_count == result.enlarge_count));
+    result = run;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  SimResult recorded = Simulate(samples, options.params, true);
+  deterministic = deterministic && recorded.swap_count == result.swap_count &&
+                  recorded.timeline.size() == recorded.swap_count;
+
+  double events = static_cast<double>(samples.size()) * options.repeat;
+  double rate = elapsed.count() > 0 ? events / elapsed.count() : 0.0;
+  std::cout << name << " (" << (options.params.polling ? "polling" : "hook")
+            << "): " << samples.size() << " samples over " << std::fixed
+            << std::setprecision(1)
+            << static_cast<double>(result.end_time_us -
+                                   result.start_time_us) /
+                   1e6
+            << " s, " << result.detections << " detections, "
+            << result.enlarge_count << " enlargements, " << result.swap_count
+            << " cursor swaps, " << result.flick_count << " flicks, "
+            << rate / 1e6 << " M events/s" << std::defaultfloat << std::endl;
+
+  if (options.timeline) {
+    for (const CursorSwapEvent& swap : recorded.timeline) {
+      std::cout << "  " << std::fixed << std::setprecision(3)
+                << static_cast<double>(swap.time_us -
+                                       recorded.start_time_us) /
+                       1e6
+                << " s  shape " << swap.shape << "  "
+                << std::defaultfloat;
+      if (swap.frame < 0) {
+        std::cout << "original" << std::endl;
+      } else {
+        std::cout << "frame " << swap.frame << std::endl;
+      }
+    }
+  }
+  if (!result.restored) {
+    std::cerr << name << ": cursors left enlarged at the end" << std::endl;
+  }
+  if (!deterministic) {
+    std::cerr << name << ": runs over the same input differ" << std::endl;
+  }
+  return result.restored && deterministic;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  int failures = 0;
+  if (options.synthetic_events > 0) {
+    std::vector<MouseSample> samples;
+    samples.reserve(options.synthetic_events);
+    SyntheticMotion motion;
+    for (uint64_t i = 0; i < options.synthetic_events; ++i) {
+      samples.push_back(motion.Next());
+    }
+    if (!Report("synthetic", samples, options)) ++failures;
+  }
+  for (const std::string& path : options.paths) {
+    std::vector<MouseSample> samples;
+    if (!LoadTrace(path, &samples)) {
+      std::cerr << path << ": not a readable mouse trace" << std::endl;
+      ++failures;
+      continue;
+    }
+    if (!Report(path, samples, options)) ++failures;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,3027 @@
+// Replays recorded mouse traces through the shake detector and reports the
+// enlargements each trace triggers and the replay throughput.
+//
+//   trace_replay [options] trace...
+//
+// Detector options default to DefaultRuntimeConfig() and the gestures to
+// DefaultGestureOptions(), as in the app. --reload-stress, --spotlight,
+// --restore-check, --swap-check, --frame-check, --scaler, --cursor-sets,
+// --cache-startup, --startup, --wake-latency, --bench-detector,
+// --bench-8khz, --ring-stress, --logger-stress, --latency-check,
+// --shm-ring-check and --deadline-check need no traces. --synthetic N
+// replays N events of synthetic motion as one more trace, so the modes that
+// replay traces can run without captured ones
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "async_logger.h"
+#include "cursor_animator.h"
+#include "cursor_scaler.h"
+#include "cursor_set_cache.h"
+#include "cursor_snapshot.h"
+#include "cursor_swap_scheduler.h"
+#include "deadline_scheduler.h"
+#include "diagnostic_ring.h"
+#include "event_loop.h"
+#include "gesture_engine.h"
+#include "headless_platform.h"
+#include "latency_histogram.h"
+#include "monotonic_clock.h"
+#include "mouse_trace.h"
+#include "multi_stream_detector.h"
+#include "rcu_pointer.h"
+#include "runtime_config.h"
+#include "sample_worker.h"
+#include "spotlight.h"
+#include "spsc_ring.h"
+#include "startup_profile.h"
+#include "synthetic_motion.h"
+#include "trace_replay.h"
+
+namespace {
+
+struct Options {
+  ShakeParams shake_params = DefaultRuntimeConfig().shake;
+  EnlargeTiming timing = DefaultRuntimeConfig().timing;
+  GestureOptions gesture_options = DefaultGestureOptions();
+  int repeat = 1;
+  size_t streams = 0;  // 0 replays each trace on its own
+  uint64_t stream_samples = 0;  // Most samples per stream, 0 for all
+  uint64_t synthetic_events = 0;
+  size_t gestures = 0;  // Most gestures in the gesture benchmark
+  uint64_t reload_stress_events = 0;
+  uint64_t ring_stress_events = 0;
+  uint64_t logger_messages = 0;  // Per producer thread
+  uint64_t latency_check_samples = 0;
+  uint64_t ring_check_records = 0;
+  uint64_t deadline_check_ops = 0;
+  uint64_t spotlight_updates = 0;
+  uint64_t restore_check_rounds = 0;
+  int scaler_repeat = 0;
+  size_t cursor_set_dpis = 0;
+  int cache_startup_runs = 0;
+  uint64_t wake_rounds = 0;
+  uint64_t detector_events = 0;  // Per window size in the detector benchmark
+  uint64_t high_rate_samples = 0;
+  bool poll_sim = false;
+  bool startup = false;
+  bool swap_check = false;
+  bool frame_check = false;
+  AdaptivePollParams poll_params = {10 * 1000LL, 100 * 1000LL, 1000 * 1000LL};
+  bool print_times = false;
+  std::vector<std::string> paths;
+};
+
+void PrintUsage() {
+  std::cerr
+      << "Usage: trace_replay [options] trace...\n"
+         "  --synthetic N        Replay N events of synthetic motion as one\n"
+         "                       more trace\n"
+         "  --history N          Movements in the detector window (10)\n"
+         "  --changes N          Minimum direction changes (5)\n"
+         "  --speed F            Minimum average speed in pixels/second (800)\n"
+         "  --window-ms N        Maximum window duration (500)\n"
+         "  --interval-us N      Minimum sample interval (1000)\n"
+         "  --enlarge-ms N       Enlarged time after the last shake (500)\n"
+         "  --max-enlarge-ms N   Longest enlargement while shaking (5000)\n"
+         "  --cooldown-ms N      Cooldown after a restore (300)\n"
+         "  --circle             Enlarge on drawn circles as well as shakes\n"
+         "  --repeat N           Replay each trace N times for timing (1)\n"
+         "  --streams N          Replay the traces as 1, 10, 100 and so on\n"
+         "                       up to N concurrent streams through one\n"
+         "                       multi-stream detector\n"
+         "  --stream-samples N   Replay at most N samples of each stream\n"
+         "  --bench-detector N   Time N synthetic movements through the\n"
+         "                       detector with 10 to 1024 movement windows\n"
+         "                       and check it against a full rescan\n"
+         "  --bench-8khz N       Time N synthetic 8 kHz samples through the\n"
+         "                       detector with and without coalescing and\n"
+         "                       compare the shakes found with 2 kHz\n"
+         "  --gestures N         Time 1 to N gestures sharing one gesture\n"
+         "                       engine against one detector per gesture\n"
+         "  --logger-stress N    Log N messages from each of 4 threads and\n"
+         "                       check the log for lost or reordered lines\n"
+         "  --latency-check N    Check the latency histogram and time the\n"
+         "                       latency probes on N synthetic samples\n"
+         "  --deadline-check N   Check the deadline scheduler's cases and N\n"
+         "                       random operations against a reference\n"
+         "  --shm-ring-check N   Write N records to a diagnostic ring in\n"
+         "                       shared memory while a reader follows it\n"
+         "  --reload-stress N    Post N synthetic events to the sample worker\n"
+         "                       while another thread reloads the config\n"
+         "  --ring-stress N      Pass N samples through the sample ring and\n"
+         "                       the sample worker and check their order,\n"
+         "                       drops and wakeups\n"
+         "  --spotlight N        Time N spotlight overlay updates at 4K and\n"
+         "                       8K and check the overlay pixels\n"
+         "  --restore-check N    Run N random enlarge and exit sequences on\n"
+         "                       a fake cursor table and check the restore\n"
+         "  --swap-check         Check the system cursor calls each enlarge,\n"
+         "                       shape change, frame and restore costs\n"
+         "  --frame-check        Check the animation frame schedule, grow\n"
+         "                       and shrink reversals included\n"
+         "  --scaler N           Time scaling cursors N times with every\n"
+         "                       kernel the CPU runs and check their pixels\n"
+         "  --cursor-sets N      Time building cursor sets for 1 to N monitor\n"
+         "                       DPIs on 1 to 4 threads and check the updates\n"
+         "  --cache-startup N    Time N startups rendering the cursors, from\n"
+         "                       a cold disk cache and from a warm one\n"
+         "  --startup            Profile the portable startup phases\n"
+         "  --wake-latency N     Time N input and N deadline wakeups of the\n"
+         "                       event loop and check each wake reason\n"
+         "  --poll-sim           Compare fixed and adaptive polling\n"
+         "  --poll-ms N          Polling interval while moving (10)\n"
+         "  --idle-poll-ms N     Longest polling interval when still (100)\n"
+         "  --idle-after-ms N    Stillness before polling slows down (1000)\n"
+         "  --times              Print the trace time of every enlargement\n";
+}
+
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--times") {
+      options->print_times = true;
+      continue;
+    }
+    if (arg == "--circle") {
+      options->gesture_options.circle = true;
+      continue;
+    }
+    if (arg == "--poll-sim") {
+      options->poll_sim = true;
+      continue;
+    }
+    if (arg == "--startup") {
+      options->startup = true;
+      continue;
+    }
+    if (arg == "--swap-check") {
+      options->swap_check = true;
+      continue;
+    }
+    if (arg == "--frame-check") {
+      options->frame_check = true;
+      continue;
+    }
+    if (arg.rfind("--", 0) != 0) {
+      options->paths.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* value = argv[++i];
+    if (arg == "--history") {
+      options->shake_params.history_size = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--changes") {
+      options->shake_params.min_direction_changes = std::atoi(value);
+    } else if (arg == "--speed") {
+      options->shake_params.min_movement_speed = std::strtod(value, nullptr);
+    } else if (arg == "--window-ms") {
+      options->shake_params.max_time_window_us = std::atoll(value) * 1000;
+    } else if (arg == "--interval-us") {
+      options->shake_params.min_sample_interval_us = std::atoll(value);
+    } else if (arg == "--enlarge-ms") {
+      options->timing.enlarge_duration_us = std::atoll(value) * 1000;
+    } else if (arg == "--max-enlarge-ms") {
+      options->timing.max_enlarge_duration_us = std::atoll(value) * 1000;
+    } else if (arg == "--cooldown-ms") {
+      options->timing.cooldown_us = std::atoll(value) * 1000;
+    } else if (arg == "--repeat") {
+      options->repeat = std::atoi(value);
+    } else if (arg == "--synthetic") {
+      options->synthetic_events = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--streams") {
+      options->streams = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--stream-samples") {
+      options->stream_samples = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--gestures") {
+      options->gestures = std::strtoull(value, nullptr, 10);
+      if (options->gestures > GestureEngine::kMaxGestures) return false;
+    } else if (arg == "--bench-detector") {
+      options->detector_events = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--bench-8khz") {
+      options->high_rate_samples = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--reload-stress") {
+      options->reload_stress_events = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--ring-stress") {
+      options->ring_stress_events = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--logger-stress") {
+      options->logger_messages = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--latency-check") {
+      options->latency_check_samples = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--deadline-check") {
+      options->deadline_check_ops = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--shm-ring-check") {
+      options->ring_check_records = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--spotlight") {
+      options->spotlight_updates = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--restore-check") {
+      options->restore_check_rounds = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--scaler") {
+      options->scaler_repeat = std::atoi(value);
+    } else if (arg == "--cache-startup") {
+      options->cache_startup_runs = std::atoi(value);
+    } else if (arg == "--cursor-sets") {
+      options->cursor_set_dpis = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--wake-latency") {
+      options->wake_rounds = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--poll-ms") {
+      options->poll_params.fast_interval_us = std::atoll(value) * 1000;
+    } else if (arg == "--idle-poll-ms") {
+      options->poll_params.slow_interval_us = std::atoll(value) * 1000;
+    } else if (arg == "--idle-after-ms") {
+      options->poll_params.idle_after_us = std::atoll(value) * 1000;
+    } else {
+      return false;
+    }
+  }
+  return (!options->paths.empty() || options->synthetic_events > 0 ||
+          options->reload_stress_events > 0 ||
+          options->ring_stress_events > 0 || options->logger_messages > 0 ||
+          options->latency_check_samples > 0 ||
+          options->ring_check_records > 0 ||
+          options->deadline_check_ops > 0 ||
+          options->spotlight_updates > 0 ||
+          options->restore_check_rounds > 0 ||
+          options->scaler_repeat > 0 || options->cursor_set_dpis > 0 ||
+          options->cache_startup_runs > 0 || options->startup ||
+          options->swap_check || options->frame_check ||
+          options->wake_rounds > 0 || options->detector_events > 0 ||
+          options->high_rate_samples > 0) &&
+         options->repeat > 0 &&
+         options->poll_params.fast_interval_us > 0 &&
+         options->poll_params.slow_interval_us >=
+             options->poll_params.fast_interval_us;
+}
+
+double WakeupsPerHour(const ReplayResult& result) {
+  double hours =
+      static_cast<double>(result.end_time_us - result.start_time_us) / 3.6e9;
+  return hours > 0 ? static_cast<double>(result.sample_count) / hours : 0.0;
+}
+
+// Replays each trace through polling mode at the fixed fast interval and
+// with the adaptive schedule, and reports the wakeups each costs and how much
+// later the adaptive schedule detects each shake. An adaptive enlargement
+// more than kMatchWindowUs after a fixed one counts as missed. Fails if the
+// adaptive schedule misses a shake or wakes up more often than the fixed one
+int SimulatePolling(const Options& options) {
+  constexpr int64_t kMatchWindowUs = 1000 * 1000;
+  TraceReplay replay(options.shake_params, options.gesture_options,
+                     options.timing);
+  AdaptivePollParams fixed = options.poll_params;
+  fixed.slow_interval_us = fixed.fast_interval_us;
+
+  int failures = 0;
+  for (const std::string& path : options.paths) {
+    MouseTraceReader trace;
+    if (!trace.Open(path)) {
+      std::cerr << path << ": not a readable mouse trace" << std::endl;
+      ++failures;
+      continue;
+    }
+    ReplayResult baseline = replay.RunPolled(trace, fixed);
+    ReplayResult adaptive = replay.RunPolled(trace, options.poll_params);
+
+    // Both lists are in time order, so they are matched in one pass
+    std::vector<int64_t> delays_us;
+    size_t missed = 0;
+    size_t j = 0;
+    for (int64_t time_us : baseline.enlarge_times_us) {
+      while (j < adaptive.enlarge_times_us.size() &&
+             adaptive.enlarge_times_us[j] < time_us) {
+        ++j;
+      }
+      if (j < adaptive.enlarge_times_us.size() &&
+          adaptive.enlarge_times_us[j] - time_us <= kMatchWindowUs) {
+        delays_us.push_back(adaptive.enlarge_times_us[j] - time_us);
+        ++j;
+      } else {
+        ++missed;
+      }
+    }
+    std::sort(delays_us.begin(), delays_us.end());
+    double mean_ms = 0.0;
+    for (int64_t delay_us : delays_us) {
+      mean_ms += static_cast<double>(delay_us) / 1000.0;
+    }
+    if (!delays_us.empty()) mean_ms /= static_cast<double>(delays_us.size());
+
+    std::cout << path << ": " << std::fixed << std::setprecision(1)
+              << static_cast<double>(adaptive.end_time_us -
+                                     adaptive.start_time_us) / 1e6
+              << " s\n" << std::setprecision(0)
+              << "  fixed " << fixed.fast_interval_us / 1000 << " ms:      "
+              << WakeupsPerHour(baseline) << " wakeups/hour, "
+              << baseline.enlarge_count << " enlargements\n"
+              << "  adaptive " << fixed.fast_interval_us / 1000 << "-"
+              << options.poll_params.slow_interval_us / 1000 << " ms: "
+              << WakeupsPerHour(adaptive) << " wakeups/hour, "
+              << adaptive.enlarge_count << " enlargements\n"
+              << std::setprecision(1) << "  detection delay: mean " << mean_ms
+              << " ms, p95 "
+              << (delays_us.empty()
+                      ? 0.0
+                      : static_cast<double>(
+                            delays_us[delays_us.size() * 95 / 100]) /
+                            1000.0)
+              << " ms, max "
+              << (delays_us.empty()
+                      ? 0.0
+                      : static_cast<double>(delays_us.back()) / 1000.0)
+              << " ms, " << missed << " missed" << std::defaultfloat
+              << std::endl;
+    if (missed > 0 || adaptive.sample_count > baseline.sample_count) {
+      ++failures;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+// Replays stream_count streams, stream i replaying trace i modulo the trace
+// count, interleaved through one MultiStreamDetector. Streams replaying the
+// same trace must enlarge the same number of times, here and in every other
+// stream count; trace_enlargements holds that number per trace once seen.
+// Returns false if a stream differs
+bool ReplayStreamCount(
+    const Options& options,
+    const std::vector<std::unique_ptr<MouseTraceReader>>& traces,
+    size_t stream_count, std::vector<uint64_t>* trace_enlargements) {
+  constexpr size_t kChunkSize = 16;     // Samples taken from a stream a turn
+  constexpr size_t kFlushSize = 4096;  // Samples handed to the detector
+  constexpr uint64_t kNotSeen = ~0ull;
+  std::vector<StreamSample> batch;
+  batch.reserve(kFlushSize + kChunkSize);
+  std::unique_ptr<bool[]> decisions(new bool[kFlushSize + kChunkSize]);
+
+  uint64_t sample_count = 0;
+  uint64_t enlarge_count = 0;
+  size_t bytes_per_stream = 0;
+  size_t mismatched_streams = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < options.repeat; ++run) {
+    MultiStreamDetector detector(options.shake_params, stream_count);
+    bytes_per_stream = detector.bytes_per_stream();
+    std::vector<EnlargeStateMachine> state_machines(
+        stream_count, EnlargeStateMachine(options.timing));
+    std::vector<MouseTraceDecoder> decoders;
+    for (size_t s = 0; s < stream_count; ++s) {
+      decoders.push_back(traces[s % traces.size()]->Decoder());
+    }
+    std::vector<uint64_t> left(
+        stream_count,
+        options.stream_samples > 0 ? options.stream_samples : ~0ull);
+    std::vector<uint64_t> stream_enlargements(stream_count, 0);
+
+    auto flush = [&] {
+      detector.Process(batch.data(), batch.size(), decisions.get());
+      for (size_t i = 0; i < batch.size(); ++i) {
+        const StreamSample& sample = batch[i];
+        if (state_machines[sample.stream].OnDetection(
+                decisions[i], sample.timestamp_us) ==
+            EnlargeStateMachine::Action::kEnlarge) {
+          ++enlarge_count;
+          ++stream_enlargements[sample.stream];
+        }
+      }
+      sample_count += batch.size();
+      batch.clear();
+    };
+
+    std::vector<bool> finished(stream_count, false);
+    size_t active = stream_count;
+    MouseSample chunk[kChunkSize];
+    while (active > 0) {
+      for (size_t s = 0; s < stream_count; ++s) {
+        if (finished[s]) continue;
+        size_t count = decoders[s].Read(
+            chunk, static_cast<size_t>(std::min<uint64_t>(kChunkSize,
+                                                          left[s])));
+        left[s] -= count;
+        if (count == 0) {
+          finished[s] = true;
+          --active;
+          continue;
+        }
+        for (size_t i = 0; i < count; ++i) {
+          batch.push_back({static_cast<uint32_t>(s), chunk[i].x, chunk[i].y,
+                           chunk[i].timestamp_us});
+        }
+        if (batch.size() >= kFlushSize) flush();
+      }
+    }
+    flush();
+
+    for (size_t s = 0; s < stream_count; ++s) {
+      uint64_t& expected = (*trace_enlargements)[s % traces.size()];
+      if (expected == kNotSeen) expected = stream_enlargements[s];
+      if (stream_enlargements[s] != expected) ++mismatched_streams;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  double rate = elapsed.count() > 0
+                    ? static_cast<double>(sample_count) / elapsed.count()
+                    : 0.0;
+  std::cout << stream_count << " streams: "
+            << sample_count / options.repeat << " samples, "
+            << enlarge_count / options.repeat << " enlargements, "
+            << std::fixed << std::setprecision(1) << rate / 1e6
+            << " M events/s, " << bytes_per_stream << " bytes/stream, "
+            << mismatched_streams << " mismatched streams"
+            << std::defaultfloat << std::endl;
+  return mismatched_streams == 0;
+}
+
+// Sweeps 1, 10, 100 and so on up to options.streams streams
+int ReplayStreams(const Options& options) {
+  std::vector<std::unique_ptr<MouseTraceReader>> traces;
+  for (const std::string& path : options.paths) {
+    traces.push_back(std::make_unique<MouseTraceReader>());
+    if (!traces.back()->Open(path)) {
+      std::cerr << path << ": not a readable mouse trace" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<uint64_t> trace_enlargements(traces.size(), ~0ull);
+  int failures = 0;
+  size_t stream_count = 1;
+  while (true) {
+    if (!ReplayStreamCount(options, traces, stream_count,
+                           &trace_enlargements)) {
+      ++failures;
+    }
+    if (stream_count >= options.streams) break;
+    stream_count = std::min(stream_count * 10, options.streams);
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+// Gesture i of the benchmark: shakes, circles and flicks in turn, each copy
+// with slightly stricter thresholds so no two are the same test
+Gesture BenchmarkGesture(const ShakeParams& shake_params, size_t i) {
+  double stricter = 1.0 + 0.01 * static_cast<double>(i / 3);
+  switch (i % 3) {
+    case 0: {
+      ShakeParams params = shake_params;
+      params.min_movement_speed *= stricter;
+      return ShakeGesture(params);
+    }
+    case 1:
+      return CircleGesture({1024, 1000 * 1000, 0.9 * stricter, 300.0, 2});
+    default:
+      return FlickGesture({256, 150 * 1000, 300.0 * stricter, 0.9});
+  }
+}
+
+// Replays the traces through one GestureEngine with 1, 2, 4, ... gestures
+// and, for comparison, through one ShakeDetector per gesture, and reports
+// the cost per sample of each. The engine's shake decisions are checked
+// against ShakeDetector's on the way
+int BenchmarkGestures(const Options& options) {
+  // The traces run back to back, each shifted to start after the last
+  std::vector<MouseSample> samples;
+  for (const std::string& path : options.paths) {
+    MouseTraceReader trace;
+    if (!trace.Open(path)) {
+      std::cerr << path << ": not a readable mouse trace" << std::endl;
+      return 1;
+    }
+    MouseTraceDecoder decoder = trace.Decoder();
+    MouseSample batch[256];
+    size_t count;
+    int64_t shift = 0;
+    bool first = true;
+    while ((count = decoder.Read(batch, 256)) > 0) {
+      if (first && !samples.empty()) {
+        shift = samples.back().timestamp_us + 1000 - batch[0].timestamp_us;
+      }
+      first = false;
+      for (size_t i = 0; i < count; ++i) {
+        batch[i].timestamp_us += shift;
+        samples.push_back(batch[i]);
+      }
+    }
+  }
+  if (samples.empty()) return 1;
+
+  uint64_t mismatches = 0;
+  uint64_t matched[3] = {};
+  {
+    GestureEngine engine(options.shake_params.min_sample_interval_us);
+    for (size_t i = 0; i < 3; ++i) {
+      engine.Register(BenchmarkGesture(options.shake_params, i));
+    }
+    ShakeDetector detector(options.shake_params);
+    for (const MouseSample& sample : samples) {
+      uint32_t matches =
+          engine.AddSample(sample.x, sample.y, sample.timestamp_us);
+      bool shaking =
+          detector.AddSample(sample.x, sample.y, sample.timestamp_us);
+      mismatches += ((matches & 1) != 0) != shaking;
+      for (size_t g = 0; g < 3; ++g) matched[g] += (matches >> g) & 1;
+    }
+  }
+  std::cout << samples.size() << " samples; samples matching: " << matched[0]
+            << " shake, " << matched[1] << " circle, " << matched[2]
+            << " flick; " << mismatches
+            << " shake decisions differ from ShakeDetector\n"
+            << "gestures  engine ns/sample  detectors ns/sample\n";
+
+  uint64_t checksum = 0;
+  for (size_t n = 1; n <= options.gestures; n *= 2) {
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < options.repeat; ++run) {
+      GestureEngine engine(options.shake_params.min_sample_interval_us);
+      for (size_t i = 0; i < n; ++i) {
+        engine.Register(BenchmarkGesture(options.shake_params, i));
+      }
+      for (const MouseSample& sample : samples) {
+        checksum += engine.AddSample(sample.x, sample.y, sample.timestamp_us);
+      }
+    }
+    std::chrono::duration<double, std::nano> engine_time =
+        std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < options.repeat; ++run) {
+      std::vector<ShakeDetector> detectors;
+      for (size_t i = 0; i < n; ++i) {
+        ShakeParams params = options.shake_params;
+        params.min_movement_speed *= 1.0 + 0.01 * static_cast<double>(i);
+        detectors.emplace_back(params);
+      }
+      for (const MouseSample& sample : samples) {
+        for (ShakeDetector& detector : detectors) {
+          checksum +=
+              detector.AddSample(sample.x, sample.y, sample.timestamp_us);
+        }
+      }
+    }
+    std::chrono::duration<double, std::nano> detectors_time =
+        std::chrono::steady_clock::now() - start;
+
+    double total = static_cast<double>(samples.size()) * options.repeat;
+    std::cout << std::setw(8) << n << std::fixed << std::setprecision(1)
+              << std::setw(18) << engine_time.count() / total << std::setw(21)
+              << detectors_time.count() / total << std::defaultfloat << '\n';
+    if (n == options.gestures) break;
+    if (n * 2 > options.gestures) n = options.gestures / 2;
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
+
+// The detector before it kept running sums: every movement rescans the
+// whole window. Kept as the reference the incremental detector must match
+class RescanDetector {
+ public:
+  explicit RescanDetector(const ShakeParams& params) : params_(params) {}
+
+  bool AddMovement(int dx, int dy, int64_t dt) {
+    history_.push_back({dx, dy, dt});
+    if (history_.size() > params_.history_size) history_.pop_front();
+    if (history_.size() < params_.history_size) return false;
+
+    int direction_changes = 0;
+    double total_speed = 0.0;
+    int64_t total_time = 0;
+    int last_x_dir = 0;
+    int last_y_dir = 0;
+    for (const Movement& movement : history_) {
+      int x_dir = (movement.dx > 0) ? 1 : (movement.dx < 0) ? -1 : 0;
+      int y_dir = (movement.dy > 0) ? 1 : (movement.dy < 0) ? -1 : 0;
+      if (last_x_dir != 0 && x_dir != 0 && last_x_dir != x_dir) {
+        direction_changes++;
+      }
+      if (last_y_dir != 0 && y_dir != 0 && last_y_dir != y_dir) {
+        direction_changes++;
+      }
+      last_x_dir = x_dir;
+      last_y_dir = y_dir;
+
+      double distance =
+          std::sqrt(movement.dx * movement.dx + movement.dy * movement.dy);
+      total_speed += (movement.dt > 0)
+                         ? (distance / static_cast<double>(movement.dt)) *
+                               1000000.0
+                         : 0;
+      total_time += movement.dt;
+    }
+    if (total_time > params_.max_time_window_us) return false;
+    double avg_speed = total_speed / static_cast<double>(history_.size());
+    return direction_changes >= params_.min_direction_changes &&
+           avg_speed >= params_.min_movement_speed;
+  }
+
+ private:
+  struct Movement {
+    int dx;
+    int dy;
+    int64_t dt;
+  };
+
+  ShakeParams params_;
+  std::deque<Movement> history_;
+};
+
+// Times the detector and the gesture engine's shake per movement for
+// windows of 10 to 1024 movements against a full rescan of the window, and
+// checks that all three decide the same on every movement. The window
+// duration and direction changes grow with the window so the shakes in the
+// synthetic motion are still detected
+int BenchmarkDetector(const Options& options) {
+  // Synthetic motion coalesced the way AddSample() does
+  std::vector<int> dxs;
+  std::vector<int> dys;
+  std::vector<int64_t> dts;
+  SyntheticMotion motion;
+  MouseSample last = motion.Next();
+  while (dts.size() < options.detector_events) {
+    MouseSample sample = motion.Next();
+    int64_t dt = sample.timestamp_us - last.timestamp_us;
+    if (dt < options.shake_params.min_sample_interval_us) continue;
+    dxs.push_back(sample.x - last.x);
+    dys.push_back(sample.y - last.y);
+    dts.push_back(dt);
+    last = sample;
+  }
+
+  std::cout << "history  incremental ns/event  engine ns/event  "
+               "rescan ns/event  shakes\n";
+  uint64_t mismatches = 0;
+  const size_t base_size =
+      std::max<size_t>(options.shake_params.history_size, 1);
+  for (size_t size = 10; size <= 1024; size = size < 16 ? 16 : size * 2) {
+    ShakeParams params = options.shake_params;
+    params.history_size = size;
+    params.max_time_window_us = static_cast<int64_t>(
+        options.shake_params.max_time_window_us * size / base_size);
+    params.min_direction_changes = static_cast<int>(
+        options.shake_params.min_direction_changes * size / base_size);
+
+    std::vector<uint8_t> decisions(dts.size());
+    ShakeDetector detector(params);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < dts.size(); ++i) {
+      decisions[i] = detector.AddMovement(dxs[i], dys[i], dts[i]);
+    }
+    std::chrono::duration<double, std::nano> incremental_time =
+        std::chrono::steady_clock::now() - start;
+
+    std::vector<uint8_t> engine_decisions(dts.size());
+    GestureEngine engine(params.min_sample_interval_us);
+    engine.Register(ShakeGesture(params));
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < dts.size(); ++i) {
+      engine_decisions[i] =
+          static_cast<uint8_t>(engine.AddMovement(dxs[i], dys[i], dts[i]));
+    }
+    std::chrono::duration<double, std::nano> engine_time =
+        std::chrono::steady_clock::now() - start;
+
+    RescanDetector rescan(params);
+    uint64_t shakes = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < dts.size(); ++i) {
+      bool shaking = rescan.AddMovement(dxs[i], dys[i], dts[i]);
+      shakes += shaking;
+      mismatches += shaking != (decisions[i] != 0);
+      mismatches += shaking != (engine_decisions[i] != 0);
+    }
+    std::chrono::duration<double, std::nano> rescan_time =
+        std::chrono::steady_clock::now() - start;
+
+    double total = static_cast<double>(dts.size());
+    std::cout << std::setw(7) << size << std::fixed << std::setprecision(1)
+              << std::setw(22) << incremental_time.count() / total
+              << std::setw(17) << engine_time.count() / total
+              << std::setw(17) << rescan_time.count() / total
+              << std::defaultfloat << std::setw(8) << shakes << '\n';
+  }
+  std::cout << mismatches << " decisions differ from the rescan"
+            << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
+
+// The detector before microsecond timestamps: intervals in whole
+// milliseconds, and a sample less than a millisecond after the last one
+// returns false without being looked at
+class MillisecondDetector {
+ public:
+  explicit MillisecondDetector(const ShakeParams& params) : window_(params) {}
+
+  bool AddSample(int x, int y, int64_t timestamp_us) {
+    if (!has_last_sample_) {
+      last_x_ = x;
+      last_y_ = y;
+      last_time_us_ = timestamp_us;
+      has_last_sample_ = true;
+      return false;
+    }
+    int64_t dt_ms = (timestamp_us - last_time_us_) / 1000;
+    if (dt_ms <= 0) return false;
+    int dx = x - last_x_;
+    int dy = y - last_y_;
+    last_x_ = x;
+    last_y_ = y;
+    last_time_us_ = timestamp_us;
+    return window_.AddMovement(dx, dy, dt_ms * 1000);
+  }
+
+ private:
+  RescanDetector window_;
+  bool has_last_sample_ = false;
+  int last_x_ = 0;
+  int last_y_ = 0;
+  int64_t last_time_us_ = 0;
+};
+
+// Synthetic motion and where its shakes are
+struct SyntheticTrace {
+  std::vector<MouseSample> samples;
+  std::vector<uint8_t> shaking;
+};
+
+SyntheticTrace MakeSyntheticTrace(int substeps, size_t count) {
+  SyntheticTrace trace;
+  SyntheticMotion motion(substeps);
+  for (size_t i = 0; i < count; ++i) {
+    trace.samples.push_back(motion.Next());
+    trace.shaking.push_back(motion.shaking());
+  }
+  return trace;
+}
+
+struct HighRateResult {
+  double ns_per_sample;
+  size_t shakes;        // Shakes in the motion
+  size_t shakes_found;  // Shakes with a detection while they last
+  double mean_delay_ms;  // From the start of a shake to its first detection
+  size_t false_detections;  // Detections starting outside a shake
+};
+
+// Times detector over the trace and scores its decisions against the shakes
+template <typename Detector>
+HighRateResult RunHighRate(const SyntheticTrace& trace, Detector detector) {
+  const std::vector<MouseSample>& samples = trace.samples;
+  std::vector<uint8_t> decisions(samples.size());
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < samples.size(); ++i) {
+    decisions[i] =
+        detector.AddSample(samples[i].x, samples[i].y, samples[i].timestamp_us);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  HighRateResult result = {};
+  result.ns_per_sample = elapsed.count() / static_cast<double>(samples.size());
+  double delay_sum_ms = 0.0;
+  int64_t shake_start_us = 0;
+  bool found = false;
+  bool detected = false;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    bool shaking = trace.shaking[i] != 0;
+    if (shaking && (i == 0 || trace.shaking[i - 1] == 0)) {
+      ++result.shakes;
+      shake_start_us = samples[i].timestamp_us;
+      found = false;
+    }
+    bool rising = decisions[i] != 0 && !detected;
+    detected = decisions[i] != 0;
+    if (!rising) continue;
+    if (!shaking) {
+      ++result.false_detections;
+    } else if (!found) {
+      found = true;
+      ++result.shakes_found;
+      delay_sum_ms +=
+          static_cast<double>(samples[i].timestamp_us - shake_start_us) / 1e3;
+    }
+  }
+  if (result.shakes_found > 0) {
+    result.mean_delay_ms =
+        delay_sum_ms / static_cast<double>(result.shakes_found);
+  }
+  return result;
+}
+
+void PrintHighRate(const char* name, const HighRateResult& result) {
+  std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(9) << result.ns_per_sample
+            << std::setw(7) << result.shakes_found << "/" << std::left
+            << std::setw(5) << result.shakes << std::right << std::setw(10)
+            << result.mean_delay_ms << std::defaultfloat << std::setw(8)
+            << result.false_detections << '\n';
+}
+
+// Runs synthetic motion at 8 kHz through the detector as it is, with every
+// sample its own movement, and as it was with millisecond intervals, next to
+// the same path at 2 kHz. Fails if coalescing at 8 kHz finds fewer shakes or
+// more false ones than 2 kHz
+int BenchmarkHighRate(const Options& options) {
+  constexpr int kSubsteps = 4;  // 2 kHz to 8 kHz
+  SyntheticTrace fast =
+      MakeSyntheticTrace(kSubsteps, options.high_rate_samples);
+  SyntheticTrace slow = MakeSyntheticTrace(
+      1, std::max<size_t>(options.high_rate_samples / kSubsteps, 1));
+  ShakeParams every_sample = options.shake_params;
+  every_sample.min_sample_interval_us = 0;
+
+  HighRateResult reference =
+      RunHighRate(slow, ShakeDetector(options.shake_params));
+  HighRateResult coalesced =
+      RunHighRate(fast, ShakeDetector(options.shake_params));
+  std::cout << "detector                  ns/sample  shakes found  delay ms"
+               "  false\n";
+  PrintHighRate("2 kHz, coalesced", reference);
+  PrintHighRate("8 kHz, coalesced", coalesced);
+  PrintHighRate("8 kHz, every sample",
+                RunHighRate(fast, ShakeDetector(every_sample)));
+  PrintHighRate("8 kHz, whole milliseconds",
+                RunHighRate(fast, MillisecondDetector(options.shake_params)));
+  std::cout.flush();
+  return coalesced.shakes_found >= reference.shakes_found &&
+                 coalesced.false_detections <= reference.false_detections
+             ? 0
+             : 1;
+}
+
+// Config file text for the given reload, cycling through a few thresholds
+// around base. A snapshot is only valid if it matches the text of its own
+// version, so a reader that sees a torn or freed snapshot notices
+std::string ReloadConfigText(const Options& options, uint64_t version) {
+  int step = static_cast<int>(version % 7);
+  std::ostringstream text;
+  text << "# reload " << version << "\n"
+       << "history_size = " << options.shake_params.history_size + step
+       << "\nmin_direction_changes = "
+       << options.shake_params.min_direction_changes + step % 3
+       << "\nmin_movement_speed = "
+       << options.shake_params.min_movement_speed + 50.0 * step
+       << "\nmax_time_window_ms = "
+       << options.shake_params.max_time_window_us / 1000 + 10 * step
+       << "\nenlarge_duration_ms = "
+       << options.timing.enlarge_duration_us / 1000 + step
+       << "\nrestore_cooldown_ms = "
+       << options.timing.cooldown_us / 1000 + step << "\n";
+  return text.str();
+}
+
+bool LoadReloadConfig(const Options& options, uint64_t version,
+                      RuntimeConfig* config) {
+  config->shake = options.shake_params;
+  config->timing = options.timing;
+  config->version = version;
+  std::string error;
+  return ParseRuntimeConfig(ReloadConfigText(options, version), config,
+                            &error);
+}
+
+bool SameConfig(const RuntimeConfig& a, const RuntimeConfig& b) {
+  return a.shake.history_size == b.shake.history_size &&
+         a.shake.min_direction_changes == b.shake.min_direction_changes &&
+         a.shake.min_movement_speed == b.shake.min_movement_speed &&
+         a.shake.max_time_window_us == b.shake.max_time_window_us &&
+         a.shake.min_sample_interval_us == b.shake.min_sample_interval_us &&
+         a.timing.enlarge_duration_us == b.timing.enlarge_duration_us &&
+         a.timing.max_enlarge_duration_us ==
+             b.timing.max_enlarge_duration_us &&
+         a.timing.cooldown_us == b.timing.cooldown_us &&
+         a.version == b.version;
+}
+
+// Runs detection on the sample worker as the app does in hook mode,
+// switching to the latest config snapshot once per batch
+class ReloadSink : public SampleSink {
+ public:
+  ReloadSink(const Options& options, RcuPointer<RuntimeConfig>* config)
+      : options_(options),
+        config_(config),
+        reader_(config->RegisterReader()),
+        detector_(options.shake_params, options.gesture_options),
+        state_machine_(options.timing) {}
+
+  void OnSamples(const MouseSample* samples, size_t count) override {
+    config_->Enter(reader_);
+    const RuntimeConfig* config = config_->Read();
+    if (config->version != applied_version_) {
+      RuntimeConfig expected;
+      if (config->version < applied_version_ ||
+          !LoadReloadConfig(options_, config->version, &expected) ||
+          !SameConfig(*config, expected)) {
+        violations_.fetch_add(1);
+      }
+      detector_.Configure(config->shake);
+      state_machine_.set_timing(config->timing);
+      applied_version_ = config->version;
+      applied_count_.fetch_add(1);
+    }
+    RuntimeConfig entered = *config;
+    // Give up the core inside the section now and then, so the writer runs
+    // while the snapshot is in use even on one core
+    if (++batch_count_ % 16 == 0) std::this_thread::yield();
+    for (size_t i = 0; i < count; ++i) {
+      MouseMoveDetector::Gestures gestures = detector_.AddSample(
+          samples[i].x, samples[i].y, samples[i].timestamp_us);
+      bool shaking = gestures.enlarge();
+      if (state_machine_.OnDetection(shaking, samples[i].timestamp_us) ==
+          EnlargeStateMachine::Action::kEnlarge) {
+        ++enlarge_count_;
+      }
+      state_machine_.Tick(samples[i].timestamp_us);
+    }
+    // The snapshot must not change while the section is open
+    if (!SameConfig(*config, entered)) violations_.fetch_add(1);
+    config_->Leave(reader_);
+    processed_.fetch_add(count);
+  }
+
+  Clock::time_point OnWake(Clock::time_point) override {
+    return Clock::time_point::max();
+  }
+
+  uint64_t processed() const { return processed_.load(); }
+  uint64_t applied_count() const { return applied_count_.load(); }
+  uint64_t violations() const { return violations_.load(); }
+  uint64_t enlarge_count() const { return enlarge_count_; }
+
+ private:
+  const Options& options_;
+  RcuPointer<RuntimeConfig>* config_;
+  RcuPointer<RuntimeConfig>::ReaderId reader_;
+  MouseMoveDetector detector_;
+  EnlargeStateMachine state_machine_;
+  uint64_t applied_version_ = 0;
+  uint64_t enlarge_count_ = 0;
+  uint64_t batch_count_ = 0;
+  std::atomic<uint64_t> processed_{0};
+  std::atomic<uint64_t> applied_count_{0};
+  std::atomic<uint64_t> violations_{0};
+};
+
+// Checks that a config cannot set a sample interval that would grow the
+// gesture windows without bound. Returns the number of problems found
+int CheckIntervalBounds() {
+  int problems = 0;
+  RuntimeConfig config = DefaultRuntimeConfig();
+  std::string error;
+  if (ParseRuntimeConfig("min_sample_interval_us = 0\n", &config, &error) ||
+      config.shake.min_sample_interval_us !=
+          DefaultRuntimeConfig().shake.min_sample_interval_us) {
+    ++problems;
+  }
+  if (!ParseRuntimeConfig("min_sample_interval_us = 10\n", &config,
+                          &error) ||
+      config.shake.min_sample_interval_us != kMinSampleIntervalUs) {
+    ++problems;
+  }
+  if (!ParseRuntimeConfig("min_sample_interval_us = 250\n", &config,
+                          &error) ||
+      config.shake.min_sample_interval_us != 250) {
+    ++problems;
+  }
+  return problems;
+}
+
+// Feeds synthetic events through the sample worker while a second thread
+// publishes new config snapshots as fast as it can. Fails if the detector
+// ever sees a snapshot other than a whole, published one, or if replaced
+// snapshots are not all freed once the reader is idle, or if a config can
+// set a sample interval below kMinSampleIntervalUs
+int StressReload(const Options& options) {
+  int bound_problems = CheckIntervalBounds();
+  auto initial = std::make_unique<RuntimeConfig>();
+  initial->shake = options.shake_params;
+  initial->timing = options.timing;
+  if (!LoadReloadConfig(options, 0, initial.get())) {
+    std::cerr << "Invalid detector options" << std::endl;
+    return 1;
+  }
+  RcuPointer<RuntimeConfig> config(std::move(initial));
+  ReloadSink sink(options, &config);
+  SampleWorker worker;
+  worker.Start(&sink);
+
+  std::atomic<bool> done{false};
+  uint64_t published = 0;
+  std::thread writer([&] {
+    while (!done.load()) {
+      auto next = std::make_unique<RuntimeConfig>();
+      LoadReloadConfig(options, published + 1, next.get());
+      config.Publish(std::move(next));
+      ++published;
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  SyntheticMotion motion;
+  for (uint64_t i = 0; i < options.reload_stress_events; ++i) {
+    MouseSample sample = motion.Next();
+    while (!worker.Post(sample)) std::this_thread::yield();
+  }
+  while (sink.processed() < options.reload_stress_events) {
+    std::this_thread::yield();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  done.store(true);
+  writer.join();
+  worker.Stop();
+  size_t retired = config.Reclaim();
+
+  double rate = elapsed.count() > 0
+                    ? static_cast<double>(options.reload_stress_events) /
+                          elapsed.count()
+                    : 0.0;
+  std::cout << options.reload_stress_events << " events, " << published
+            << " reloads published, " << sink.applied_count()
+            << " applied, " << sink.enlarge_count() << " enlargements, "
+            << retired << " snapshots left, " << sink.violations()
+            << " violations, " << std::fixed << std::setprecision(1)
+            << rate / 1e6 << " M events/s" << std::defaultfloat << std::endl;
+  std::cout << "Sample interval bounds: " << bound_problems << " problems"
+            << std::endl;
+  return sink.violations() == 0 && retired == 0 && bound_problems == 0 ? 0
+                                                                       : 1;
+}
+
+// Checks that samples arrive in the order posted, each at most once, and
+// counts the ones missing. Samples carry their sequence number as timestamp
+class SequenceCheck {
+ public:
+  void Check(const MouseSample* samples, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      int64_t sequence = samples[i].timestamp_us;
+      if (sequence < next_) {
+        ++out_of_order_;
+      } else {
+        missing_ += static_cast<uint64_t>(sequence - next_);
+        next_ = sequence + 1;
+      }
+    }
+    received_.fetch_add(count, std::memory_order_release);
+  }
+
+  uint64_t received() const {
+    return received_.load(std::memory_order_acquire);
+  }
+  // Samples missing out of the first count posted
+  uint64_t missing(uint64_t count) const {
+    int64_t end = static_cast<int64_t>(count);
+    return missing_ + static_cast<uint64_t>(end > next_ ? end - next_ : 0);
+  }
+  uint64_t out_of_order() const { return out_of_order_; }
+
+ private:
+  int64_t next_ = 0;
+  uint64_t missing_ = 0;
+  uint64_t out_of_order_ = 0;
+  std::atomic<uint64_t> received_{0};
+};
+
+class SequenceSink : public SampleSink {
+ public:
+  void OnSamples(const MouseSample* samples, size_t count) override {
+    check_.Check(samples, count);
+  }
+
+  // Only a posted sample may wake the worker, so a lost wakeup stalls
+  Clock::time_point OnWake(Clock::time_point) override {
+    return Clock::time_point::max();
+  }
+
+  const SequenceCheck& check() const { return check_; }
+
+ private:
+  SequenceCheck check_;
+};
+
+void PrintRate(const char* name, uint64_t events,
+               std::chrono::duration<double> elapsed) {
+  std::cout << name << ": " << std::fixed << std::setprecision(1)
+            << static_cast<double>(events) / elapsed.count() / 1e6
+            << " M samples/s" << std::defaultfloat << std::endl;
+}
+
+// Pushes N samples through the bare ring, retrying when it is full, and
+// through the sample worker twice: flat out, where a full ring drops
+// samples, and in bursts that each wait for the worker to drain the ring
+// and go back to sleep, where a lost wakeup leaves the burst unread. Fails
+// on any reordered, lost or unaccounted sample or any stalled burst
+int StressRing(const Options& options) {
+  constexpr auto kStallTimeout = std::chrono::seconds(1);
+  const uint64_t events = options.ring_stress_events;
+  bool ok = true;
+
+  {
+    auto ring = std::make_unique<
+        SpscRing<MouseSample, SampleWorker::kRingCapacity>>();
+    SequenceCheck check;
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&] {
+      std::mt19937 random(1);
+      MouseSample batch[SampleWorker::kBatchSize];
+      while (check.received() < events) {
+        size_t count =
+            ring->PopBatch(batch, 1 + random() % SampleWorker::kBatchSize);
+        if (count == 0) std::this_thread::yield();
+        check.Check(batch, count);
+      }
+    });
+    for (uint64_t i = 0; i < events; ++i) {
+      MouseSample sample = {0, 0, static_cast<int64_t>(i)};
+      while (!ring->TryPush(sample)) std::this_thread::yield();
+    }
+    consumer.join();
+    PrintRate("Ring", events, std::chrono::steady_clock::now() - start);
+    std::cout << "  " << check.out_of_order() << " out of order, "
+              << check.missing(events) << " lost" << std::endl;
+    ok = ok && check.out_of_order() == 0 && check.missing(events) == 0;
+  }
+
+  {
+    SequenceSink sink;
+    SampleWorker worker;
+    worker.Start(&sink);
+    uint64_t rejected = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < events; ++i) {
+      rejected += !worker.Post({0, 0, static_cast<int64_t>(i)});
+    }
+    // Nothing is posted after the last sample, so only its wakeup can
+    // drain the rest
+    auto posted = std::chrono::steady_clock::now();
+    bool stalled = false;
+    while (sink.check().received() + rejected < events) {
+      if (std::chrono::steady_clock::now() - posted > kStallTimeout) {
+        stalled = true;
+        break;
+      }
+      std::this_thread::yield();
+    }
+    PrintRate("Worker, flat out", events, posted - start);
+    worker.Stop();
+    const SequenceCheck& check = sink.check();
+    std::cout << "  " << rejected << " dropped (" << worker.dropped_count()
+              << " counted), " << check.missing(events) << " missing, "
+              << check.out_of_order() << " out of order"
+              << (stalled ? ", STALLED" : "") << std::endl;
+    ok = ok && !stalled && check.out_of_order() == 0 &&
+         check.missing(events) == rejected &&
+         worker.dropped_count() == rejected;
+  }
+
+  {
+    SequenceSink sink;
+    SampleWorker worker;
+    worker.Start(&sink);
+    std::mt19937 random(2);
+    uint64_t sequence = 0;
+    uint64_t bursts = 0;
+    uint64_t stalls = 0;
+    uint64_t rejected = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (sequence < events && stalls == 0) {
+      uint64_t burst =
+          std::min<uint64_t>(1 + random() % 64, events - sequence);
+      for (uint64_t i = 0; i < burst; ++i) {
+        rejected += !worker.Post({0, 0, static_cast<int64_t>(sequence++)});
+      }
+      ++bursts;
+      auto posted = std::chrono::steady_clock::now();
+      while (sink.check().received() + rejected < sequence) {
+        if (std::chrono::steady_clock::now() - posted > kStallTimeout) {
+          ++stalls;
+          break;
+        }
+        std::this_thread::yield();
+      }
+      // The next burst lands anywhere from before the worker looks at the
+      // ring again to well after it is asleep
+      for (uint32_t spin = random() % 2048; spin > 0; --spin) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      }
+    }
+    PrintRate("Worker, bursts", sequence,
+              std::chrono::steady_clock::now() - start);
+    worker.Stop();
+    const SequenceCheck& check = sink.check();
+    std::cout << "  " << bursts << " bursts, " << stalls << " stalled, "
+              << rejected << " dropped, " << check.missing(sequence)
+              << " missing, "
+              << check.out_of_order() << " out of order" << std::endl;
+    ok = ok && stalls == 0 && rejected == 0 &&
+         check.missing(sequence) == 0 && check.out_of_order() == 0;
+  }
+  return ok ? 0 : 1;
+}
+
+// Logs options.logger_messages messages from each of kProducers threads at
+// once and reads the log back. Every message must be written exactly once,
+// and each thread's in the order it logged them; a full queue is retried,
+// as a caller that must not lose the line would. Reports the time of each
+// Log() call
+int StressLogger(const Options& options) {
+  constexpr int kProducers = 4;
+  std::error_code error;
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path(error) /
+      ("trace_replay-logger-" +
+       std::to_string(
+           std::chrono::steady_clock::now().time_since_epoch().count()) +
+       ".log");
+  if (error) {
+    std::cerr << "No temporary directory for the log" << std::endl;
+    return 1;
+  }
+
+  const uint64_t messages = options.logger_messages;
+  LatencyHistogram call_ns;
+  std::atomic<uint64_t> retries{0};
+  uint64_t dropped = 0;
+  auto start = std::chrono::steady_clock::now();
+  {
+    AsyncLogger logger({path, 0, 0});
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < kProducers; ++producer) {
+      producers.emplace_back([&, producer] {
+        char message[32];
+        for (uint64_t i = 0; i < messages; ++i) {
+          int size = std::snprintf(message, sizeof(message), "p%d %llu",
+                                   producer,
+                                   static_cast<unsigned long long>(i));
+          for (;;) {
+            auto call_start = std::chrono::steady_clock::now();
+            bool logged =
+                logger.Log(std::string_view(message, static_cast<size_t>(
+                                                         size)));
+            call_ns.Record(std::chrono::duration_cast<
+                               std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - call_start)
+                               .count());
+            if (logged) break;
+            retries.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (std::thread& producer : producers) producer.join();
+    logger.Flush();
+    dropped = logger.dropped_count();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  // Lines are "<time> - p<producer> <index>"
+  uint64_t next[kProducers] = {};
+  uint64_t lines = 0;
+  uint64_t out_of_order = 0;
+  uint64_t malformed = 0;
+  {
+    std::ifstream in(path, std::ios::binary);
+    std::string line;
+    while (std::getline(in, line)) {
+      ++lines;
+      size_t at = line.find(" - p");
+      int producer = -1;
+      unsigned long long index = 0;
+      if (at == std::string::npos ||
+          std::sscanf(line.c_str() + at + 4, "%d %llu", &producer, &index) !=
+              2 ||
+          producer < 0 || producer >= kProducers) {
+        ++malformed;
+        continue;
+      }
+      if (index != next[producer]) ++out_of_order;
+      next[producer] = index + 1;
+    }
+  }
+  std::filesystem::remove(path, error);
+
+  uint64_t expected = messages * kProducers;
+  uint64_t missing = lines < expected ? expected - lines : 0;
+  double rate = elapsed.count() > 0
+                    ? static_cast<double>(expected) / elapsed.count()
+                    : 0.0;
+  std::cout << kProducers << " threads x " << messages << " messages: "
+            << std::fixed << std::setprecision(2) << rate / 1e6
+            << " M messages/s, " << retries.load() << " full-queue retries\n"
+            << "Log() call: mean " << std::setprecision(0) << call_ns.mean()
+            << " ns, p50 " << call_ns.ValueAtPercentile(50.0) << " ns, p99 "
+            << call_ns.ValueAtPercentile(99.0) << " ns, p99.9 "
+            << call_ns.ValueAtPercentile(99.9) << " ns, max "
+            << call_ns.max_value() << " ns\n"
+            << lines << " lines written, " << missing << " missing, "
+            << out_of_order << " out of order, " << malformed << " malformed"
+            << std::defaultfloat << std::endl;
+  return lines == expected && out_of_order == 0 && malformed == 0 &&
+                 dropped == retries.load()
+             ? 0
+             : 1;
+}
+
+// Timers whose callbacks log their id, for checking the order they run in
+class LoggedTimers {
+ public:
+  LoggedTimers(DeadlineScheduler* scheduler, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      ids_.push_back(scheduler->Add([this, i](int64_t now_us) {
+        ran_.push_back(i);
+        ran_at_us_.push_back(now_us);
+      }));
+    }
+  }
+
+  DeadlineScheduler::TimerId operator[](size_t i) const { return ids_[i]; }
+
+  // Timers run since the last call, in order
+  std::vector<size_t> TakeRan() {
+    std::vector<size_t> ran;
+    ran.swap(ran_);
+    ran_at_us_.clear();
+    return ran;
+  }
+
+  const std::vector<int64_t>& ran_at_us() const { return ran_at_us_; }
+
+ private:
+  std::vector<DeadlineScheduler::TimerId> ids_;
+  std::vector<size_t> ran_;
+  std::vector<int64_t> ran_at_us_;
+};
+
+// Arming, moving, cancelling and running timers, each checked against the
+// order they must run in. Returns the number of problems found
+int CheckDeadlineCases() {
+  using Ran = std::vector<size_t>;
+  int problems = 0;
+  auto expect = [&problems](bool ok) { problems += ok ? 0 : 1; };
+
+  {  // Arm: nothing runs before the deadline, then exactly once
+    DeadlineScheduler scheduler;
+    LoggedTimers timers(&scheduler, 1);
+    expect(scheduler.NextDeadline() == DeadlineScheduler::kNoDeadline);
+    scheduler.Arm(timers[0], 100);
+    expect(scheduler.armed(timers[0]) && scheduler.NextDeadline() == 100);
+    expect(scheduler.RunExpired(99) == 0);
+    expect(scheduler.RunExpired(150) == 1);
+    expect(timers.ran_at_us() == std::vector<int64_t>{150});
+    expect(timers.TakeRan() == Ran{0} && !scheduler.armed(timers[0]));
+    expect(scheduler.RunExpired(200) == 0);
+  }
+
+  {  // Moving earlier and later reorders the heap
+    DeadlineScheduler scheduler;
+    LoggedTimers timers(&scheduler, 3);
+    scheduler.Arm(timers[0], 100);
+    scheduler.Arm(timers[1], 200);
+    scheduler.Arm(timers[2], 300);
+    scheduler.Arm(timers[2], 50);
+    expect(scheduler.NextDeadline() == 50);
+    scheduler.Arm(timers[2], 400);
+    scheduler.Arm(timers[0], 250);
+    expect(scheduler.NextDeadline() == 200 &&
+           scheduler.deadline(timers[0]) == 250);
+    scheduler.Arm(timers[1], DeadlineScheduler::kNoDeadline);
+    expect(!scheduler.armed(timers[1]));
+    expect(scheduler.RunExpired(1000) == 2 && timers.TakeRan() == Ran{0, 2});
+  }
+
+  {  // Cancelling from the middle of the heap keeps the rest in order
+    constexpr size_t kTimers = 15;
+    DeadlineScheduler scheduler;
+    LoggedTimers timers(&scheduler, kTimers);
+    for (size_t i = 0; i < kTimers; ++i) {
+      scheduler.Arm(timers[i], static_cast<int64_t>((i * 7) % kTimers));
+    }
+    Ran expected;
+    for (int64_t deadline = 0; deadline < static_cast<int64_t>(kTimers);
+         ++deadline) {
+      for (size_t i = 0; i < kTimers; ++i) {
+        if (static_cast<int64_t>((i * 7) % kTimers) == deadline &&
+            i != 3 && i != 9) {
+          expected.push_back(i);
+        }
+      }
+    }
+    scheduler.Cancel(timers[3]);
+    scheduler.Cancel(timers[9]);
+    scheduler.Cancel(timers[9]);  // Already cancelled
+    expect(!scheduler.armed(timers[3]) && !scheduler.armed(timers[9]));
+    expect(scheduler.RunExpired(1000) == kTimers - 2 &&
+           timers.TakeRan() == expected);
+  }
+
+  {  // Equal deadlines run in registration order, however they were armed
+    DeadlineScheduler scheduler;
+    LoggedTimers timers(&scheduler, 5);
+    for (size_t i = 5; i-- > 0;) scheduler.Arm(timers[i], 100);
+    scheduler.Arm(timers[2], 50);
+    scheduler.Arm(timers[2], 100);
+    expect(scheduler.RunExpired(100) == 5 &&
+           timers.TakeRan() == Ran{0, 1, 2, 3, 4});
+  }
+
+  {  // A timer re-arming itself for now runs once per RunExpired()
+    DeadlineScheduler scheduler;
+    DeadlineScheduler::TimerId self = 0;
+    int runs = 0;
+    self = scheduler.Add([&](int64_t now_us) {
+      ++runs;
+      scheduler.Arm(self, now_us);
+    });
+    scheduler.Arm(self, 10);
+    expect(scheduler.RunExpired(10) == 1 && runs == 1);
+    expect(scheduler.armed(self) && scheduler.NextDeadline() == 10);
+    expect(scheduler.RunExpired(10) == 1 && runs == 2);
+  }
+
+  {  // A timer cancelled by a callback does not run, and one it arms for
+     // now runs in the same call, within the budget
+    DeadlineScheduler scheduler;
+    LoggedTimers timers(&scheduler, 3);
+    DeadlineScheduler::TimerId first = scheduler.Add([&](int64_t now_us) {
+      scheduler.Arm(timers[0], now_us);
+      scheduler.Cancel(timers[1]);
+    });
+    scheduler.Arm(first, 10);
+    scheduler.Arm(timers[1], 15);
+    scheduler.Arm(timers[2], 20);
+    expect(scheduler.RunExpired(20) == 3 && timers.TakeRan() == Ran{0, 2});
+    expect(scheduler.RunExpired(20) == 0 && !scheduler.armed(timers[1]));
+  }
+
+  {  // Timers re-arming themselves for now share the budget: two armed on
+     // entry allow two runs, so the second waits for the next call
+    DeadlineScheduler scheduler;
+    std::vector<int> order;
+    DeadlineScheduler::TimerId ids[2] = {};
+    for (int i = 0; i < 2; ++i) {
+      ids[i] = scheduler.Add([&, i](int64_t now_us) {
+        order.push_back(i);
+        scheduler.Arm(ids[i], now_us);
+      });
+    }
+    scheduler.Arm(ids[0], 10);
+    scheduler.Arm(ids[1], 10);
+    expect(scheduler.RunExpired(10) == 2 && order == std::vector<int>{0, 0});
+    expect(scheduler.armed(ids[0]) && scheduler.armed(ids[1]));
+  }
+  return problems;
+}
+
+// The deadline scheduler's cases, then options.deadline_check_ops random
+// arms, moves, cancels and runs over kTimers timers checked against a plain
+// list of deadlines
+int CheckDeadlineScheduler(const Options& options) {
+  constexpr size_t kTimers = 64;
+  int case_problems = CheckDeadlineCases();
+
+  DeadlineScheduler scheduler;
+  LoggedTimers timers(&scheduler, kTimers);
+  std::vector<int64_t> deadlines(kTimers, DeadlineScheduler::kNoDeadline);
+  std::mt19937 random(17);
+  int64_t now_us = 0;
+  uint64_t mismatches = 0;
+  uint64_t runs = 0;
+  for (uint64_t op = 0; op < options.deadline_check_ops; ++op) {
+    size_t i = random() % kTimers;
+    switch (random() % 4) {
+      case 0:
+      case 1: {
+        int64_t deadline_us = now_us + static_cast<int64_t>(random() % 1000);
+        scheduler.Arm(timers[i], deadline_us);
+        deadlines[i] = deadline_us;
+        break;
+      }
+      case 2:
+        scheduler.Cancel(timers[i]);
+        deadlines[i] = DeadlineScheduler::kNoDeadline;
+        break;
+      default: {
+        now_us += static_cast<int64_t>(random() % 100);
+        std::vector<std::pair<int64_t, size_t>> due;
+        for (size_t t = 0; t < kTimers; ++t) {
+          if (deadlines[t] <= now_us) {
+            due.push_back({deadlines[t], t});
+            deadlines[t] = DeadlineScheduler::kNoDeadline;
+          }
+        }
+        std::sort(due.begin(), due.end());
+        std::vector<size_t> expected;
+        for (const auto& timer : due) expected.push_back(timer.second);
+        runs += scheduler.RunExpired(now_us);
+        if (timers.TakeRan() != expected) ++mismatches;
+        break;
+      }
+    }
+    int64_t earliest = *std::min_element(deadlines.begin(), deadlines.end());
+    if (scheduler.NextDeadline() != earliest) ++mismatches;
+  }
+
+  std::cout << "Deadline scheduler cases: " << case_problems
+            << " problems\n"
+            << options.deadline_check_ops << " random operations, " << runs
+            << " timers run, " << mismatches << " differ from the reference"
+            << std::endl;
+  return case_problems == 0 && mismatches == 0 ? 0 : 1;
+}
+
+// Checks that LatencyHistogram's buckets tile the value range without gaps,
+// each within 1/32 of its values, and that its percentiles, mean and
+// extremes match the exact ones. Returns the number of problems found
+int CheckHistogram() {
+  using Histogram = LatencyHistogram;
+  int problems = 0;
+  for (size_t i = 0; i + 1 < Histogram::kBucketCount; ++i) {
+    int64_t low = Histogram::BucketLowestValue(i);
+    int64_t high = Histogram::BucketHighestValue(i);
+    if (high < low || Histogram::BucketLowestValue(i + 1) != high + 1) {
+      ++problems;
+    }
+    if (Histogram::BucketIndex(low) != i ||
+        Histogram::BucketIndex(high) != i) {
+      ++problems;
+    }
+    if (high - low > low / Histogram::kSubBucketCount) ++problems;
+  }
+  const int64_t kOverflow = int64_t{1} << Histogram::kMaxValueBits;
+  for (int64_t value : {kOverflow, kOverflow * 4,
+                        std::numeric_limits<int64_t>::max()}) {
+    if (Histogram::BucketIndex(value) != Histogram::kBucketCount - 1) {
+      ++problems;
+    }
+  }
+
+  // Every value from 1 to kValues once, recorded from several threads
+  constexpr int kThreads = 4;
+  constexpr int64_t kValues = 100000;
+  Histogram histogram;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&histogram, t] {
+      for (int64_t value = 1 + t; value <= kValues; value += kThreads) {
+        histogram.Record(value);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  if (histogram.count() != static_cast<uint64_t>(kValues) ||
+      histogram.mean() != static_cast<double>(kValues + 1) / 2.0 ||
+      histogram.min_value() != 1) {
+    ++problems;
+  }
+  for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9, 100.0}) {
+    int64_t exact = static_cast<int64_t>(
+        std::ceil(percentile / 100.0 * static_cast<double>(kValues)));
+    int64_t reported = histogram.ValueAtPercentile(percentile);
+    if (std::abs(reported - exact) > exact / Histogram::kSubBucketCount + 1) {
+      ++problems;
+    }
+  }
+
+  histogram.Reset();
+  if (histogram.count() != 0 || histogram.ValueAtPercentile(50.0) != 0) {
+    ++problems;
+  }
+  histogram.Record(-5);  // Clamped to 0
+  if (histogram.max_value() != 0 || histogram.mean() != 0.0) ++problems;
+  return problems;
+}
+
+// Best time per sample, in nanoseconds, of the app's detection on samples
+// with the latency probe the sample worker runs, or with none if recorder is
+// null
+double TimeProbedDetection(const std::vector<MouseSample>& samples,
+                           LatencyRecorder* recorder, uint64_t* checksum) {
+  double best_ns = 0.0;
+  for (int run = 0; run < 3; ++run) {
+    MouseMoveDetector detector(DefaultRuntimeConfig().shake,
+                               DefaultGestureOptions());
+    auto start = std::chrono::steady_clock::now();
+    for (const MouseSample& sample : samples) {
+      bool enlarge =
+          detector.AddSample(sample.x, sample.y, sample.timestamp_us)
+              .enlarge();
+      if (recorder && recorder->enabled()) {
+        recorder->Record(LatencyRecorder::kEventToDecision,
+                         MonotonicNanos() - sample.timestamp_us * 1000);
+      }
+      *checksum += enlarge;
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    double ns = elapsed.count() / static_cast<double>(samples.size());
+    if (run == 0 || ns < best_ns) best_ns = ns;
+  }
+  return best_ns;
+}
+
+// Checks the latency histogram, then times what the latency probes add to
+// detection on options.latency_check_samples samples of synthetic motion,
+// with tracing off and on
+int CheckLatencyRecording(const Options& options) {
+  int problems = CheckHistogram();
+  std::cout << "Histogram buckets and percentiles: " << problems
+            << " problems" << std::endl;
+
+  std::vector<MouseSample> samples;
+  samples.reserve(options.latency_check_samples);
+  SyntheticMotion motion;
+  for (uint64_t i = 0; i < options.latency_check_samples; ++i) {
+    samples.push_back(motion.Next());
+  }
+  uint64_t checksum = 0;
+  LatencyRecorder recorder;
+  double bare_ns = TimeProbedDetection(samples, nullptr, &checksum);
+  double off_ns = TimeProbedDetection(samples, &recorder, &checksum);
+  recorder.set_enabled(true);
+  double on_ns = TimeProbedDetection(samples, &recorder, &checksum);
+  std::cout << "Detection per sample: " << std::fixed << std::setprecision(1)
+            << bare_ns << " ns without probes, " << off_ns
+            << " ns with tracing off (" << std::showpos << off_ns - bare_ns
+            << "), " << std::noshowpos << on_ns << " ns with tracing on ("
+            << std::showpos << on_ns - bare_ns << ")" << std::noshowpos
+            << std::defaultfloat << "\n(checksum " << checksum << ", "
+            << recorder.histogram(LatencyRecorder::kEventToDecision).count()
+            << " recorded)" << std::endl;
+  return problems == 0 ? 0 : 1;
+}
+
+// Moves the spotlight along a fast Lissajous path over a framebuffer of the
+// given size, timing the first full draw and each dirty-rectangle update,
+// then checks every pixel against the scalar reference so stale spotlight
+// pixels left behind by the dirty-rectangle tracking are caught too
+bool BenchmarkSpotlightAt(int width, int height, uint64_t updates) {
+  // The app's defaults from CursorConfig
+  SpotlightCompositor compositor({120, 6, 0xA0000000, 0xE0FFC800});
+  std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+  FramebufferView frame = {pixels.data(), width, height,
+                           static_cast<size_t>(width)};
+
+  int x = width / 2;
+  int y = height / 2;
+  auto start = std::chrono::steady_clock::now();
+  compositor.Draw(frame, x, y);
+  std::chrono::duration<double> full =
+      std::chrono::steady_clock::now() - start;
+
+  int64_t dirty_pixels = 0;
+  double worst_us = 0.0;
+  start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < updates; ++i) {
+    double t = static_cast<double>(i) * 0.004;
+    x = width / 2 + static_cast<int>(0.45 * width * std::sin(3.0 * t));
+    y = height / 2 + static_cast<int>(0.55 * height * std::cos(2.0 * t));
+    auto update_start = std::chrono::steady_clock::now();
+    dirty_pixels += compositor.Draw(frame, x, y).area();
+    std::chrono::duration<double, std::micro> update =
+        std::chrono::steady_clock::now() - update_start;
+    worst_us = std::max(worst_us, update.count());
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  uint64_t mismatches = 0;
+  for (int py = 0; py < height; ++py) {
+    for (int px = 0; px < width; ++px) {
+      uint32_t actual = pixels[static_cast<size_t>(py) * width + px];
+      uint32_t expected = compositor.Shade(px, py, x, y);
+      // Allow for a contracted multiply-add rounding differently
+      for (int ch = 0; ch < 32; ch += 8) {
+        int a = static_cast<int>((actual >> ch) & 0xFF);
+        int e = static_cast<int>((expected >> ch) & 0xFF);
+        if (std::abs(a - e) > 1) {
+          ++mismatches;
+          break;
+        }
+      }
+    }
+  }
+
+  double updates_d = static_cast<double>(updates > 0 ? updates : 1);
+  std::cout << width << "x" << height << ": full draw " << std::fixed
+            << std::setprecision(2) << full.count() * 1e3 << " ms, "
+            << elapsed.count() / updates_d << " us per update (worst "
+            << worst_us << " us), "
+            << static_cast<double>(dirty_pixels) / updates_d / 1e3
+            << " k dirty pixels per update, " << std::defaultfloat
+            << mismatches << " mismatched pixels" << std::endl;
+  return mismatches == 0;
+}
+
+int BenchmarkSpotlight(const Options& options) {
+  std::cout << "Spotlight kernel: " << SpotlightCompositor::KernelName()
+            << std::endl;
+  bool ok = BenchmarkSpotlightAt(3840, 2160, options.spotlight_updates);
+  ok = BenchmarkSpotlightAt(7680, 4320, options.spotlight_updates) && ok;
+  return ok ? 0 : 1;
+}
+
+// System cursor table in memory. Each handle refers to a cursor image; the
+// saved scheme holds different images than the live table, as when another
+// program has set its own cursors. Counts the scheme reloads, which are
+// what notifies every window on Windows
+class FakeCursorTable : public SystemCursorTable {
+ public:
+  static constexpr uint32_t kFirstId = 32512;  // OCR_NORMAL
+
+  // With left_enlarged the live cursors are enlarged ones left by an
+  // instance that did not exit
+  FakeCursorTable(uint32_t count, bool left_enlarged) {
+    for (uint32_t id = kFirstId; id < kFirstId + count; ++id) {
+      scheme_[id] = id;
+      live_[id] = left_enlarged ? id + 100000 : id;
+    }
+  }
+
+  uintptr_t CopyCurrent(uint32_t id) override {
+    auto it = live_.find(id);
+    return it == live_.end() ? 0 : NewHandle(it->second);
+  }
+
+  bool Set(uint32_t id, uintptr_t cursor) override {
+    ++set_count_;
+    auto handle = handles_.find(cursor);
+    if (id == failing_id_ || handle == handles_.end() || !live_.count(id)) {
+      return false;
+    }
+    live_[id] = handle->second;
+    return true;
+  }
+
+  void Destroy(uintptr_t cursor) override { handles_.erase(cursor); }
+
+  bool ReloadScheme(bool notify) override {
+    if (notify) ++reload_count_;
+    live_ = scheme_;
+    return true;
+  }
+
+  uintptr_t NewHandle(uint32_t image) {
+    handles_[next_handle_] = image;
+    return next_handle_++;
+  }
+
+  uint32_t live(uint32_t id) const { return live_.at(id); }
+  uint32_t saved(uint32_t id) const { return scheme_.at(id); }
+  size_t handle_count() const { return handles_.size(); }
+  uint64_t set_count() const { return set_count_; }
+  // Reloads that notified every window
+  uint64_t reload_count() const { return reload_count_; }
+  void set_failing_id(uint32_t id) { failing_id_ = id; }
+
+ private:
+  std::map<uint32_t, uint32_t> scheme_;
+  std::map<uint32_t, uint32_t> live_;
+  std::map<uintptr_t, uint32_t> handles_;
+  uintptr_t next_handle_ = 1;
+  uint32_t failing_id_ = 0;
+  uint64_t set_count_ = 0;
+  uint64_t reload_count_ = 0;
+};
+
+// LargeCursorManager over the fake table: enlarged frames are swapped in
+// and out through the snapshot, and the shape on screen is random
+class FakeLargeCursors : public CursorSwapPlatform {
+ public:
+  static constexpr int kShapes = 13;
+  static constexpr int kFrames = 6;
+
+  FakeLargeCursors(FakeCursorTable* table, std::mt19937* random)
+      : table_(table), snapshot_(table), random_(random) {
+    uint32_t ids[kShapes];
+    for (int shape = 0; shape < kShapes; ++shape) {
+      ids[shape] = FakeCursorTable::kFirstId + static_cast<uint32_t>(shape);
+      for (int frame = 0; frame < kFrames; ++frame) {
+        frames_[shape][frame] = table->NewHandle(
+            static_cast<uint32_t>(200000 + shape * kFrames + frame));
+      }
+    }
+    snapshot_.Capture(ids, kShapes);
+  }
+
+  ~FakeLargeCursors() {
+    for (auto& frames : frames_) {
+      for (uintptr_t frame : frames) table_->Destroy(frame);
+    }
+  }
+
+  int ShapeCount() const override { return kShapes; }
+  int CurrentShape() override {
+    return static_cast<int>((*random_)() % (kShapes + 1)) - 1;
+  }
+  void ShowEnlarged(int shape, int frame) override {
+    snapshot_.Replace(static_cast<size_t>(shape), frames_[shape][frame]);
+  }
+  void ShowOriginal(int shape) override {
+    snapshot_.Restore(static_cast<size_t>(shape));
+  }
+
+  CursorSnapshot& snapshot() { return snapshot_; }
+
+ private:
+  FakeCursorTable* table_;
+  CursorSnapshot snapshot_;
+  std::mt19937* random_;
+  uintptr_t frames_[kShapes][kFrames];
+};
+
+// One run from startup to exit: random enlarge, animation, shape change and
+// restore steps, then exit at a random point, possibly while enlarged. With
+// start_enlarged a previous instance left the cursors enlarged, which must
+// not be taken as the originals. With fail_on_exit one cursor cannot be put
+// back at exit, which must fall back to one scheme reload. Returns the
+// number of problems found
+int CheckRestoreRound(uint64_t round, bool start_enlarged, bool fail_on_exit,
+                      uint64_t* reload_count, uint64_t* set_count) {
+  std::mt19937 random(static_cast<uint32_t>(round));
+  FakeCursorTable table(FakeLargeCursors::kShapes, start_enlarged);
+  int problems = 0;
+  {
+    FakeLargeCursors platform(&table, &random);
+    for (uint32_t shape = 0; shape < FakeLargeCursors::kShapes; ++shape) {
+      uint32_t id = FakeCursorTable::kFirstId + shape;
+      if (table.live(id) != table.saved(id)) ++problems;
+    }
+    CursorSwapScheduler::Mode mode =
+        round % 2 == 0 ? CursorSwapScheduler::Mode::kAll
+                       : CursorSwapScheduler::Mode::kCurrentOnly;
+    CursorSwapScheduler scheduler(&platform, mode);
+    int steps = static_cast<int>(random() % 200);
+    for (int i = 0; i < steps; ++i) {
+      switch (random() % 4) {
+        case 0:
+          scheduler.Enlarge(static_cast<int>(random() %
+                                             FakeLargeCursors::kFrames));
+          break;
+        case 1:
+          scheduler.ShowFrame(static_cast<int>(random() %
+                                               FakeLargeCursors::kFrames));
+          break;
+        case 2:
+          scheduler.TrackShape();
+          break;
+        default:
+          scheduler.Restore();
+          break;
+      }
+    }
+
+    uint64_t sets_before_exit = table.set_count();
+    size_t replaced = platform.snapshot().replaced_count();
+    uint32_t failing_id = 0;
+    if (fail_on_exit) {
+      failing_id = FakeCursorTable::kFirstId +
+                   static_cast<uint32_t>(random() % FakeLargeCursors::kShapes);
+      table.set_failing_id(failing_id);
+    }
+    // Only a replaced cursor that cannot be put back may reload the scheme
+    bool expect_reload =
+        fail_on_exit && table.live(failing_id) != table.saved(failing_id);
+    platform.snapshot().RestoreAll();
+
+    uint64_t exit_sets = table.set_count() - sets_before_exit;
+    *set_count += exit_sets;
+    if (exit_sets != replaced || platform.snapshot().replaced_count() != 0 ||
+        table.reload_count() != (expect_reload ? 1u : 0u)) {
+      ++problems;
+    }
+    for (uint32_t shape = 0; shape < FakeLargeCursors::kShapes; ++shape) {
+      uint32_t id = FakeCursorTable::kFirstId + shape;
+      if (table.live(id) != table.saved(id)) ++problems;
+    }
+    *reload_count += table.reload_count();
+  }
+  // The snapshot and the frames are released with the platform
+  if (table.handle_count() != 0) ++problems;
+  return problems;
+}
+
+int CheckRestore(const Options& options) {
+  int problems = 0;
+  uint64_t reloads = 0;
+  uint64_t exit_sets = 0;
+  for (uint64_t round = 0; round < options.restore_check_rounds; ++round) {
+    problems += CheckRestoreRound(round, false, false, &reloads, &exit_sets);
+  }
+  std::cout << options.restore_check_rounds << " exits: " << exit_sets
+            << " cursors put back, " << reloads << " scheme reloads, "
+            << problems << " problems" << std::endl;
+
+  int failure_problems = 0;
+  uint64_t failure_reloads = 0;
+  uint64_t failure_sets = 0;
+  for (uint64_t round = 0; round < options.restore_check_rounds; ++round) {
+    failure_problems += CheckRestoreRound(round, false, true,
+                                          &failure_reloads, &failure_sets);
+  }
+  std::cout << options.restore_check_rounds
+            << " exits with a failing cursor: " << failure_reloads
+            << " scheme reloads, " << failure_problems << " problems"
+            << std::endl;
+
+  int enlarged_problems = 0;
+  uint64_t enlarged_reloads = 0;
+  uint64_t enlarged_sets = 0;
+  for (uint64_t round = 0; round < options.restore_check_rounds; ++round) {
+    enlarged_problems += CheckRestoreRound(round, true, false,
+                                           &enlarged_reloads, &enlarged_sets);
+  }
+  std::cout << options.restore_check_rounds
+            << " starts while left enlarged: " << enlarged_sets
+            << " cursors put back, " << enlarged_reloads
+            << " scheme reloads, " << enlarged_problems << " problems"
+            << std::endl;
+  return problems == 0 && failure_problems == 0 && enlarged_problems == 0 &&
+                 reloads == 0 && enlarged_reloads == 0
+             ? 0
+             : 1;
+}
+
+// Counts the system cursor calls, one SetSystemCursor each on Windows, and
+// tracks what every shape shows
+class CountingCursors : public CursorSwapPlatform {
+ public:
+  static constexpr int kShapes = 13;
+
+  int ShapeCount() const override { return kShapes; }
+  int CurrentShape() override { return current_shape_; }
+  void ShowEnlarged(int shape, int frame) override {
+    shown_[shape] = frame;
+    ++calls_;
+  }
+  void ShowOriginal(int shape) override {
+    shown_[shape] = -1;
+    ++calls_;
+  }
+
+  void set_current_shape(int shape) { current_shape_ = shape; }
+
+  // Calls since the last time this was asked
+  uint64_t TakeCalls() {
+    uint64_t calls = calls_;
+    calls_ = 0;
+    return calls;
+  }
+
+  int EnlargedShapes() const {
+    int count = 0;
+    for (int frame : shown_) count += frame >= 0;
+    return count;
+  }
+
+ private:
+  int current_shape_ = 0;
+  uint64_t calls_ = 0;
+  int shown_[kShapes] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+};
+
+// Drives the swap scheduler in both modes through enlarges, shape changes,
+// animation frames and restores, and checks the system cursor calls each
+// step costs and that every shape is back to its original afterwards
+int CheckSwapCounts() {
+  using Mode = CursorSwapScheduler::Mode;
+  constexpr int kShapes = CountingCursors::kShapes;
+  int failures = 0;
+  int steps = 0;
+  auto expect = [&failures, &steps](const char* mode, const char* step,
+                                    CountingCursors* cursors,
+                                    uint64_t calls) {
+    ++steps;
+    uint64_t actual = cursors->TakeCalls();
+    if (actual != calls) {
+      std::cout << mode << ", " << step << ": " << actual
+                << " cursor calls, expected " << calls << std::endl;
+      ++failures;
+    }
+  };
+
+  {
+    CountingCursors cursors;
+    CursorSwapScheduler scheduler(&cursors, Mode::kCurrentOnly);
+    const char* mode = "current only";
+    cursors.set_current_shape(4);
+    scheduler.Enlarge(0);
+    expect(mode, "enlarge", &cursors, 1);
+    scheduler.Enlarge(0);
+    expect(mode, "enlarge again", &cursors, 0);
+    scheduler.TrackShape();
+    expect(mode, "same shape", &cursors, 0);
+    cursors.set_current_shape(7);
+    scheduler.TrackShape();
+    expect(mode, "new shape", &cursors, 1);
+    cursors.set_current_shape(4);
+    scheduler.TrackShape();
+    expect(mode, "back to a swapped shape", &cursors, 0);
+    cursors.set_current_shape(-1);
+    scheduler.TrackShape();
+    expect(mode, "unmanaged shape", &cursors, 0);
+    scheduler.ShowFrame(1);
+    expect(mode, "next frame", &cursors, 2);
+    scheduler.ShowFrame(1);
+    expect(mode, "same frame", &cursors, 0);
+    scheduler.Restore();
+    expect(mode, "restore", &cursors, 2);
+    scheduler.Restore();
+    expect(mode, "restore again", &cursors, 0);
+    scheduler.TrackShape();
+    scheduler.ShowFrame(2);
+    expect(mode, "shape change and frame when restored", &cursors, 0);
+
+    // An unknown shape on screen enlarges the default one
+    scheduler.Enlarge(0);
+    expect(mode, "enlarge over an unmanaged shape", &cursors, 1);
+    scheduler.Restore();
+    expect(mode, "restore", &cursors, 1);
+    failures += cursors.EnlargedShapes() != 0;
+    failures += scheduler.swap_count() != 8;
+  }
+
+  {
+    CountingCursors cursors;
+    CursorSwapScheduler scheduler(&cursors, Mode::kAll);
+    const char* mode = "all";
+    scheduler.Enlarge(0);
+    expect(mode, "enlarge", &cursors, kShapes);
+    failures += cursors.EnlargedShapes() != kShapes;
+    cursors.set_current_shape(7);
+    scheduler.TrackShape();
+    expect(mode, "new shape", &cursors, 0);
+    scheduler.ShowFrame(1);
+    expect(mode, "next frame", &cursors, kShapes);
+    scheduler.Restore();
+    expect(mode, "restore", &cursors, kShapes);
+    failures += cursors.EnlargedShapes() != 0;
+    failures += scheduler.swap_count() != 3 * kShapes;
+  }
+
+  std::cout << steps << " steps checked, " << failures << " failures"
+            << std::endl;
+  return failures == 0 ? 0 : 1;
+}
+
+// Walks the pacer through every microsecond of a run and checks that each
+// step is shown exactly when due, that NextDeadline() names the time the
+// next step becomes due, and that the run ends on the last step
+int CheckPacerRun(int64_t duration_us, int step_count, int first_step) {
+  constexpr int64_t kStartUs = 1000;
+  FramePacer pacer;
+  pacer.Start(kStartUs, duration_us, step_count, first_step);
+  int intervals = step_count > 1 ? step_count - 1 : 1;
+  int failures = 0;
+  int shown = -1;
+  int64_t deadline = kStartUs;
+  for (int64_t now = kStartUs; now <= kStartUs + duration_us + 1; ++now) {
+    int64_t elapsed = now - kStartUs;
+    int64_t due = duration_us > 0
+                      ? first_step + elapsed * intervals / duration_us
+                      : step_count - 1;
+    if (due > step_count - 1) due = step_count - 1;
+    int step = pacer.Advance(now);
+    int expected = due != shown ? static_cast<int>(due) : -1;
+    if (step != expected || (step >= 0 && now != deadline)) ++failures;
+    if (step >= 0) shown = step;
+    deadline = pacer.NextDeadline();
+  }
+  if (pacer.running() || shown != step_count - 1) ++failures;
+  if (failures > 0) {
+    std::cout << "Pacer over " << duration_us << " us, " << step_count
+              << " steps from " << first_step << ": " << failures
+              << " failures" << std::endl;
+  }
+  return failures;
+}
+
+// Frame on screen from time_ms, -1 for the original cursor
+struct FrameAt {
+  int64_t time_ms;
+  int frame;
+};
+
+// Runs the animator on a simulated clock, calling it for each detection and
+// at every deadline it asks for as the app does, and checks the frames it
+// shows against the expected schedule
+int CheckAnimatorRun(const char* name, const EnlargeTiming& timing,
+                     const std::vector<std::pair<int64_t, bool>>& detections,
+                     const std::vector<FrameAt>& expected) {
+  constexpr int64_t kEndUs = 2000 * 1000;
+  ManualClock clock;
+  HeadlessCursors cursors(&clock, 1);
+  LatencyRecorder latency;
+  CursorAnimator animator(
+      &cursors, &clock, &latency,
+      {timing, 6, 120 * 1000, CursorSwapScheduler::Mode::kCurrentOnly});
+
+  size_t next = 0;
+  while (true) {
+    int64_t now = animator.NextDeadline();
+    if (next < detections.size() && detections[next].first * 1000 <= now) {
+      now = detections[next].first * 1000;
+    }
+    if (now > kEndUs) break;
+    clock.Set(now);
+    if (next < detections.size() && detections[next].first * 1000 == now) {
+      animator.OnDetection(detections[next++].second);
+    } else {
+      animator.Tick();
+    }
+  }
+
+  std::vector<FrameAt> shown;
+  for (const CursorSwapEvent& swap : cursors.timeline()) {
+    shown.push_back({swap.time_us / 1000, swap.frame});
+  }
+  bool same = shown.size() == expected.size();
+  for (size_t i = 0; same && i < shown.size(); ++i) {
+    same = shown[i].time_ms == expected[i].time_ms &&
+           shown[i].frame == expected[i].frame;
+  }
+  if (!same) {
+    std::cout << name << ": frames";
+    for (const FrameAt& at : shown) {
+      std::cout << " " << at.frame << "@" << at.time_ms;
+    }
+    std::cout << ", expected";
+    for (const FrameAt& at : expected) {
+      std::cout << " " << at.frame << "@" << at.time_ms;
+    }
+    std::cout << std::endl;
+  }
+  return same ? 0 : 1;
+}
+
+// Checks the frame pacer on its own, late wakeups and runs that start part
+// way included, then the frames the animator shows over time for a full
+// grow and shrink, a shrink turned back into a grow and a grow cut short
+// by a restore. Six frames over 120 ms put one frame every 24 ms
+int CheckFrameSchedule() {
+  int failures = 0;
+  failures += CheckPacerRun(120 * 1000, 6, 0);
+  failures += CheckPacerRun(120 * 1000, 6, 3);
+  failures += CheckPacerRun(100 * 1000, 7, 0);
+  failures += CheckPacerRun(1000, 1, 0);
+  failures += CheckPacerRun(0, 6, 2);
+
+  FramePacer late;
+  late.Start(0, 120 * 1000, 6);
+  failures += late.Advance(0) != 0;
+  failures += late.Advance(100 * 1000) != 4;  // Skips the missed steps
+  failures += late.NextDeadline() != 120 * 1000;
+  failures += late.Advance(200 * 1000) != 5;
+  failures += late.NextDeadline() != FramePacer::kNoDeadline;
+
+  const EnlargeTiming timing = {500 * 1000, 5000 * 1000, 0};
+  failures += CheckAnimatorRun(
+      "Grow and shrink", timing, {{0, true}},
+      {{0, 0}, {24, 1}, {48, 2}, {72, 3}, {96, 4}, {120, 5},
+       {500, 4}, {524, 3}, {548, 2}, {572, 1}, {596, 0}, {620, -1}});
+  // A shake at 550 ms, with frame 2 on screen, grows back from frame 3 over
+  // the remaining part of the duration
+  failures += CheckAnimatorRun(
+      "Shrink reversed", timing, {{0, true}, {550, false}, {550, true}},
+      {{0, 0}, {24, 1}, {48, 2}, {72, 3}, {96, 4}, {120, 5},
+       {500, 4}, {524, 3}, {548, 2}, {550, 3}, {574, 4}, {598, 5},
+       {1050, 4}, {1074, 3}, {1098, 2}, {1122, 1}, {1146, 0}, {1170, -1}});
+  // Restoring at 50 ms, with frame 2 on screen, shrinks from frame 1
+  failures += CheckAnimatorRun(
+      "Grow reversed", {50 * 1000, 5000 * 1000, 0}, {{0, true}},
+      {{0, 0}, {24, 1}, {48, 2}, {50, 1}, {74, 0}, {98, -1}});
+
+  std::cout << failures << " frame schedule failures" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
+
+// Source cursors as the system cursors come at 96 DPI: color arrows of two
+// sizes and monochrome I-beams, with different hotspots
+std::vector<CursorImage> SyntheticCursors(size_t count) {
+  std::vector<CursorImage> cursors;
+  for (size_t i = 0; i < count; ++i) {
+    CursorImage cursor;
+    int size = i % 3 == 0 ? 48 : 32;
+    cursor.pixels.width = size;
+    cursor.pixels.height = size;
+    cursor.hotspot_x = static_cast<int>(i % 5) * size / 8;
+    cursor.hotspot_y = static_cast<int>(i % 7) * size / 8;
+    cursor.monochrome = i % 4 == 1;
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        uint32_t pixel;
+        if (cursor.monochrome) {
+          // Inverts the screen inside the bar, leaves it alone elsewhere
+          bool bar = std::abs(2 * x - size) < size / 4;
+          pixel = bar ? 0xFF00FF00 : 0xFF0000FF;
+        } else {
+          bool arrow = x <= y && x + y / 2 < size;
+          pixel = arrow ? 0xFF000000 | static_cast<uint32_t>(
+                                           (x * 255 / size) << 16 |
+                                           (y * 255 / size) << 8 | i * 19)
+                        : 0;
+        }
+        cursor.pixels.pixels.push_back(pixel);
+      }
+    }
+    cursors.push_back(std::move(cursor));
+  }
+  return cursors;
+}
+
+// The synthetic cursors premultiplied, and soft-edged images with random
+// alpha whose ringing under the Lanczos filter has to be clamped
+std::vector<BgraImage> ScalerSources() {
+  std::vector<BgraImage> images;
+  for (const CursorImage& cursor : SyntheticCursors(13)) {
+    images.push_back(cursor.pixels);
+    CursorScaler::Premultiply(&images.back());
+  }
+  std::mt19937 random(5);
+  for (int size : {17, 32, 64}) {
+    BgraImage image;
+    image.width = size;
+    image.height = size;
+    for (int i = 0; i < size * size; ++i) {
+      uint32_t a = random() % 256;
+      uint32_t pixel = a << 24;
+      for (int ch = 0; ch < 3; ++ch) pixel |= (random() % (a + 1)) << (ch * 8);
+      image.pixels.push_back(pixel);
+    }
+    images.push_back(std::move(image));
+  }
+  return images;
+}
+
+// Scales a set of cursors with every filter at enlarging and shrinking
+// factors, halving ones included since they land on rounding ties, with
+// every kernel the CPU runs. Reports the time per set for each kernel and
+// fails if a kernel's pixels differ from the scalar kernel's or a color
+// exceeds its alpha
+int BenchmarkScaler(const Options& options) {
+  constexpr double kScales[] = {0.5, 0.75, 1.5, 2.0, 3.0, 4.5};
+  constexpr ScaleFilter kFilters[] = {ScaleFilter::kBilinear,
+                                      ScaleFilter::kArea,
+                                      ScaleFilter::kLanczos3};
+  constexpr ScalerKernel kKernels[] = {
+      ScalerKernel::kScalar, ScalerKernel::kSse2, ScalerKernel::kAvx2};
+  const std::vector<BgraImage> sources = ScalerSources();
+
+  std::cout << "Best kernel: " << CursorScaler::KernelName() << std::endl;
+  std::vector<BgraImage> reference;
+  size_t differing = 0;
+  size_t invalid = 0;
+  for (ScalerKernel kernel : kKernels) {
+    if (!CursorScaler::KernelSupported(kernel)) continue;
+    std::vector<BgraImage> scaled;
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < options.scaler_repeat; ++run) {
+      scaled.clear();
+      for (ScaleFilter filter : kFilters) {
+        for (double scale : kScales) {
+          for (const BgraImage& source : sources) {
+            scaled.push_back(CursorScaler::Scale(
+                source, static_cast<int>(source.width * scale),
+                static_cast<int>(source.height * scale), filter, kernel));
+          }
+        }
+      }
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    for (size_t i = 0; i < scaled.size(); ++i) {
+      if (kernel == ScalerKernel::kScalar) continue;
+      differing += scaled[i].pixels != reference[i].pixels;
+    }
+    for (const BgraImage& image : scaled) {
+      for (uint32_t pixel : image.pixels) {
+        uint32_t a = pixel >> 24;
+        invalid += (pixel & 0xFF) > a || ((pixel >> 8) & 0xFF) > a ||
+                   ((pixel >> 16) & 0xFF) > a;
+      }
+    }
+    double sets = static_cast<double>(options.scaler_repeat) *
+                  std::size(kFilters) * std::size(kScales);
+    std::cout << std::setw(6) << CursorScaler::KernelName(kernel) << ": "
+              << std::fixed << std::setprecision(3) << elapsed.count() / sets
+              << " ms per set of " << sources.size() << std::defaultfloat
+              << std::endl;
+    if (kernel == ScalerKernel::kScalar) reference = std::move(scaled);
+  }
+  std::cout << differing << " images differ from the scalar kernel, "
+            << invalid << " pixels with a color above alpha" << std::endl;
+  return differing == 0 && invalid == 0 ? 0 : 1;
+}
+
+// Frames in a's sets that b lacks or holds different pixels for
+size_t DifferingFrames(const CursorSetCache& a, const CursorSetCache& b) {
+  size_t differing = 0;
+  for (int dpi : a.dpis()) {
+    const CursorSet* expected = a.Find(dpi);
+    const CursorSet* actual = b.Find(dpi);
+    for (size_t shape = 0; shape < expected->shapes.size(); ++shape) {
+      const FrameAtlas& want = expected->shapes[shape];
+      for (int i = 0; i < want.frame_count(); ++i) {
+        if (!actual || shape >= actual->shapes.size() ||
+            i >= actual->shapes[shape].frame_count()) {
+          ++differing;
+          continue;
+        }
+        const FrameAtlas& got = actual->shapes[shape];
+        const FrameAtlas::Frame& w = want.frame(i);
+        const FrameAtlas::Frame& g = got.frame(i);
+        bool same = w.width == g.width && w.height == g.height &&
+                    w.hotspot_x == g.hotspot_x &&
+                    w.hotspot_y == g.hotspot_y &&
+                    std::memcmp(want.FramePixels(i), got.FramePixels(i),
+                                static_cast<size_t>(w.width) * w.height *
+                                    sizeof(uint32_t)) == 0;
+        differing += same ? 0 : 1;
+      }
+    }
+  }
+  return differing;
+}
+
+double SyncMilliseconds(CursorSetCache* cache, const std::vector<int>& dpis,
+                        const CursorCache::Reader* disk_cache,
+                        CursorSetCache::SyncResult* result) {
+  auto start = std::chrono::steady_clock::now();
+  *result = cache->Sync(dpis, disk_cache);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Times rendering the cursor sets from scratch for 1 to N monitor DPIs on
+// one thread and on pools of more, checking every pool renders the same
+// frames. Then checks a display change renders only the DPI that appeared
+// and a restart takes every frame from the disk cache
+int BenchmarkCursorSets(const Options& options) {
+  static const int kDpis[] = {96, 120, 144, 168, 192, 240, 288, 336, 384};
+  size_t dpi_count = std::min(options.cursor_set_dpis, std::size(kDpis));
+  // The app's defaults from CursorConfig, over the 13 system cursors
+  const CursorSetParams params = {3.0, 6, ScaleFilter::kLanczos3, 96};
+  const std::vector<CursorImage> sources = SyntheticCursors(13);
+
+  std::vector<unsigned> thread_counts = {2, 4};
+  unsigned hardware = std::thread::hardware_concurrency();
+  if (hardware > 4) thread_counts.push_back(hardware);
+  std::cout << "Scaler kernel: " << CursorScaler::KernelName() << ", "
+            << hardware << " hardware threads" << std::endl;
+
+  size_t differing = 0;
+  for (size_t count = 1; count <= dpi_count; ++count) {
+    std::vector<int> dpis(kDpis, kDpis + count);
+    CursorSetCache serial(sources, params, nullptr);
+    CursorSetCache::SyncResult result;
+    double serial_ms = SyncMilliseconds(&serial, dpis, nullptr, &result);
+    std::cout << count << " DPIs: " << std::fixed << std::setprecision(1)
+              << serial_ms << " ms on 1 thread";
+    for (unsigned threads : thread_counts) {
+      WorkStealingPool pool(threads);
+      CursorSetCache parallel(sources, params, &pool);
+      double ms = SyncMilliseconds(&parallel, dpis, nullptr, &result);
+      differing += DifferingFrames(serial, parallel);
+      std::cout << ", " << ms << " ms on " << threads << " ("
+                << std::setprecision(2) << serial_ms / ms << "x)"
+                << std::setprecision(1);
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+
+  // Swap the last monitor for one at a new DPI without waiting, as the app
+  // does on a display change: the old sets stay until the new one is built
+  WorkStealingPool pool(4);
+  std::vector<int> dpis(kDpis, kDpis + dpi_count);
+  CursorSetCache sets(sources, params, &pool);
+  CursorSetCache::SyncResult result;
+  SyncMilliseconds(&sets, dpis, nullptr, &result);
+  int removed = dpis.back();
+  dpis.back() = 216;
+  std::atomic<bool> built{false};
+  auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<CursorSetCache::PendingSync> pending =
+      sets.StartSync(dpis, nullptr, [&built] { built.store(true); });
+  std::chrono::duration<double, std::milli> start_ms =
+      std::chrono::steady_clock::now() - start;
+  bool incremental = sets.Find(removed) != nullptr && !sets.Find(216);
+  while (!built.load()) std::this_thread::yield();
+  std::chrono::duration<double, std::milli> change_ms =
+      std::chrono::steady_clock::now() - start;
+  result = sets.FinishSync(pending.get());
+  incremental = incremental && result.built == std::vector<int>{216} &&
+                result.dropped == std::vector<int>{removed} &&
+                sets.Find(216) && !sets.Find(removed);
+  double same_ms = SyncMilliseconds(&sets, dpis, nullptr, &result);
+  incremental =
+      incremental && result.built.empty() && result.dropped.empty();
+  std::cout << "Display change: " << std::fixed << std::setprecision(1)
+            << change_ms.count() << " ms to swap one DPI, "
+            << std::setprecision(3) << start_ms.count()
+            << " ms until the caller is free, " << std::setprecision(1)
+            << same_ms << " ms when nothing changed" << std::defaultfloat
+            << std::endl;
+
+  // A restart with the sets written out takes every frame from disk
+  std::filesystem::path cache_path =
+      std::filesystem::temp_directory_path() / "trace_replay_cursor_sets.bin";
+  CursorCache::Writer writer;
+  sets.AddTo(&writer);
+  bool cached = writer.Write(cache_path);
+  CursorCache::Reader disk_cache;
+  cached = cached && disk_cache.Open(cache_path);
+  CursorSetCache restarted(sources, params, &pool);
+  double restart_ms =
+      SyncMilliseconds(&restarted, dpis, &disk_cache, &result);
+  cached = cached && result.scaled_frames == 0;
+  differing += DifferingFrames(sets, restarted);
+  disk_cache.Close();
+  std::error_code error;
+  std::filesystem::remove(cache_path, error);
+  std::cout << "Restart from the disk cache: " << std::fixed
+            << std::setprecision(1) << restart_ms << " ms, "
+            << std::defaultfloat << result.scaled_frames
+            << " frames scaled" << std::endl;
+
+  std::cout << differing << " differing frames, display change "
+            << (incremental ? "incremental" : "NOT incremental")
+            << ", disk cache " << (cached ? "reused" : "NOT reused")
+            << std::endl;
+  return differing == 0 && incremental && cached ? 0 : 1;
+}
+
+#ifdef __linux__
+
+// Writes the file back and asks the kernel to drop it from the page cache,
+// then returns the fraction of its pages still resident, 1 if unknown
+double EvictFromPageCache(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return 1.0;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+  double resident = 1.0;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      std::vector<unsigned char> pages((size + page - 1) / page);
+      if (mincore(data, size, pages.data()) == 0) {
+        size_t count = 0;
+        for (unsigned char in_core : pages) count += in_core & 1;
+        resident = static_cast<double>(count) / pages.size();
+      }
+      munmap(data, size);
+    }
+  }
+  close(fd);
+  return resident;
+}
+
+#else
+
+double EvictFromPageCache(const std::filesystem::path&) { return 1.0; }
+
+#endif
+
+// Times the app's startup work for the cursors on one thread three ways:
+// rendering every frame, and opening the disk cache and reading every frame
+// from it, with the file first dropped from the page cache and then with
+// it warm. Fails if a cached startup renders anything or its frames differ.
+// Dropping the file is Linux only and does nothing on tmpfs, so the share
+// of the file still resident is reported with the cold time
+int BenchmarkCacheStartup(const Options& options) {
+  const std::vector<int> dpis = {96, 144};
+  const CursorSetParams params = {3.0, 6, ScaleFilter::kLanczos3, 96};
+  const std::vector<CursorImage> sources = SyntheticCursors(13);
+  const int runs = options.cache_startup_runs;
+
+  CursorSetCache rendered(sources, params, nullptr);
+  CursorSetCache::SyncResult result;
+  double render_ms = 0.0;
+  for (int run = 0; run < runs; ++run) {
+    CursorSetCache sets(sources, params, nullptr);
+    render_ms += SyncMilliseconds(&sets, dpis, nullptr, &result);
+    if (run == 0) rendered.Sync(dpis, nullptr);
+  }
+
+  std::filesystem::path cache_path =
+      std::filesystem::temp_directory_path() / "trace_replay_startup.bin";
+  CursorCache::Writer writer;
+  rendered.AddTo(&writer);
+  if (!writer.Write(cache_path)) {
+    std::cerr << "Failed to write " << cache_path.string() << std::endl;
+    return 1;
+  }
+
+  size_t scaled_from_cache = 0;
+  size_t differing = 0;
+  double resident = 0.0;
+  double cached_ms[2] = {0.0, 0.0};  // Cold, warm
+  for (int warm = 0; warm < 2; ++warm) {
+    for (int run = 0; run < runs; ++run) {
+      if (!warm) resident += EvictFromPageCache(cache_path);
+      auto start = std::chrono::steady_clock::now();
+      CursorCache::Reader disk_cache;
+      bool opened = disk_cache.Open(cache_path);
+      CursorSetCache sets(sources, params, nullptr);
+      result = sets.Sync(dpis, opened ? &disk_cache : nullptr);
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      cached_ms[warm] += elapsed.count();
+      scaled_from_cache += result.scaled_frames;
+      differing += DifferingFrames(rendered, sets);
+    }
+  }
+  std::error_code error;
+  std::filesystem::remove(cache_path, error);
+
+  std::cout << std::fixed << std::setprecision(2) << "Rendering: "
+            << render_ms / runs << " ms\nCold cache: " << cached_ms[0] / runs
+            << " ms (" << std::setprecision(0) << 100.0 * resident / runs
+            << "% of the file still resident)\nWarm cache: "
+            << std::setprecision(2) << cached_ms[1] / runs << " ms\n"
+            << std::defaultfloat << scaled_from_cache
+            << " frames rendered with the cache, " << differing
+            << " differing frames" << std::endl;
+  return scaled_from_cache == 0 && differing == 0 ? 0 : 1;
+}
+
+// Detects on the sample worker. Marks detection ready when the worker first
+// waits for samples, and the first sample
+class StartupSink : public SampleSink {
+ public:
+  StartupSink(const ShakeParams& params, const GestureOptions& gestures,
+              StartupProfile* profile)
+      : detector_(params, gestures), profile_(profile) {}
+
+  void OnSamples(const MouseSample* samples, size_t count) override {
+    for (size_t i = 0; i < count; ++i) {
+      detector_.AddSample(samples[i].x, samples[i].y,
+                          samples[i].timestamp_us);
+    }
+    profile_->Mark(StartupProfile::kFirstSample);
+  }
+
+  Clock::time_point OnWake(Clock::time_point) override {
+    profile_->Mark(StartupProfile::kDetectionReady);
+    return Clock::time_point::max();
+  }
+
+ private:
+  MouseMoveDetector detector_;
+  StartupProfile* profile_;
+};
+
+// Runs the app's startup with the platform parts left out: the cursor sets
+// for one monitor on the app's pool, the config, the sample worker and the
+// first sample through detection. The window and tray phases are Windows
+// only and show as not reached
+int ProfileStartup(const Options& options) {
+  SteadyMonotonicClock clock;
+  StartupProfile profile(&clock);
+
+  WorkStealingPool pool(4);
+  CursorSetCache sets(SyntheticCursors(13),
+                      {3.0, 6, ScaleFilter::kLanczos3, 96}, &pool);
+  sets.Sync({96});
+  profile.Mark(StartupProfile::kCursorsReady);
+
+  RuntimeConfig config;
+  if (!LoadReloadConfig(options, 0, &config)) {
+    std::cerr << "Invalid detector options" << std::endl;
+    return 1;
+  }
+  profile.Mark(StartupProfile::kConfigLoaded);
+
+  // The synthetic input is there from the start; detection is ready once
+  // the worker runs
+  StartupSink sink(config.shake, options.gesture_options, &profile);
+  SampleWorker worker;
+  profile.Mark(StartupProfile::kInputStarted);
+  worker.Start(&sink);
+
+  // Like hook callbacks, which only arrive once the app's message loop
+  // runs, the first sample comes once the worker waits for it
+  while (!profile.reached(StartupProfile::kDetectionReady)) {
+    std::this_thread::yield();
+  }
+  SyntheticMotion motion;
+  worker.Post(motion.Next());
+  while (!profile.reached(StartupProfile::kFirstSample)) {
+    std::this_thread::yield();
+  }
+  worker.Stop();
+
+  std::cout << profile.Report();
+  // Reached phases must be in order, the Windows only ones not reached
+  int64_t previous_us = 0;
+  bool ordered = true;
+  for (int i = 0; i < StartupProfile::kPhaseCount; ++i) {
+    int64_t elapsed =
+        profile.elapsed_us(static_cast<StartupProfile::Phase>(i));
+    if (elapsed == StartupProfile::kNotReached) continue;
+    ordered = ordered && elapsed >= previous_us;
+    previous_us = elapsed;
+  }
+  bool platform_skipped =
+      !profile.reached(StartupProfile::kWindowCreated) &&
+      !profile.reached(StartupProfile::kTrayIconAdded);
+  return ordered && platform_skipped ? 0 : 1;
+}
+
+#ifdef __linux__
+
+void PrintLatency(const char* name, const LatencyHistogram& histogram) {
+  std::cout << name << ": p50 " << std::fixed << std::setprecision(1)
+            << static_cast<double>(histogram.ValueAtPercentile(50.0)) / 1e3
+            << " us, p99 "
+            << static_cast<double>(histogram.ValueAtPercentile(99.0)) / 1e3
+            << " us, max "
+            << static_cast<double>(histogram.max_value()) / 1e3 << " us"
+            << std::defaultfloat << std::endl;
+}
+
+// Times how late the epoll event loop wakes up for a byte another thread
+// writes to a pipe and for a timer deadline, and checks that every Wait()
+// returns for the reason it was woken for and that nothing else wakes it.
+// The writer lets the loop go back to sleep before each write, so every
+// input wakeup is from idle as it is for the first event after a pause
+int BenchmarkWakeLatency(const Options& options) {
+  using Clock = EventLoop::Clock;
+  constexpr auto kIdleBeforeWrite = std::chrono::microseconds(200);
+  constexpr auto kDeadlineDelay = std::chrono::milliseconds(1);
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+    std::cerr << "Failed to create the input pipe" << std::endl;
+    return 1;
+  }
+  EpollEventLoop loop;
+  loop.AddInputFd(fds[0]);
+  uint64_t rounds = options.wake_rounds;
+  uint64_t wrong_reasons = 0;
+
+  LatencyHistogram input_ns;
+  std::atomic<int64_t> sent_ns{0};
+  std::atomic<uint64_t> handled{0};
+  std::thread writer([&] {
+    for (uint64_t i = 0; i < rounds; ++i) {
+      while (handled.load(std::memory_order_acquire) < i) {
+        std::this_thread::yield();
+      }
+      std::this_thread::sleep_for(kIdleBeforeWrite);
+      sent_ns.store(Clock::now().time_since_epoch().count(),
+                    std::memory_order_release);
+      char byte = 0;
+      ssize_t written = write(fds[1], &byte, 1);
+      (void)written;
+    }
+  });
+  for (uint64_t i = 0; i < rounds; ++i) {
+    EventLoop::WakeReason reason = loop.Wait(EventLoop::kNoDeadline);
+    int64_t woken_ns = Clock::now().time_since_epoch().count();
+    if (reason != EventLoop::WakeReason::kInput) {
+      ++wrong_reasons;
+    } else {
+      input_ns.Record(woken_ns - sent_ns.load(std::memory_order_acquire));
+      char byte;
+      while (read(fds[0], &byte, 1) == 1) {
+      }
+    }
+    handled.store(i + 1, std::memory_order_release);
+  }
+  writer.join();
+
+  LatencyHistogram deadline_ns;
+  for (uint64_t i = 0; i < rounds; ++i) {
+    Clock::time_point deadline = Clock::now() + kDeadlineDelay;
+    EventLoop::WakeReason reason = loop.Wait(deadline);
+    Clock::time_point woken = Clock::now();
+    if (reason != EventLoop::WakeReason::kDeadline || woken < deadline) {
+      ++wrong_reasons;
+    } else {
+      deadline_ns.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             woken - deadline)
+                             .count());
+    }
+  }
+
+  std::thread stopper([&loop, kIdleBeforeWrite] {
+    std::this_thread::sleep_for(kIdleBeforeWrite);
+    loop.Shutdown();
+  });
+  if (loop.Wait(EventLoop::kNoDeadline) != EventLoop::WakeReason::kShutdown) {
+    ++wrong_reasons;
+  }
+  stopper.join();
+  close(fds[0]);
+  close(fds[1]);
+
+  PrintLatency("Input wakeup", input_ns);
+  PrintLatency("Deadline overshoot", deadline_ns);
+  // One wakeup per input, deadline and the shutdown and none while idle
+  uint64_t extra_wakeups = loop.wakeup_count() - (2 * rounds + 1);
+  std::cout << wrong_reasons << " wrong wake reasons, " << extra_wakeups
+            << " extra wakeups" << std::endl;
+  return wrong_reasons == 0 && extra_wakeups == 0 ? 0 : 1;
+}
+
+// Record position of a diagnostic ring check, with every field derived from
+// it so a record mixing two writes is caught
+DiagnosticRecord RingCheckRecord(uint64_t position) {
+  DiagnosticRecord record = {};
+  record.timestamp_us = static_cast<int64_t>(position);
+  record.x = static_cast<int32_t>(position * 3);
+  record.y = -static_cast<int32_t>(position);
+  record.average_speed = static_cast<double>(position) * 0.5;
+  record.total_time_us = static_cast<int64_t>(position) * 7;
+  record.direction_changes = static_cast<int32_t>(position % 1000);
+  record.movement_count = static_cast<uint16_t>(position);
+  record.flags = static_cast<uint8_t>(position % 8);
+  return record;
+}
+
+bool SameRecord(const DiagnosticRecord& a, const DiagnosticRecord& b) {
+  return a.timestamp_us == b.timestamp_us && a.x == b.x && a.y == b.y &&
+         a.average_speed == b.average_speed &&
+         a.total_time_us == b.total_time_us &&
+         a.direction_changes == b.direction_changes &&
+         a.movement_count == b.movement_count && a.flags == b.flags;
+}
+
+// Writes options.ring_check_records records into a small diagnostic ring in
+// named shared memory while a reader attached by name follows it, so the
+// writer laps the reader over and over. Every record read must be whole and
+// newer than the last, and records read plus records lost must add up to
+// the records written. Then checks that the reader sees the last capacity
+// records after the writer stops, and that a slot caught mid-write is
+// skipped as lost rather than returned
+int CheckDiagnosticRing(const Options& options) {
+  constexpr uint32_t kCapacity = 64;
+  constexpr size_t kBatchSize = 16;
+  std::string name = "/trace_replay-ring-" + std::to_string(getpid());
+  const uint64_t total = options.ring_check_records;
+
+  DiagnosticRingWriter writer;
+  if (!writer.Create(name, kCapacity, DefaultRuntimeConfig().shake)) {
+    std::cerr << name << ": failed to create the shared memory" << std::endl;
+    return 1;
+  }
+  DiagnosticRingReader reader;
+  if (!reader.Open(name)) {
+    std::cerr << name << ": failed to attach to the shared memory"
+              << std::endl;
+    return 1;
+  }
+
+  std::atomic<bool> written{false};
+  std::thread writer_thread([&] {
+    for (uint64_t position = 0; position < total; ++position) {
+      writer.Append(RingCheckRecord(position));
+      if (position % 256 == 0) std::this_thread::yield();
+    }
+    written.store(true, std::memory_order_release);
+  });
+
+  DiagnosticRecord records[kBatchSize];
+  uint64_t position = 0;
+  uint64_t read = 0;
+  uint64_t lost = 0;
+  uint64_t torn = 0;
+  uint64_t out_of_order = 0;
+  int64_t last_timestamp_us = -1;
+  for (;;) {
+    bool done = written.load(std::memory_order_acquire);
+    size_t count;
+    while ((count = reader.Read(&position, records, kBatchSize, &lost)) > 0) {
+      for (size_t i = 0; i < count; ++i) {
+        const DiagnosticRecord& record = records[i];
+        if (!SameRecord(record, RingCheckRecord(static_cast<uint64_t>(
+                                    record.timestamp_us)))) {
+          ++torn;
+        } else if (record.timestamp_us <= last_timestamp_us) {
+          ++out_of_order;
+        } else {
+          last_timestamp_us = record.timestamp_us;
+        }
+      }
+      read += count;
+    }
+    if (done) break;
+    std::this_thread::yield();
+  }
+  writer_thread.join();
+
+  // A reader attaching now sees exactly the last kCapacity records
+  int problems = 0;
+  uint64_t end = reader.write_position();
+  uint64_t tail = end - kCapacity;
+  uint64_t tail_lost = 0;
+  DiagnosticRecord last[kCapacity];
+  if (end != total ||
+      reader.Read(&tail, last, kCapacity, &tail_lost) != kCapacity ||
+      tail_lost != 0) {
+    ++problems;
+  } else {
+    for (uint32_t i = 0; i < kCapacity; ++i) {
+      if (!SameRecord(last[i], RingCheckRecord(end - kCapacity + i))) {
+        ++problems;
+      }
+    }
+  }
+
+  // Mark the newest slot as being written, through a second writable
+  // mapping of the same name as the app's writer would leave it
+  SharedMemory region;
+  if (!region.Create(name, DiagnosticRing::RegionSize(kCapacity))) {
+    ++problems;
+  } else {
+    auto* slots = reinterpret_cast<DiagnosticRing::Slot*>(
+        region.data() + sizeof(DiagnosticRing::Header));
+    slots[(end - 1) % kCapacity].sequence.store(2 * (end - 1) + 1);
+    uint64_t newest = end - 1;
+    uint64_t newest_lost = 0;
+    if (reader.Read(&newest, last, 1, &newest_lost) != 0 ||
+        newest_lost != 1) {
+      ++problems;
+    }
+  }
+  region.Close();
+  reader.Close();
+  writer.Close();
+
+  std::cout << total << " records through a " << kCapacity
+            << "-slot ring: " << read << " read, " << lost << " lost, "
+            << torn << " torn, " << out_of_order << " out of order, "
+            << problems << " problems after the writer stopped" << std::endl;
+  return read + lost == total && torn == 0 && out_of_order == 0 &&
+                 problems == 0
+             ? 0
+             : 1;
+}
+
+#else
+
+int BenchmarkWakeLatency(const Options&) {
+  std::cerr << "--wake-latency times the epoll event loop and needs Linux"
+            << std::endl;
+  return 1;
+}
+
+int CheckDiagnosticRing(const Options&) {
+  std::cerr << "--shm-ring-check uses POSIX shared memory names and needs "
+               "Linux"
+            << std::endl;
+  return 1;
+}
+
+#endif
+
+}  // namespace
+
+// SyntheticMotion written to a temporary trace file, which is removed again
+// when this goes away
+class SyntheticTraceFile {
+ public:
+  SyntheticTraceFile() = default;
+  SyntheticTraceFile(const SyntheticTraceFile&) = delete;
+  SyntheticTraceFile& operator=(const SyntheticTraceFile&) = delete;
+
+  ~SyntheticTraceFile() {
+    std::error_code error;
+    if (!path_.empty()) std::filesystem::remove(path_, error);
+  }
+
+  bool Write(uint64_t event_count) {
+    std::error_code error;
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path(error);
+    if (error) return false;
+    path_ = directory /
+            ("trace_replay-synthetic-" +
+             std::to_string(std::chrono::steady_clock::now()
+                                .time_since_epoch()
+                                .count()) +
+             ".trace");
+    MouseTraceWriter writer;
+    if (!writer.Open(path_, {2000, 96})) return false;
+    SyntheticMotion motion;
+    for (uint64_t i = 0; i < event_count; ++i) writer.Append(motion.Next());
+    return writer.Close();
+  }
+
+  const std::filesystem::path& path() const { return path_; }
+
+ private:
+  std::filesystem::path path_;
+};
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage();
+    return 1;
+  }
+  SyntheticTraceFile synthetic;
+  if (options.synthetic_events > 0) {
+    if (!synthetic.Write(options.synthetic_events)) {
+      std::cerr << "Failed to write the synthetic trace" << std::endl;
+      return 1;
+    }
+    options.paths.push_back(synthetic.path().string());
+  }
+  if (options.reload_stress_events > 0) return StressReload(options);
+  if (options.ring_stress_events > 0) return StressRing(options);
+  if (options.logger_messages > 0) return StressLogger(options);
+  if (options.latency_check_samples > 0) {
+    return CheckLatencyRecording(options);
+  }
+  if (options.ring_check_records > 0) return CheckDiagnosticRing(options);
+  if (options.deadline_check_ops > 0) return CheckDeadlineScheduler(options);
+  if (options.spotlight_updates > 0) return BenchmarkSpotlight(options);
+  if (options.restore_check_rounds > 0) return CheckRestore(options);
+  if (options.swap_check) return CheckSwapCounts();
+  if (options.frame_check) return CheckFrameSchedule();
+  if (options.scaler_repeat > 0) return BenchmarkScaler(options);
+  if (options.cursor_set_dpis > 0) return BenchmarkCursorSets(options);
+  if (options.cache_startup_runs > 0) return BenchmarkCacheStartup(options);
+  if (options.startup) return ProfileStartup(options);
+  if (options.wake_rounds > 0) return BenchmarkWakeLatency(options);
+  if (options.streams > 0) return ReplayStreams(options);
+  if (options.gestures > 0) return BenchmarkGestures(options);
+  if (options.detector_events > 0) return BenchmarkDetector(options);
+  if (options.high_rate_samples > 0) return BenchmarkHighRate(options);
+  if (options.poll_sim) return SimulatePolling(options);
+
+  TraceReplay replay(options.shake_params, options.gesture_options,
+                     options.timing);
+  int failures = 0;
+  for (const std::string& path : options.paths) {
+    MouseTraceReader trace;
+    if (!trace.Open(path)) {
+      std::cerr << path << ": not a readable mouse trace" << std::endl;
+      ++failures;
+      continue;
+    }
+
+    ReplayResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.repeat; ++i) {
+      result = replay.Run(trace);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double events = static_cast<double>(result.sample_count) * options.repeat;
+    double rate = elapsed.count() > 0 ? events / elapsed.count() : 0.0;
+    MouseTraceInfo info = trace.info();
+    std::cout << path << ": " << result.sample_count << " samples ("
+              << info.sample_rate_hz << " Hz, " << info.dpi << " dpi), "
+              << result.enlarge_count << " enlargements, "
+              << result.restore_count << " restores, "
+              << result.shake_decisions << " shake decisions, " << std::fixed
+              << std::setprecision(1) << rate / 1e6 << " M events/s"
+              << std::defaultfloat << std::endl;
+
+    if (options.print_times) {
+      for (int64_t time_us : result.enlarge_times_us) {
+        std::cout << "  enlarge at " << std::fixed << std::setprecision(3)
+                  << static_cast<double>(time_us - result.start_time_us) / 1e6
+                  << " s" << std::defaultfloat << std::endl;
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
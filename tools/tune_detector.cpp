@@ -0,0 +1,273 @@
+// Searches shake detector thresholds over a labelled corpus of mouse traces
+// and ranks the configurations by F1 score, then by detection latency.
+//
+//   tune_detector [options] trace...
+//
+// Labels for each trace are read from "<trace>.labels"; see
+// DetectorTuner::LoadLabels for the format. A trace without a labels file
+// contains no shakes. --synthetic N adds N events of synthetic motion
+// labelled with its own shakes, so the tuner runs without captures. Ranges
+// are given as min:max:step, or a single value
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "detector_tuner.h"
+#include "runtime_config.h"
+#include "synthetic_motion.h"
+#include "work_stealing_pool.h"
+
+namespace {
+
+struct Options {
+  ParamRange history_size = {6, 16, 2};
+  ParamRange min_direction_changes = {3, 8, 1};
+  ParamRange min_movement_speed = {400, 1600, 200};
+  ParamRange max_time_window_ms = {300, 800, 100};
+  int64_t min_sample_interval_us =
+      DefaultRuntimeConfig().shake.min_sample_interval_us;
+  EnlargeTiming timing = DefaultRuntimeConfig().timing;
+  GestureOptions gestures = DefaultGestureOptions();
+  int64_t tolerance_us = 200 * 1000;
+  size_t random_count = 0;  // 0 searches the whole grid
+  uint64_t seed = 1;
+  unsigned threads = 0;
+  size_t top = 10;
+  uint64_t synthetic_events = 0;
+  double min_f1 = 0.0;
+  std::string csv_path;
+  std::vector<std::string> paths;
+};
+
+void PrintUsage() {
+  std::cerr
+      << "Usage: tune_detector [options] trace...\n"
+         "  --history R          Movements in the window (6:16:2)\n"
+         "  --changes R          Minimum direction changes (3:8:1)\n"
+         "  --speed R            Minimum speed, pixels/second (400:1600:200)\n"
+         "  --window-ms R        Maximum window duration (300:800:100)\n"
+         "  --interval-us N      Minimum sample interval (1000)\n"
+         "  --circle             Enlarge on drawn circles as well as shakes\n"
+         "  --tolerance-ms N     Late enlargements still matching a shake "
+         "(200)\n"
+         "  --random N           Evaluate N random points instead of the "
+         "grid\n"
+         "  --seed N             Seed for --random (1)\n"
+         "  --threads N          Worker threads (all cores)\n"
+         "  --top N              Configurations to print (10)\n"
+         "  --synthetic N        Add N events of labelled synthetic motion\n"
+         "  --min-f1 F           Fail if no configuration reaches F1 F\n"
+         "  --csv FILE           Write every result to FILE\n";
+}
+
+bool ParseRange(const char* text, ParamRange* range) {
+  char* end;
+  range->min = std::strtod(text, &end);
+  range->max = range->min;
+  range->step = 0;
+  if (*end == ':') range->max = std::strtod(end + 1, &end);
+  if (*end == ':') range->step = std::strtod(end + 1, &end);
+  if (range->max > range->min && range->step <= 0) range->step = 1;
+  return *end == '\0' && range->max >= range->min;
+}
+
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--circle") {
+      options->gestures.circle = true;
+      continue;
+    }
+    if (arg.rfind("--", 0) != 0) {
+      options->paths.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char* value = argv[++i];
+    bool ok = true;
+    if (arg == "--history") {
+      ok = ParseRange(value, &options->history_size);
+    } else if (arg == "--changes") {
+      ok = ParseRange(value, &options->min_direction_changes);
+    } else if (arg == "--speed") {
+      ok = ParseRange(value, &options->min_movement_speed);
+    } else if (arg == "--window-ms") {
+      ok = ParseRange(value, &options->max_time_window_ms);
+    } else if (arg == "--interval-us") {
+      options->min_sample_interval_us = std::atoll(value);
+    } else if (arg == "--tolerance-ms") {
+      options->tolerance_us = std::atoll(value) * 1000;
+    } else if (arg == "--random") {
+      options->random_count = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--seed") {
+      options->seed = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--threads") {
+      options->threads = static_cast<unsigned>(std::atoi(value));
+    } else if (arg == "--top") {
+      options->top = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--synthetic") {
+      options->synthetic_events = std::strtoull(value, nullptr, 10);
+    } else if (arg == "--min-f1") {
+      options->min_f1 = std::strtod(value, nullptr);
+    } else if (arg == "--csv") {
+      options->csv_path = value;
+    } else {
+      return false;
+    }
+    if (!ok) return false;
+  }
+  return !options->paths.empty() || options->synthetic_events > 0;
+}
+
+bool LoadCorpus(const std::vector<std::string>& paths,
+                std::vector<LabelledTrace>* corpus, size_t* shake_count) {
+  *shake_count = 0;
+  for (const std::string& path : paths) {
+    MouseTraceReader reader;
+    if (!reader.Open(path)) {
+      std::cerr << path << ": not a readable mouse trace" << std::endl;
+      return false;
+    }
+    LabelledTrace trace;
+    trace.name = path;
+    DetectorTuner::Decode(reader, &trace.samples);
+    std::filesystem::path labels_path = path + ".labels";
+    if (std::filesystem::exists(labels_path) &&
+        !DetectorTuner::LoadLabels(labels_path, reader.start_time_us(),
+                                   &trace.shakes)) {
+      std::cerr << labels_path.string() << ": malformed labels" << std::endl;
+      return false;
+    }
+    *shake_count += trace.shakes.size();
+    corpus->push_back(std::move(trace));
+  }
+  return true;
+}
+
+// SyntheticMotion labelled with the spans it spends shaking
+LabelledTrace SyntheticCorpusTrace(uint64_t event_count) {
+  LabelledTrace trace;
+  trace.name = "synthetic";
+  trace.samples.reserve(event_count);
+  SyntheticMotion motion;
+  bool shaking = false;
+  for (uint64_t i = 0; i < event_count; ++i) {
+    MouseSample sample = motion.Next();
+    trace.samples.push_back(sample);
+    if (motion.shaking() && !shaking) {
+      trace.shakes.push_back({sample.timestamp_us, sample.timestamp_us});
+    }
+    if (motion.shaking()) trace.shakes.back().end_us = sample.timestamp_us;
+    shaking = motion.shaking();
+  }
+  return trace;
+}
+
+// Higher F1 first, then lower latency
+bool Better(const TuneResult& a, const TuneResult& b) {
+  if (a.f1() != b.f1()) return a.f1() > b.f1();
+  return a.mean_latency_ms() < b.mean_latency_ms();
+}
+
+void PrintResult(std::ostream& out, const TuneResult& result) {
+  out << std::fixed << std::setprecision(3) << result.f1() << "  "
+      << result.precision() << "  " << result.recall() << "  "
+      << std::setprecision(1) << std::setw(7) << result.mean_latency_ms()
+      << "  " << std::setw(7) << result.max_latency_us / 1000.0 << "  "
+      << std::setw(3) << result.params.history_size << "  " << std::setw(3)
+      << result.params.min_direction_changes << "  " << std::setw(7)
+      << result.params.min_movement_speed << "  " << std::setw(7)
+      << result.params.max_time_window_us / 1000 << std::defaultfloat
+      << std::endl;
+}
+
+bool WriteCsv(const std::string& path, const std::vector<TuneResult>& results) {
+  std::ofstream out(path);
+  if (!out) return false;
+  out << "history_size,min_direction_changes,min_movement_speed,"
+         "max_time_window_ms,detected,missed,false_positives,duplicates,"
+         "precision,recall,f1,mean_latency_ms,max_latency_ms\n";
+  for (const TuneResult& result : results) {
+    out << result.params.history_size << ','
+        << result.params.min_direction_changes << ','
+        << result.params.min_movement_speed << ','
+        << result.params.max_time_window_us / 1000.0 << ',' << result.detected
+        << ',' << result.missed << ',' << result.false_positives << ','
+        << result.duplicates << ',' << result.precision() << ','
+        << result.recall() << ',' << result.f1() << ','
+        << result.mean_latency_ms() << ','
+        << result.max_latency_us / 1000.0 << '\n';
+  }
+  return static_cast<bool>(out);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  std::vector<LabelledTrace> corpus;
+  size_t shake_count;
+  if (!LoadCorpus(options.paths, &corpus, &shake_count)) return 1;
+  if (options.synthetic_events > 0) {
+    corpus.push_back(SyntheticCorpusTrace(options.synthetic_events));
+    shake_count += corpus.back().shakes.size();
+  }
+
+  ShakeParams base = {0, 0, 0.0, 0, options.min_sample_interval_us};
+  ParamSpace space(base, options.history_size, options.min_direction_changes,
+                   options.min_movement_speed, options.max_time_window_ms);
+  size_t config_count =
+      options.random_count > 0 ? options.random_count : space.GridSize();
+
+  DetectorTuner tuner(&corpus, options.gestures, options.timing,
+                      options.tolerance_us);
+  WorkStealingPool pool(options.threads);
+  std::cerr << "Evaluating " << config_count << " configurations over "
+            << corpus.size() << " traces (" << shake_count
+            << " labelled shakes) on " << pool.thread_count() << " threads"
+            << std::endl;
+
+  std::vector<TuneResult> results(config_count);
+  auto start = std::chrono::steady_clock::now();
+  pool.ParallelFor(config_count, 16, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      ShakeParams params = options.random_count > 0
+                               ? space.RandomPoint(options.seed, i)
+                               : space.GridPoint(i);
+      results[i] = tuner.Evaluate(params);
+    }
+  });
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Done in " << std::fixed << std::setprecision(2)
+            << elapsed.count() << " s, "
+            << config_count / std::max(elapsed.count(), 1e-9)
+            << " configurations/s" << std::defaultfloat << std::endl;
+
+  if (!options.csv_path.empty() && !WriteCsv(options.csv_path, results)) {
+    std::cerr << options.csv_path << ": write failed" << std::endl;
+    return 1;
+  }
+
+  size_t top = std::min(options.top, results.size());
+  std::partial_sort(results.begin(), results.begin() + top, results.end(),
+                    Better);
+  std::cout << "   f1   prec    rec  lat(ms)  max(ms)  his  chg    speed  "
+               "win(ms)"
+            << std::endl;
+  for (size_t i = 0; i < top; ++i) {
+    PrintResult(std::cout, results[i]);
+  }
+  return top > 0 && results[0].f1() >= options.min_f1 ? 0 : 1;
+}
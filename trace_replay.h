@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "adaptive_poll_rate.h"
+#include "deadline_scheduler.h"
+#include "enlarge_state_machine.h"
+#include "mouse_trace.h"
+#include "shake_app.h"
+
+// Outcome of replaying one trace
+struct ReplayResult {
+  uint64_t sample_count = 0;     // Samples fed to the detector
+  int64_t start_time_us = 0;     // Timestamp of the first sample
+  int64_t end_time_us = 0;       // Timestamp of the last sample
+  uint64_t shake_decisions = 0;  // Samples the detector reported as a shake
+  uint64_t enlarge_count = 0;
+  uint64_t restore_count = 0;
+  std::vector<int64_t> enlarge_times_us;  // Trace time of each enlargement
+};
+
+// Streams recorded samples through the app's gesture detector and the
+// enlarge state machine exactly as the app does, with trace timestamps as
+// the clock.
+// Samples are decoded in batches straight from the mapped file without
+// copying the trace
+class TraceReplay {
+ public:
+  TraceReplay(const ShakeParams& shake_params, const GestureOptions& gestures,
+              const EnlargeTiming& timing)
+      : shake_params_(shake_params), gestures_(gestures), timing_(timing) {}
+
+  ReplayResult Run(const MouseTraceReader& trace) const {
+    MouseMoveDetector detector(shake_params_, gestures_);
+    EnlargeStateMachine state_machine(timing_);
+    ReplayResult result;
+
+    MouseTraceDecoder decoder = trace.Decoder();
+    MouseSample batch[kBatchSize];
+    size_t count;
+    while ((count = decoder.Read(batch, kBatchSize)) > 0) {
+      if (result.sample_count == 0) {
+        result.start_time_us = batch[0].timestamp_us;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        const MouseSample& sample = batch[i];
+        bool shaking =
+            detector.AddSample(sample.x, sample.y, sample.timestamp_us)
+                .enlarge();
+        result.shake_decisions += shaking;
+        if (state_machine.OnDetection(shaking, sample.timestamp_us) ==
+            EnlargeStateMachine::Action::kEnlarge) {
+          result.enlarge_times_us.push_back(sample.timestamp_us);
+        }
+      }
+      result.sample_count += count;
+      result.end_time_us = batch[count - 1].timestamp_us;
+    }
+
+    Finish(&state_machine, &result);
+    return result;
+  }
+
+  // Replays the trace as polling mode sees it: the cursor is sampled on the
+  // poll_rate schedule, each poll reading the last recorded position at that
+  // time, and restores run on their own deadline timer as in the app. Each
+  // poll is one sample in the result
+  ReplayResult RunPolled(const MouseTraceReader& trace,
+                         const AdaptivePollParams& poll_params) const {
+    MouseMoveDetector detector(shake_params_, gestures_);
+    EnlargeStateMachine state_machine(timing_);
+    AdaptivePollRate poll_rate(poll_params);
+    ReplayResult result;
+
+    MouseTraceDecoder decoder = trace.Decoder();
+    MouseSample batch[kBatchSize];
+    size_t count = decoder.Read(batch, kBatchSize);
+    if (count == 0) return result;
+    size_t next = 0;
+    MouseSample position = batch[0];
+    result.start_time_us = position.timestamp_us;
+    int32_t polled_x = position.x;
+    int32_t polled_y = position.y;
+
+    DeadlineScheduler timers;
+    DeadlineScheduler::TimerId restore_timer = timers.Add(
+        [&state_machine](int64_t now_us) { state_machine.Tick(now_us); });
+    DeadlineScheduler::TimerId poll_timer = 0;
+    poll_timer = timers.Add([&](int64_t now_us) {
+      // Move the cursor to where the trace has it at this poll
+      while (count > 0 && batch[next].timestamp_us <= now_us) {
+        position = batch[next];
+        if (++next == count) {
+          count = decoder.Read(batch, kBatchSize);
+          next = 0;
+        }
+      }
+
+      bool moved = position.x != polled_x || position.y != polled_y;
+      polled_x = position.x;
+      polled_y = position.y;
+      bool shaking =
+          detector.AddSample(position.x, position.y, now_us).enlarge();
+      result.shake_decisions += shaking;
+      if (state_machine.OnDetection(shaking, now_us) ==
+          EnlargeStateMachine::Action::kEnlarge) {
+        result.enlarge_times_us.push_back(now_us);
+      }
+      ++result.sample_count;
+      result.end_time_us = now_us;
+      if (count > 0) {
+        timers.Arm(poll_timer, now_us + poll_rate.OnPoll(moved, now_us));
+      }
+    });
+
+    timers.Arm(poll_timer, position.timestamp_us);
+    int64_t now_us;
+    while ((now_us = timers.NextDeadline()) != DeadlineScheduler::kNoDeadline) {
+      timers.RunExpired(now_us);
+      timers.Arm(restore_timer, state_machine.NextDeadline());
+    }
+
+    Finish(&state_machine, &result);
+    return result;
+  }
+
+ private:
+  static constexpr size_t kBatchSize = 256;
+
+  // Applies a restore still pending at the end of the trace
+  static void Finish(EnlargeStateMachine* state_machine,
+                     ReplayResult* result) {
+    if (state_machine->state() == EnlargeStateMachine::State::kEnlarged) {
+      state_machine->Tick(state_machine->NextDeadline());
+    }
+    result->enlarge_count = state_machine->enlarge_count();
+    result->restore_count = state_machine->restore_count();
+  }
+
+  ShakeParams shake_params_;
+  GestureOptions gestures_;
+  EnlargeTiming timing_;
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool with one task deque per worker. A worker takes tasks from the
+// front of its own deque and, when that is empty, steals from the back of
+// the others, so uneven tasks still keep every core busy. Tasks submitted
+// from inside a task go to the submitting worker's own deque
+class WorkStealingPool {
+ public:
+  explicit WorkStealingPool(unsigned thread_count = 0) {
+    if (thread_count == 0) {
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < thread_count; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < thread_count; ++i) {
+      threads_.emplace_back(&WorkStealingPool::ThreadMain, this, i);
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      stop_ = true;
+    }
+    wake_cv_.notify_all();
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(std::function<void()> task) {
+    unfinished_.fetch_add(1);
+    const WorkerSlot& slot = CurrentWorker();
+    size_t index = slot.pool == this
+                       ? slot.index
+                       : next_queue_.fetch_add(1) % queues_.size();
+    {
+      Queue& queue = *queues_[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      ++queued_;
+    }
+    wake_cv_.notify_one();
+  }
+
+  // Blocks until every submitted task has finished. Must not be called from
+  // a task
+  void Wait() {
+    std::unique_lock<std::mutex> lock(done_mutex_);
+    done_cv_.wait(lock, [this] { return unfinished_.load() == 0; });
+  }
+
+  // Runs fn(begin, end) over [0, count) in chunks of grain and waits
+  template <typename Fn>
+  void ParallelFor(size_t count, size_t grain, Fn fn) {
+    grain = std::max<size_t>(grain, 1);
+    for (size_t begin = 0; begin < count; begin += grain) {
+      size_t end = std::min(count, begin + grain);
+      Submit([fn, begin, end] { fn(begin, end); });
+    }
+    Wait();
+  }
+
+  unsigned thread_count() const {
+    return static_cast<unsigned>(threads_.size());
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  struct WorkerSlot {
+    WorkStealingPool* pool = nullptr;
+    size_t index = 0;
+  };
+
+  // Pool and queue of the calling thread, if it is a worker
+  static WorkerSlot& CurrentWorker() {
+    static thread_local WorkerSlot slot;
+    return slot;
+  }
+
+  void ThreadMain(size_t index) {
+    CurrentWorker() = {this, index};
+
+    std::function<void()> task;
+    for (;;) {
+      if (TakeTask(index, &task)) {
+        task();
+        task = nullptr;
+        if (unfinished_.fetch_sub(1) == 1) {
+          std::lock_guard<std::mutex> lock(done_mutex_);
+          done_cv_.notify_all();
+        }
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_cv_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+      if (stop_ && queued_.load() == 0) return;
+    }
+  }
+
+  bool TakeTask(size_t index, std::function<void()>* task) {
+    size_t count = queues_.size();
+    for (size_t i = 0; i < count; ++i) {
+      Queue& queue = *queues_[(index + i) % count];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) continue;
+      if (i == 0) {
+        *task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      } else {
+        *task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      queued_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_queue_{0};
+  std::atomic<size_t> unfinished_{0};
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  std::atomic<size_t> queued_{0};  // Only incremented under wake_mutex_
+  bool stop_ = false;
+
+  std::mutex done_mutex_;
+  std::condition_variable done_cv_;
+};